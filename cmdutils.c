@@ -1036,6 +1036,14 @@ int opt_max_alloc(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+int opt_huge_page_threshold(void *optctx, const char *opt, const char *arg)
+{
+    /* buffers are allocated with int sizes */
+    int size = parse_number_or_die(opt, arg, OPT_INT64, 0, INT_MAX);
+    av_buffer_huge_page_threshold(size);
+    return 0;
+}
+
 int opt_timelimit(void *optctx, const char *opt, const char *arg)
 {
 #if HAVE_SETRLIMIT
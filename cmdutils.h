@@ -103,6 +103,11 @@ int opt_report(const char *opt);
 
 int opt_max_alloc(void *optctx, const char *opt, const char *arg);
 
+/**
+ * Set the size from which frame buffers are backed by huge pages.
+ */
+int opt_huge_page_threshold(void *optctx, const char *opt, const char *arg);
+
 int opt_codec_debug(void *optctx, const char *opt, const char *arg);
 
 #if CONFIG_OPENCL
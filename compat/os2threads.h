@@ -30,6 +30,7 @@
 #include <os2.h>
 
 #undef __STRICT_ANSI__          /* for _beginthread() */
+#include <errno.h>
 #include <stdlib.h>
 
 #include <sys/builtin.h>
@@ -117,6 +118,14 @@ static av_always_inline int pthread_mutex_lock(pthread_mutex_t *mutex)
     return 0;
 }
 
+static av_always_inline int pthread_mutex_trylock(pthread_mutex_t *mutex)
+{
+    if (DosRequestMutexSem(*(PHMTX)mutex, SEM_IMMEDIATE_RETURN))
+        return EBUSY;
+
+    return 0;
+}
+
 static av_always_inline int pthread_mutex_unlock(pthread_mutex_t *mutex)
 {
     DosReleaseMutexSem(*(PHMTX)mutex);
@@ -127,6 +127,10 @@ static inline int pthread_mutex_lock(pthread_mutex_t *m)
     EnterCriticalSection(m);
     return 0;
 }
+static inline int pthread_mutex_trylock(pthread_mutex_t *m)
+{
+    return TryEnterCriticalSection(m) ? 0 : EBUSY;
+}
 static inline int pthread_mutex_unlock(pthread_mutex_t *m)
 {
     LeaveCriticalSection(m);
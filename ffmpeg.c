@@ -44,6 +44,7 @@
 #include "libswresample/swresample.h"
 #include "libavutil/opt.h"
 #include "libavutil/channel_layout.h"
+#include "libavutil/cpu.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/samplefmt.h"
 #include "libavutil/fifo.h"
@@ -59,6 +60,7 @@
 #include "libavutil/bprint.h"
 #include "libavutil/time.h"
 #include "libavutil/threadmessage.h"
+#include "libavutil/trace.h"
 #include "libavcodec/mathops.h"
 #include "libavformat/os_support.h"
 
@@ -132,6 +134,7 @@ static int run_as_daemon  = 0;
 static int nb_frames_dup = 0;
 static int nb_frames_drop = 0;
 static int64_t decode_error_stat[2];
+static int64_t memory_estimate;
 
 static int want_sdp = 1;
 
@@ -162,6 +165,7 @@ static int restore_tty;
 
 #if HAVE_PTHREADS
 static void free_input_threads(void);
+static int init_input_threads(void);
 #endif
 
 /* sub2video hack:
@@ -472,6 +476,10 @@ static void ffmpeg_cleanup(int ret)
         int maxrss = getmaxrss() / 1024;
         av_log(NULL, AV_LOG_INFO, "bench: maxrss=%ikB\n", maxrss);
     }
+    if (max_memory > 0)
+        av_log(NULL, AV_LOG_INFO, "Memory budget %"PRId64"kB, estimated use "
+               "%"PRId64"kB, maxrss %"PRId64"kB\n", max_memory / 1024,
+               memory_estimate / 1024, getmaxrss() / 1024);
 
     for (i = 0; i < nb_filtergraphs; i++) {
         FilterGraph *fg = filtergraphs[i];
@@ -585,7 +593,19 @@ static void ffmpeg_cleanup(int ret)
     av_freep(&output_streams);
     av_freep(&output_files);
 
+    if (trace_file) {
+        int nb_events = av_trace_dump(trace_file);
+        if (nb_events < 0)
+            av_log(NULL, AV_LOG_ERROR, "Error writing trace to %s: %s\n",
+                   trace_file, av_err2str(nb_events));
+        else
+            av_log(NULL, AV_LOG_VERBOSE, "Wrote %d trace events to %s\n",
+                   nb_events, trace_file);
+        av_trace_free();
+    }
+
     uninit_opts();
+    av_opt_free_indexes();
 
     avformat_network_deinit();
 
@@ -862,6 +882,29 @@ static int check_recording_time(OutputStream *ost)
     return 1;
 }
 
+/* After a seek restart, drop the packets the encoder still returns for
+ * frames from before it, and move the others back from the encoder's
+ * continuous timeline. Returns 1 if the packet was dropped. */
+static int restart_filter_packet(OutputStream *ost, AVPacket *pkt)
+{
+    ost->packets_encoded++;
+    if (ost->restart_drop) {
+        /* Video encoders may code the frames they still hold as B-frames
+         * referencing the new keyframe, so go by timestamp there. */
+        if (ost->enc_ctx->codec_type != AVMEDIA_TYPE_VIDEO ||
+            (pkt->pts != AV_NOPTS_VALUE && pkt->pts < ost->restart_next_pts)) {
+            ost->restart_drop--;
+            av_packet_unref(pkt);
+            return 1;
+        }
+    }
+    if (pkt->pts != AV_NOPTS_VALUE)
+        pkt->pts -= ost->restart_pts_offset;
+    if (pkt->dts != AV_NOPTS_VALUE)
+        pkt->dts -= ost->restart_pts_offset;
+    return 0;
+}
+
 static void do_audio_out(OutputFile *of, OutputStream *ost,
                          AVFrame *frame)
 {
@@ -882,6 +925,12 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
     ost->samples_encoded += frame->nb_samples;
     ost->frames_encoded++;
 
+    if (ost->seek_restart) {
+        ost->restart_pts_offset = ost->restart_next_pts - frame->pts;
+        ost->seek_restart = 0;
+    }
+    frame->pts += ost->restart_pts_offset;
+
     av_assert0(pkt.size || !pkt.data);
     update_benchmark(NULL);
     if (debug_ts) {
@@ -904,6 +953,9 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
 
         update_benchmark("encode_audio %d.%d", ost->file_index, ost->index);
 
+        if (restart_filter_packet(ost, &pkt))
+            continue;
+
         av_packet_rescale_ts(&pkt, enc->time_base, ost->st->time_base);
 
         if (debug_ts) {
@@ -1046,6 +1098,10 @@ static void do_video_out(OutputFile *of,
                                           ost->last_nb0_frames[1],
                                           ost->last_nb0_frames[2]);
     } else {
+        /* the input jumped, continue from the new position as at the start */
+        if (ost->seek_restart)
+            ost->sync_opts = lrint(sync_ipts);
+
         delta0 = sync_ipts - ost->sync_opts; // delta0 is the "drift" between the input frame (next_picture) and where it would fall in the output.
         delta  = delta0 + duration;
 
@@ -1207,6 +1263,23 @@ static void do_video_out(OutputFile *of,
 
         pts_time = in_picture->pts != AV_NOPTS_VALUE ?
             in_picture->pts * av_q2d(enc->time_base) : NAN;
+
+        /* Continue as if encoding started at this frame, which must not
+         * reference the frames from before the restart. */
+        if (ost->seek_restart) {
+            ost->restart_pts_offset = ost->restart_next_pts - in_picture->pts;
+            ost->seek_restart = 0;
+            forced_keyframe = 1;
+            ost->forced_kf_index = 0;
+            while (ost->forced_kf_index < ost->forced_kf_count &&
+                   ost->forced_kf_pts[ost->forced_kf_index] < in_picture->pts)
+                ost->forced_kf_index++;
+            ost->forced_keyframes_expr_const_values[FKF_N] = 0;
+            ost->forced_keyframes_expr_const_values[FKF_N_FORCED] = 0;
+            ost->forced_keyframes_expr_const_values[FKF_PREV_FORCED_N] = NAN;
+            ost->forced_keyframes_expr_const_values[FKF_PREV_FORCED_T] = NAN;
+        }
+
         if (ost->forced_kf_index < ost->forced_kf_count &&
             in_picture->pts >= ost->forced_kf_pts[ost->forced_kf_index]) {
             ost->forced_kf_index++;
@@ -1254,6 +1327,7 @@ static void do_video_out(OutputFile *of,
 
         ost->frames_encoded++;
 
+        in_picture->pts += ost->restart_pts_offset;
         ret = avcodec_send_frame(enc, in_picture);
         if (ret < 0)
             goto error;
@@ -1273,6 +1347,9 @@ static void do_video_out(OutputFile *of,
                        av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &enc->time_base));
             }
 
+            if (restart_filter_packet(ost, &pkt))
+                continue;
+
             if (pkt.pts == AV_NOPTS_VALUE && !(enc->codec->capabilities & AV_CODEC_CAP_DELAY))
                 pkt.pts = ost->sync_opts;
 
@@ -1921,6 +1998,8 @@ static void flush_encoders(void)
                     av_packet_unref(&pkt);
                     continue;
                 }
+                if (restart_filter_packet(ost, &pkt))
+                    continue;
                 av_packet_rescale_ts(&pkt, enc->time_base, ost->st->time_base);
                 pkt_size = pkt.size;
                 output_packet(of, &pkt, ost);
@@ -2769,6 +2848,47 @@ static int get_buffer(AVCodecContext *s, AVFrame *frame, int flags)
     return avcodec_default_get_buffer2(s, frame, flags);
 }
 
+/**
+ * Get the channel layout all the encoders fed by an audio input stream will
+ * consume, or 0 if they differ. Only valid once the filtergraphs have been
+ * configured.
+ *
+ * @return 0 if some consumer of the stream is unknown, 1 otherwise
+ */
+static int get_audio_output_layout(InputStream *ist, uint64_t *channel_layout)
+{
+    int i, j, first = 1;
+
+    *channel_layout = 0;
+
+    if (ist->dec_ctx->codec_type != AVMEDIA_TYPE_AUDIO || !ist->nb_filters)
+        return 0;
+
+    for (i = 0; i < ist->nb_filters; i++) {
+        FilterGraph *fg = ist->filters[i]->graph;
+
+        for (j = 0; j < fg->nb_outputs; j++) {
+            OutputFilter *ofilter = fg->outputs[j];
+            AVFilterLink *link;
+
+            if (!ofilter->ost || !ofilter->filter ||
+                !ofilter->filter->nb_inputs || !ofilter->filter->inputs[0])
+                return 0;
+            link = ofilter->filter->inputs[0];
+            if (!link->channels || !link->sample_rate)
+                return 0;
+
+            if (first)
+                *channel_layout = link->channel_layout;
+            else if (*channel_layout != link->channel_layout)
+                *channel_layout = 0;
+            first = 0;
+        }
+    }
+
+    return 1;
+}
+
 static int init_input_stream(int ist_index, char *error, int error_len)
 {
     int ret;
@@ -2797,6 +2917,22 @@ static int init_input_stream(int ist_index, char *error, int error_len)
 
         av_dict_set(&ist->decoder_opts, "sub_text_format", "ass", AV_DICT_DONT_OVERWRITE);
 
+        if (ist->dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
+            uint64_t channel_layout;
+            int known = get_audio_output_layout(ist, &channel_layout);
+
+            /* Let decoders that can produce a downmix themselves (TrueHD/MLP
+             * substreams, (E-)AC-3, DTS) decode only what the output keeps,
+             * instead of decoding every channel and rematrixing afterwards. */
+            if (known && channel_layout && !ist->dec_ctx->request_channel_layout &&
+                !av_dict_get(ist->decoder_opts, "request_channel_layout", NULL, 0) &&
+                ist->dec_ctx->channels > av_get_channel_layout_nb_channels(channel_layout)) {
+                av_log(NULL, AV_LOG_VERBOSE, "Requesting a %d channel downmix from the decoder for input stream #%d:%d\n",
+                       av_get_channel_layout_nb_channels(channel_layout), ist->file_index, ist->st->index);
+                ist->dec_ctx->request_channel_layout = channel_layout;
+            }
+        }
+
         /* Useful for subtitles retiming by lavf (FIXME), skipping samples in
          * audio, and video decoders such as cuvid or mediacodec */
         av_codec_set_pkt_timebase(ist->dec_ctx, ist->st->time_base);
@@ -3308,6 +3444,221 @@ static void set_encoder_id(OutputFile *of, OutputStream *ost)
                 AV_DICT_DONT_STRDUP_VAL | AV_DICT_DONT_OVERWRITE);
 }
 
+/* Reference frames kept by the H.264 and HEVC decoders at 4K */
+#define BUDGET_REF_FRAMES     6
+/* Default libx264 lookahead */
+#define BUDGET_X264_LOOKAHEAD 40
+
+static int budget_thread_count(AVDictionary *opts, int height)
+{
+    AVDictionaryEntry *e = av_dict_get(opts, "threads", NULL, 0);
+    int nb_cpus;
+
+    if (e && strcmp(e->value, "auto"))
+        return FFMAX(atoi(e->value), 1);
+
+    /* as chosen by libavcodec for "auto" */
+    nb_cpus = av_cpu_count();
+    if (height)
+        nb_cpus = FFMIN(nb_cpus, (height + 15) / 16);
+    return nb_cpus > 1 ? FFMIN(nb_cpus + 1, 16) : 1;
+}
+
+static int budget_lookahead(OutputStream *ost)
+{
+    AVDictionaryEntry *e;
+
+    if (!ost->enc || strcmp(ost->enc->name, "libx264"))
+        return 0;
+    e = av_dict_get(ost->encoder_opts, "rc-lookahead", NULL, 0);
+    return e ? atoi(e->value) : BUDGET_X264_LOOKAHEAD;
+}
+
+static int64_t budget_frame_size(int format, int width, int height)
+{
+    int size = av_image_get_buffer_size(format == AV_PIX_FMT_NONE ?
+                                        AV_PIX_FMT_YUV420P : format,
+                                        width, height, 32);
+    return FFMAX(size, 0);
+}
+
+/* size of a video packet, the other ones being much smaller */
+static int64_t budget_packet_size(AVFormatContext *ic)
+{
+    AVRational rate = { 25, 1 };
+    int i;
+
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+            st->avg_frame_rate.num > 0 && st->avg_frame_rate.den > 0) {
+            rate = st->avg_frame_rate;
+            break;
+        }
+    }
+    return ic->bit_rate > 0 ? av_rescale(ic->bit_rate / 8, rate.den, rate.num) : 0;
+}
+
+static int64_t estimate_memory(void)
+{
+    int64_t total = 0;
+    int i, j;
+
+    /* packets queued by the input threads */
+    for (i = 0; i < nb_input_files && nb_input_files > 1; i++)
+        total += input_files[i]->thread_queue_size *
+                 budget_packet_size(input_files[i]->ctx);
+
+    /* every frame thread decodes into a frame of its own */
+    for (i = 0; i < nb_input_streams; i++) {
+        InputStream *ist = input_streams[i];
+        AVCodecParameters *par = ist->st->codecpar;
+        const AVCodecDescriptor *desc = avcodec_descriptor_get(par->codec_id);
+        int refs = desc && desc->props & AV_CODEC_PROP_INTRA_ONLY ? 0 : BUDGET_REF_FRAMES;
+
+        if (!ist->decoding_needed || par->codec_type != AVMEDIA_TYPE_VIDEO)
+            continue;
+        total += budget_frame_size(par->format, par->width, par->height) *
+                 (budget_thread_count(ist->decoder_opts, par->height) + refs);
+    }
+
+    /* about a frame in the pool of every filter, at the largest size */
+    for (i = 0; i < nb_filtergraphs; i++) {
+        FilterGraph *fg = filtergraphs[i];
+        int64_t frame_size = 0;
+
+        if (!fg->graph)
+            continue;
+        for (j = 0; j < fg->nb_inputs; j++) {
+            AVCodecParameters *par = fg->inputs[j]->ist->st->codecpar;
+            if (par->codec_type == AVMEDIA_TYPE_VIDEO)
+                frame_size = FFMAX(frame_size, budget_frame_size(par->format, par->width, par->height));
+        }
+        for (j = 0; j < fg->nb_outputs; j++) {
+            AVCodecContext *enc_ctx = fg->outputs[j]->ost->enc_ctx;
+            if (enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO)
+                frame_size = FFMAX(frame_size, budget_frame_size(enc_ctx->pix_fmt, enc_ctx->width, enc_ctx->height));
+        }
+        total += frame_size * fg->graph->nb_filters;
+    }
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+        AVCodecContext *enc_ctx = ost->enc_ctx;
+
+        if (ost->stream_copy || enc_ctx->codec_type != AVMEDIA_TYPE_VIDEO)
+            continue;
+        total += budget_frame_size(enc_ctx->pix_fmt, enc_ctx->width, enc_ctx->height) *
+                 (budget_thread_count(ost->encoder_opts, enc_ctx->height) +
+                  budget_lookahead(ost) + FFMAX(enc_ctx->max_b_frames, 0) + 1);
+    }
+
+    /* packets buffered for interleaving */
+    for (i = 0; i < nb_output_files; i++) {
+        AVFormatContext *oc = output_files[i]->ctx;
+        int64_t bit_rate = 0;
+
+        for (j = 0; j < oc->nb_streams; j++) {
+            OutputStream *ost = output_streams[output_files[i]->ost_index + j];
+            InputStream *ist = get_input_stream(ost);
+
+            if (!ost->stream_copy && ost->enc_ctx->bit_rate > 0)
+                bit_rate += ost->enc_ctx->bit_rate;
+            else if (ist && ist->st->codecpar->bit_rate > 0)
+                bit_rate += ist->st->codecpar->bit_rate;
+        }
+        total += av_rescale(bit_rate / 8, oc->max_interleave_delta, AV_TIME_BASE);
+    }
+
+    return total;
+}
+
+static void budget_set_int(AVDictionary **opts, const char *key, int val)
+{
+    char buf[16];
+
+    snprintf(buf, sizeof(buf), "%d", val);
+    av_dict_set(opts, key, buf, 0);
+}
+
+/*
+ * Shrink the queues, the lookahead and the thread counts, in the order of
+ * the least throughput lost per byte saved, until the estimated memory use
+ * fits in max_memory.
+ */
+static void apply_memory_budget(void)
+{
+    int i, val;
+
+    memory_estimate = estimate_memory();
+    av_log(NULL, AV_LOG_VERBOSE, "Estimated memory use %"PRId64"kB, budget %"PRId64"kB\n",
+           memory_estimate / 1024, max_memory / 1024);
+
+    for (i = 0; i < nb_output_files && memory_estimate > max_memory; i++) {
+        AVFormatContext *oc = output_files[i]->ctx;
+        while (memory_estimate > max_memory && oc->max_interleave_delta > AV_TIME_BASE) {
+            oc->max_interleave_delta = FFMAX(oc->max_interleave_delta / 2, AV_TIME_BASE);
+            memory_estimate = estimate_memory();
+        }
+        av_log(NULL, AV_LOG_VERBOSE, "Output #%d: max_interleave_delta %"PRId64"\n",
+               i, oc->max_interleave_delta);
+    }
+
+    for (i = 0; i < nb_input_files && memory_estimate > max_memory; i++) {
+        InputFile *f = input_files[i];
+        while (memory_estimate > max_memory && f->thread_queue_size > 8) {
+            f->thread_queue_size = FFMAX(f->thread_queue_size / 2, 8);
+            memory_estimate = estimate_memory();
+        }
+        av_log(NULL, AV_LOG_VERBOSE, "Input #%d: thread_queue_size %d\n",
+               i, f->thread_queue_size);
+    }
+
+    for (i = 0; i < nb_output_streams && memory_estimate > max_memory; i++) {
+        OutputStream *ost = output_streams[i];
+        if (ost->stream_copy || !(val = budget_lookahead(ost)))
+            continue;
+        while (memory_estimate > max_memory && val > 10) {
+            val = FFMAX(val / 2, 10);
+            budget_set_int(&ost->encoder_opts, "rc-lookahead", val);
+            memory_estimate = estimate_memory();
+        }
+        av_log(NULL, AV_LOG_VERBOSE, "Output stream #%d:%d: rc-lookahead %d\n",
+               ost->file_index, ost->index, val);
+    }
+
+    for (i = 0; i < nb_input_streams && memory_estimate > max_memory; i++) {
+        InputStream *ist = input_streams[i];
+        if (!ist->decoding_needed || ist->st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO)
+            continue;
+        val = budget_thread_count(ist->decoder_opts, ist->st->codecpar->height);
+        while (memory_estimate > max_memory && val > 1) {
+            budget_set_int(&ist->decoder_opts, "threads", --val);
+            memory_estimate = estimate_memory();
+        }
+        av_log(NULL, AV_LOG_VERBOSE, "Input stream #%d:%d: %d decoding threads\n",
+               ist->file_index, ist->st->index, val);
+    }
+
+    for (i = 0; i < nb_output_streams && memory_estimate > max_memory; i++) {
+        OutputStream *ost = output_streams[i];
+        if (ost->stream_copy || ost->enc_ctx->codec_type != AVMEDIA_TYPE_VIDEO)
+            continue;
+        val = budget_thread_count(ost->encoder_opts, ost->enc_ctx->height);
+        while (memory_estimate > max_memory && val > 1) {
+            budget_set_int(&ost->encoder_opts, "threads", --val);
+            memory_estimate = estimate_memory();
+        }
+        av_log(NULL, AV_LOG_VERBOSE, "Output stream #%d:%d: %d encoding threads\n",
+               ost->file_index, ost->index, val);
+    }
+
+    if (memory_estimate > max_memory)
+        av_log(NULL, AV_LOG_WARNING, "Estimated memory use %"PRId64"kB exceeds "
+               "max_memory even with the smallest queues and thread counts\n",
+               memory_estimate / 1024);
+}
+
 static int transcode_init(void)
 {
     int ret = 0, i, j, k;
@@ -3549,6 +3900,9 @@ static int transcode_init(void)
         }
     }
 
+    if (max_memory > 0)
+        apply_memory_budget();
+
     /* init input streams */
     for (i = 0; i < nb_input_streams; i++)
         if ((ret = init_input_stream(i, error, sizeof(error))) < 0) {
@@ -3767,6 +4121,122 @@ static void set_tty_echo(int on)
 #endif
 }
 
+static int can_seek_restart(void)
+{
+    int i;
+
+    if (!copy_ts) {
+        av_log(NULL, AV_LOG_ERROR, "Seek restarts need -copyts\n");
+        return 0;
+    }
+    for (i = 0; i < nb_input_files; i++) {
+        if (input_files[i]->eof_reached) {
+            av_log(NULL, AV_LOG_ERROR, "Input #%d is finished, cannot seek restart\n", i);
+            return 0;
+        }
+    }
+    for (i = 0; i < nb_output_files; i++) {
+        AVFormatContext *os = output_files[i]->ctx;
+        if (!output_files[i]->header_written ||
+            !av_opt_find(os, "seek_restart", NULL, 0, AV_OPT_SEARCH_CHILDREN)) {
+            av_log(NULL, AV_LOG_ERROR, "Output #%d (%s) cannot seek restart\n",
+                   i, os->oformat->name);
+            return 0;
+        }
+    }
+    for (i = 0; i < nb_output_streams; i++) {
+        if (output_streams[i]->finished) {
+            av_log(NULL, AV_LOG_ERROR, "Output stream #%d:%d is finished, cannot seek restart\n",
+                   output_streams[i]->file_index, output_streams[i]->index);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Continue all outputs from input position ts, at segment number segment of
+ * the segmenting muxers, instead of restarting the whole transcode with -ss
+ * and -skip_to_segment/-segment_start_number: the inputs are seeked, the
+ * decoders and filtergraphs flushed, and the encoders keep running, with a
+ * keyframe at the new position. */
+static int seek_restart(int64_t ts, int segment)
+{
+    int i, j, ret;
+
+#if HAVE_PTHREADS
+    free_input_threads();
+#endif
+
+    for (i = 0; i < nb_input_files; i++) {
+        InputFile *ifile = input_files[i];
+        AVFormatContext *is = ifile->ctx;
+        int64_t timestamp = ts;
+
+        if (is->start_time != AV_NOPTS_VALUE)
+            timestamp += is->start_time;
+        ret = avformat_seek_file(is, -1, INT64_MIN, timestamp, timestamp, 0);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "%s: could not seek to position %0.3f\n",
+                   is->filename, (double)timestamp / AV_TIME_BASE);
+            return ret;
+        }
+        /* moves the -ss trim of accurate seeking to the new position */
+        ifile->start_time = ts;
+
+        for (j = 0; j < ifile->nb_streams; j++) {
+            InputStream *ist = input_streams[ifile->ist_index + j];
+
+            if (ist->decoding_needed)
+                avcodec_flush_buffers(ist->dec_ctx);
+            ist->saw_first_ts = 0;
+            ist->next_pts = AV_NOPTS_VALUE;
+            ist->next_dts = AV_NOPTS_VALUE;
+            ist->filter_in_rescale_delta_last = AV_NOPTS_VALUE;
+        }
+    }
+
+    /* drop the frames buffered in the filters */
+    for (i = 0; i < nb_filtergraphs; i++) {
+        if (filtergraphs[i]->graph &&
+            (ret = configure_filtergraph(filtergraphs[i])) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Error reinitializing filters!\n");
+            return ret;
+        }
+    }
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        if (ost->encoding_needed) {
+            ost->seek_restart       = 1;
+            ost->restart_next_pts   = ost->sync_opts + ost->restart_pts_offset;
+            ost->restart_drop       = ost->frames_encoded - ost->packets_encoded;
+        }
+    }
+
+    for (i = 0; i < nb_output_files; i++) {
+        AVFormatContext *os = output_files[i]->ctx;
+
+        /* the packets still interleaved go to the current segments */
+        if ((ret = av_interleaved_write_frame(os, NULL)) < 0)
+            return ret;
+        av_opt_set_int(os, "seek_restart", segment, AV_OPT_SEARCH_CHILDREN);
+    }
+    for (i = 0; i < nb_output_streams; i++) {
+        output_streams[i]->last_mux_dts = AV_NOPTS_VALUE;
+        output_streams[i]->st->cur_dts  = AV_NOPTS_VALUE;
+    }
+
+    av_log(NULL, AV_LOG_INFO, "Restarted at %0.3f, segment %d\n",
+           (double)ts / AV_TIME_BASE, segment);
+
+#if HAVE_PTHREADS
+    if ((ret = init_input_threads()) < 0)
+        return ret;
+#endif
+    return 0;
+}
+
 static int check_keyboard_interaction(int64_t cur_time)
 {
     int i, ret, key;
@@ -3833,6 +4303,27 @@ static int check_keyboard_interaction(int64_t cur_time)
                    "only %d given in string '%s'\n", n, buf);
         }
     }
+    if (key == 'S'){
+        char buf[256], time_str[64];
+        int64_t ts;
+        int k, segment;
+        fprintf(stderr, "\nEnter seek restart: <time> <segment number>\n");
+        i = 0;
+        set_tty_echo(1);
+        while ((k = read_key()) != '\n' && k != '\r' && i < sizeof(buf)-1)
+            if (k > 0)
+                buf[i++] = k;
+        buf[i] = 0;
+        set_tty_echo(0);
+        fprintf(stderr, "\n");
+        if (k > 0 && sscanf(buf, "%63s %d", time_str, &segment) == 2 &&
+            av_parse_time(&ts, time_str, 1) >= 0 && segment >= 0) {
+            if (can_seek_restart() && (ret = seek_restart(ts, segment)) < 0)
+                return ret;
+        } else {
+            av_log(NULL, AV_LOG_ERROR, "Could not parse seek restart '%s'\n", buf);
+        }
+    }
     if (key == 'd' || key == 'D'){
         int debug=0;
         if(key == 'D') {
@@ -3875,6 +4366,7 @@ static int check_keyboard_interaction(int64_t cur_time)
                         "h      dump packets/hex press to cycle through the 3 states\n"
                         "q      quit\n"
                         "s      Show QP histogram\n"
+                        "S      Seek restart at a time and segment number\n"
         );
     }
     return 0;
@@ -3887,6 +4379,8 @@ static void *input_thread(void *arg)
     unsigned flags = f->non_blocking ? AV_THREAD_MESSAGE_NONBLOCK : 0;
     int ret = 0;
 
+    av_trace_set_thread_name("input thread");
+
     while (1) {
         AVPacket pkt;
         ret = av_read_frame(f->ctx, &pkt);
@@ -3955,8 +4449,9 @@ static int init_input_threads(void)
         if (f->ctx->pb ? !f->ctx->pb->seekable :
             strcmp(f->ctx->iformat->name, "lavfi"))
             f->non_blocking = 1;
-        ret = av_thread_message_queue_alloc(&f->in_thread_queue,
-                                            f->thread_queue_size, sizeof(AVPacket));
+        ret = av_thread_message_queue_alloc2(&f->in_thread_queue,
+                                             f->thread_queue_size, sizeof(AVPacket),
+                                             AV_THREAD_MESSAGE_QUEUE_SPSC);
         if (ret < 0)
             return ret;
 
@@ -4694,6 +5189,15 @@ int main(int argc, char **argv)
     if (ret < 0)
         exit_program(1);
 
+    if (trace_file) {
+        if ((ret = av_trace_enable(trace_events)) < 0) {
+            av_log(NULL, AV_LOG_FATAL, "Tracing is not supported: %s\n",
+                   av_err2str(ret));
+            exit_program(1);
+        }
+        av_trace_set_thread_name("main");
+    }
+
     if (nb_output_files <= 0 && nb_input_files == 0) {
         show_usage();
         av_log(NULL, AV_LOG_WARNING, "Use -h to get full help or, even better, run 'man %s'\n", program_name);
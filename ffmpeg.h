@@ -454,6 +454,12 @@ typedef struct OutputStream {
     AVExpr *forced_keyframes_pexpr;
     double forced_keyframes_expr_const_values[FKF_NB];
 
+    /* seek restart */
+    int seek_restart;            /* the next frame is the first one after a seek restart */
+    int64_t restart_next_pts;    /* encoder timestamp the next frame had before the restart */
+    int64_t restart_pts_offset;  /* keeps the timestamps seen by the encoder increasing */
+    uint64_t restart_drop;       /* packets still in the encoder from before the restart */
+
     /* audio only */
     int *audio_channels_map;             /* list of the channels id to pick from the source stream */
     int audio_channels_mapped;           /* number of channels in audio_channels_map */
@@ -498,6 +504,8 @@ typedef struct OutputStream {
     // number of frames/samples sent to the encoder
     uint64_t frames_encoded;
     uint64_t samples_encoded;
+    // number of packets received from the encoder
+    uint64_t packets_encoded;
 
     /* packet quality factor */
     int quality;
@@ -568,6 +576,9 @@ extern int stdin_interaction;
 extern int frame_bits_per_raw_sample;
 extern AVIOContext *progress_avio;
 extern float max_error_rate;
+extern int64_t max_memory;
+extern char *trace_file;
+extern int trace_events;
 extern char *videotoolbox_pixfmt;
 
 extern const AVIOInterruptCB int_cb;
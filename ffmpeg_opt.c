@@ -126,6 +126,9 @@ int qp_hist           = 0;
 int stdin_interaction = 1;
 int frame_bits_per_raw_sample = 0;
 float max_error_rate  = 2.0/3;
+int64_t max_memory    = 0;
+char *trace_file      = NULL;
+int trace_events      = 1 << 16;
 
 
 static int intra_only         = 0;
@@ -3389,6 +3392,12 @@ const OptionDef options[] = {
         "add timings for benchmarking" },
     { "benchmark_all",  OPT_BOOL | OPT_EXPERT,                       { &do_benchmark_all },
       "add timings for each task" },
+    { "max_memory",     HAS_ARG | OPT_INT64 | OPT_EXPERT,            { &max_memory },
+      "fit queues, lookahead and thread counts in a memory budget", "bytes" },
+    { "trace",          HAS_ARG | OPT_STRING | OPT_EXPERT,           { &trace_file },
+      "write a Chrome trace of the decoding, filtering, encoding and muxing", "filename" },
+    { "trace_events",   HAS_ARG | OPT_INT | OPT_EXPERT,              { &trace_events },
+      "number of trace events kept per thread", "number" },
     { "progress",       HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_progress },
       "write program-readable progress information", "url" },
     { "stdin",          OPT_BOOL | OPT_EXPERT,                       { &stdin_interaction },
@@ -525,6 +525,7 @@ int av_packet_shrink_side_data(AVPacket *pkt, enum AVPacketSideDataType type,
         if (pkt->side_data[i].type == type) {
             if (size > pkt->side_data[i].size)
                 return AVERROR(ENOMEM);
+            memset(pkt->side_data[i].data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
             pkt->side_data[i].size = size;
             return 0;
         }
@@ -24,6 +24,7 @@
 #include "libavutil/avassert.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/thread.h"
+#include "libavutil/trace.h"
 #include "avcodec.h"
 #include "internal.h"
 #include "thread.h"
@@ -62,6 +63,8 @@ static void * attribute_align_arg worker(void *v){
     ThreadContext *c = avctx->internal->frame_thread_encoder;
     AVPacket *pkt = NULL;
 
+    av_trace_set_thread_name("encode thread");
+
     while(!c->exit){
         int got_packet, ret;
         AVFrame *frame;
@@ -42,6 +42,7 @@
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/thread.h"
+#include "libavutil/trace.h"
 
 /**
  * Context used by codec threads and stored in their AVCodecInternal thread_ctx.
@@ -131,6 +132,8 @@ static attribute_align_arg void *frame_worker_thread(void *arg)
     AVCodecContext *avctx = p->avctx;
     const AVCodec *codec = avctx->codec;
 
+    av_trace_set_thread_name("frame thread");
+
     pthread_mutex_lock(&p->mutex);
     while (1) {
             while (p->state == STATE_INPUT_READY && !p->die)
@@ -143,7 +146,9 @@ static attribute_align_arg void *frame_worker_thread(void *arg)
 
         av_frame_unref(p->frame);
         p->got_frame = 0;
+        av_trace_event(AV_TRACE_BEGIN, codec->name, "decode", p->avpkt.size);
         p->result = codec->decode(avctx, p->frame, &p->got_frame, &p->avpkt);
+        av_trace_event(AV_TRACE_END, codec->name, "decode", p->result);
 
         if ((p->result < 0 || !p->got_frame) && p->frame->buf[0]) {
             if (avctx->internal->allocate_progress)
@@ -323,10 +328,13 @@ static int submit_packet(PerThreadContext *p, AVPacket *avpkt)
     if (prev_thread) {
         int err;
         if (prev_thread->state == STATE_SETTING_UP) {
+            av_trace_event(AV_TRACE_BEGIN, "await_setup", "frame_thread",
+                           prev_thread - fctx->threads);
             pthread_mutex_lock(&prev_thread->progress_mutex);
             while (prev_thread->state == STATE_SETTING_UP)
                 pthread_cond_wait(&prev_thread->progress_cond, &prev_thread->progress_mutex);
             pthread_mutex_unlock(&prev_thread->progress_mutex);
+            av_trace_event(AV_TRACE_END, "await_setup", "frame_thread", 0);
         }
 
         err = update_context_from_thread(p->avctx, prev_thread->avctx, 0);
@@ -342,6 +350,7 @@ static int submit_packet(PerThreadContext *p, AVPacket *avpkt)
     p->state = STATE_SETTING_UP;
     pthread_cond_signal(&p->input_cond);
     pthread_mutex_unlock(&p->mutex);
+    av_trace_event(AV_TRACE_INSTANT, "submit", "frame_thread", p - fctx->threads);
 
     /*
      * If the client doesn't have a thread-safe get_buffer(),
@@ -426,10 +435,13 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
         p = &fctx->threads[finished++];
 
         if (p->state != STATE_INPUT_READY) {
+            av_trace_event(AV_TRACE_BEGIN, "await_output", "frame_thread",
+                           p - fctx->threads);
             pthread_mutex_lock(&p->progress_mutex);
             while (p->state != STATE_INPUT_READY)
                 pthread_cond_wait(&p->output_cond, &p->progress_mutex);
             pthread_mutex_unlock(&p->progress_mutex);
+            av_trace_event(AV_TRACE_END, "await_output", "frame_thread", 0);
         }
 
         av_frame_move_ref(picture, p->frame);
@@ -498,10 +510,12 @@ void ff_thread_await_progress(ThreadFrame *f, int n, int field)
     if (f->owner->debug&FF_DEBUG_THREADS)
         av_log(f->owner, AV_LOG_DEBUG, "thread awaiting %d field %d from %p\n", n, field, progress);
 
+    av_trace_event(AV_TRACE_BEGIN, "await_progress", "frame_thread", n);
     pthread_mutex_lock(&p->progress_mutex);
     while (progress[field] < n)
         pthread_cond_wait(&p->progress_cond, &p->progress_mutex);
     pthread_mutex_unlock(&p->progress_mutex);
+    av_trace_event(AV_TRACE_END, "await_progress", "frame_thread", n);
 }
 
 void ff_thread_finish_setup(AVCodecContext *avctx) {
@@ -517,6 +531,7 @@ void ff_thread_finish_setup(AVCodecContext *avctx) {
     p->state = STATE_SETUP_FINISHED;
     pthread_cond_broadcast(&p->progress_cond);
     pthread_mutex_unlock(&p->progress_mutex);
+    av_trace_event(AV_TRACE_INSTANT, "finish_setup", "frame_thread", 0);
 }
 
 /// Waits for all threads to finish.
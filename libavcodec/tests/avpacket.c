@@ -0,0 +1,154 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavcodec/avcodec.h"
+#include "libavutil/avassert.h"
+#include "libavutil/mem.h"
+
+#define TEST_TYPE AV_PKT_DATA_SKIP_SAMPLES
+
+static const uint8_t pattern[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+static int padding_is_zero(const uint8_t *data, int size)
+{
+    int i;
+
+    for (i = 0; i < AV_INPUT_BUFFER_PADDING_SIZE; i++)
+        if (data[size + i])
+            return 0;
+    return 1;
+}
+
+static void check_side_data(AVPacket *pkt, enum AVPacketSideDataType type,
+                            const uint8_t *expected, int expected_size)
+{
+    int size;
+    uint8_t *data = av_packet_get_side_data(pkt, type, &size);
+
+    av_assert0(data && size == expected_size);
+    av_assert0(!memcmp(data, expected, size));
+    av_assert0(padding_is_zero(data, size));
+}
+
+static void test_copy(void)
+{
+    AVPacket a, b, c;
+    uint8_t *data_a, *data_b;
+    int size;
+
+    av_init_packet(&b);
+    av_init_packet(&c);
+    av_assert0(av_new_packet(&a, 64) >= 0);
+    data_a = av_packet_new_side_data(&a, TEST_TYPE, sizeof(pattern));
+    av_assert0(data_a && padding_is_zero(data_a, sizeof(pattern)));
+    memcpy(data_a, pattern, sizeof(pattern));
+
+    /* copies get their own payload, which may be modified */
+    av_assert0(av_packet_ref(&b, &a) >= 0);
+    data_b = av_packet_get_side_data(&b, TEST_TYPE, &size);
+    av_assert0(data_b && data_b != data_a && size == sizeof(pattern));
+    av_assert0(av_packet_copy_props(&c, &a) >= 0);
+    av_assert0(av_packet_get_side_data(&c, TEST_TYPE, NULL) != data_a);
+    data_b[0] = 42;
+    check_side_data(&a, TEST_TYPE, pattern, sizeof(pattern));
+    check_side_data(&c, TEST_TYPE, pattern, sizeof(pattern));
+
+    /* the payload is a plain av_malloc() allocation */
+    data_a = av_realloc(a.side_data[0].data, 2 * sizeof(pattern));
+    av_assert0(data_a);
+    a.side_data[0].data = data_a;
+    av_freep(&c.side_data[0].data);
+    c.side_data[0].size = 0;
+
+    av_packet_unref(&a);
+    av_packet_unref(&b);
+    av_packet_unref(&c);
+    printf("copy: ok\n");
+}
+
+static void test_shrink(void)
+{
+    AVPacket a, b;
+    uint8_t *data;
+
+    av_init_packet(&b);
+    av_assert0(av_new_packet(&a, 0) >= 0);
+    data = av_packet_new_side_data(&a, TEST_TYPE, sizeof(pattern));
+    av_assert0(data);
+    memcpy(data, pattern, sizeof(pattern));
+    av_assert0(av_packet_ref(&b, &a) >= 0);
+
+    /* shrinking one copy leaves the other untouched */
+    av_assert0(av_packet_shrink_side_data(&b, TEST_TYPE, 4) >= 0);
+    check_side_data(&b, TEST_TYPE, pattern, 4);
+    check_side_data(&a, TEST_TYPE, pattern, sizeof(pattern));
+
+    av_assert0(av_packet_shrink_side_data(&a, TEST_TYPE, 6) >= 0);
+    av_assert0(av_packet_get_side_data(&a, TEST_TYPE, NULL) == data);
+    check_side_data(&a, TEST_TYPE, pattern, 6);
+    av_assert0(av_packet_shrink_side_data(&a, TEST_TYPE, 8) == AVERROR(ENOMEM));
+    av_assert0(av_packet_shrink_side_data(&a, AV_PKT_DATA_PALETTE, 0) == AVERROR(ENOENT));
+
+    av_packet_unref(&a);
+    av_packet_unref(&b);
+    printf("shrink: ok\n");
+}
+
+static void test_merge_split(void)
+{
+    static const uint8_t payload[5] = { 0xde, 0xad, 0xbe, 0xef, 0x00 };
+    AVPacket a, b;
+    uint8_t *data;
+
+    av_init_packet(&b);
+    av_assert0(av_new_packet(&a, sizeof(payload)) >= 0);
+    memcpy(a.data, payload, sizeof(payload));
+    data = av_packet_new_side_data(&a, TEST_TYPE, sizeof(pattern));
+    av_assert0(data);
+    memcpy(data, pattern, sizeof(pattern));
+    /* added side data is taken over */
+    data = av_memdup(pattern, 3);
+    av_assert0(data && av_packet_add_side_data(&a, AV_PKT_DATA_PALETTE, data, 3) >= 0);
+    av_assert0(av_packet_ref(&b, &a) >= 0);
+
+    av_assert0(av_packet_merge_side_data(&a) == 1);
+    av_assert0(!a.side_data_elems && a.size > sizeof(payload));
+    /* merging one packet does not affect the copies of its side data */
+    check_side_data(&b, TEST_TYPE, pattern, sizeof(pattern));
+
+    av_assert0(av_packet_split_side_data(&a) == 1);
+    av_assert0(a.side_data_elems == 2 && a.size == sizeof(payload));
+    av_assert0(!memcmp(a.data, payload, sizeof(payload)));
+    check_side_data(&a, TEST_TYPE, pattern, sizeof(pattern));
+    check_side_data(&a, AV_PKT_DATA_PALETTE, pattern, 3);
+
+    av_packet_unref(&a);
+    av_packet_unref(&b);
+    printf("merge/split: ok\n");
+}
+
+int main(void)
+{
+    test_copy();
+    test_shrink();
+    test_merge_split();
+    return 0;
+}
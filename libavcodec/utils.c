@@ -43,6 +43,7 @@
 #include "libavutil/samplefmt.h"
 #include "libavutil/dict.h"
 #include "libavutil/thread.h"
+#include "libavutil/trace.h"
 #include "libavutil/extlib.h"
 #include "avcodec.h"
 #include "libavutil/opt.h"
@@ -250,8 +251,10 @@ int ff_side_data_update_matrix_encoding(AVFrame *frame,
     AVFrameSideData *side_data;
     enum AVMatrixEncoding *data;
 
-    side_data = av_frame_get_side_data(frame, AV_FRAME_DATA_MATRIXENCODING);
-    if (!side_data)
+    /* the side data may be shared with other frames */
+    if (av_frame_get_side_data(frame, AV_FRAME_DATA_MATRIXENCODING))
+        side_data = av_frame_get_side_data_writable(frame, AV_FRAME_DATA_MATRIXENCODING);
+    else
         side_data = av_frame_new_side_data(frame, AV_FRAME_DATA_MATRIXENCODING,
                                            sizeof(enum AVMatrixEncoding));
 
@@ -560,7 +563,7 @@ static int update_frame_pool(AVCodecContext *avctx, AVFrame *frame)
                 pool->pools[i] = av_buffer_pool_init(size[i] + 16 + STRIDE_ALIGN - 1,
                                                      CONFIG_MEMORY_POISONING ?
                                                         NULL :
-                                                        av_buffer_allocz);
+                                                        av_buffer_allocz_huge);
                 if (!pool->pools[i]) {
                     ret = AVERROR(ENOMEM);
                     goto fail;
@@ -1892,7 +1895,10 @@ int attribute_align_arg avcodec_encode_audio2(AVCodecContext *avctx,
 
     av_assert0(avctx->codec->encode2);
 
+    av_trace_event(AV_TRACE_BEGIN, avctx->codec->name, "encode",
+                   frame ? frame->pts : AV_NOPTS_VALUE);
     ret = avctx->codec->encode2(avctx, avpkt, frame, got_packet_ptr);
+    av_trace_event(AV_TRACE_END, avctx->codec->name, "encode", ret);
     if (!ret) {
         if (*got_packet_ptr) {
             if (!(avctx->codec->capabilities & AV_CODEC_CAP_DELAY)) {
@@ -1998,7 +2004,10 @@ int attribute_align_arg avcodec_encode_video2(AVCodecContext *avctx,
 
     av_assert0(avctx->codec->encode2);
 
+    av_trace_event(AV_TRACE_BEGIN, avctx->codec->name, "encode",
+                   frame ? frame->pts : AV_NOPTS_VALUE);
     ret = avctx->codec->encode2(avctx, avpkt, frame, got_packet_ptr);
+    av_trace_event(AV_TRACE_END, avctx->codec->name, "encode", ret);
     av_assert0(ret <= 0);
 
     emms_c();
@@ -2257,6 +2266,7 @@ int attribute_align_arg avcodec_decode_video2(AVCodecContext *avctx, AVFrame *pi
             goto fail;
 
         avctx->internal->pkt = &tmp;
+        av_trace_event(AV_TRACE_BEGIN, avctx->codec->name, "decode", tmp.size);
         if (HAVE_THREADS && avctx->active_thread_type & FF_THREAD_FRAME)
             ret = ff_thread_decode_frame(avctx, picture, got_picture_ptr,
                                          &tmp);
@@ -2278,6 +2288,7 @@ int attribute_align_arg avcodec_decode_video2(AVCodecContext *avctx, AVFrame *pi
                 if (picture->format == AV_PIX_FMT_NONE)   picture->format              = avctx->pix_fmt;
             }
         }
+        av_trace_event(AV_TRACE_END, avctx->codec->name, "decode", ret);
 
 fail:
         emms_c(); //needed to avoid an emms_c() call before every return;
@@ -2368,6 +2379,7 @@ int attribute_align_arg avcodec_decode_audio4(AVCodecContext *avctx,
             goto fail;
 
         avctx->internal->pkt = &tmp;
+        av_trace_event(AV_TRACE_BEGIN, avctx->codec->name, "decode", tmp.size);
         if (HAVE_THREADS && avctx->active_thread_type & FF_THREAD_FRAME)
             ret = ff_thread_decode_frame(avctx, frame, got_frame_ptr, &tmp);
         else {
@@ -2375,6 +2387,7 @@ int attribute_align_arg avcodec_decode_audio4(AVCodecContext *avctx,
             av_assert0(ret <= tmp.size);
             frame->pkt_dts = avpkt->dts;
         }
+        av_trace_event(AV_TRACE_END, avctx->codec->name, "decode", ret);
         if (ret >= 0 && *got_frame_ptr) {
             avctx->frame_number++;
             av_frame_set_best_effort_timestamp(frame,
@@ -3060,8 +3073,16 @@ av_cold int avcodec_close(AVCodecContext *avctx)
         av_frame_free(&avctx->internal->to_free);
         av_frame_free(&avctx->internal->buffer_frame);
         av_packet_free(&avctx->internal->buffer_pkt);
-        for (i = 0; i < FF_ARRAY_ELEMS(pool->pools); i++)
+        for (i = 0; i < FF_ARRAY_ELEMS(pool->pools); i++) {
+            if (pool->pools[i]) {
+                AVBufferPoolStats stats;
+                av_buffer_pool_get_stats(pool->pools[i], &stats);
+                av_log(avctx, AV_LOG_DEBUG, "Frame pool %d: %"PRId64" hits, "
+                       "%"PRId64" misses, at most %d buffers in use\n",
+                       i, stats.hits, stats.misses, stats.peak);
+            }
             av_buffer_pool_uninit(&pool->pools[i]);
+        }
         av_freep(&avctx->internal->pool);
 
         if (avctx->hwaccel && avctx->hwaccel->uninit)
@@ -54,6 +54,8 @@ typedef struct DynamicAudioNormalizerContext {
     int dc_correction;
     int channels_coupled;
     int alt_boundary_mode;
+    int lookahead;
+    int prefill;
 
     double peak_value;
     double max_amplification;
@@ -86,6 +88,7 @@ static const AVOption dynaudnorm_options[] = {
     { "c", "set DC correction",                OFFSET(dc_correction),     AV_OPT_TYPE_BOOL,   {.i64 = 0},      0,     1, FLAGS },
     { "b", "set alternative boundary mode",    OFFSET(alt_boundary_mode), AV_OPT_TYPE_BOOL,   {.i64 = 0},      0,     1, FLAGS },
     { "s", "set the compress factor",          OFFSET(compress_factor),   AV_OPT_TYPE_DOUBLE, {.dbl = 0.0},  0.0,  30.0, FLAGS },
+    { "l", "set the lookahead in frames",      OFFSET(lookahead),         AV_OPT_TYPE_INT,    {.i64 = -1},    -1,   150, FLAGS },
     { NULL }
 };
 
@@ -329,8 +332,14 @@ static int config_input(AVFilterLink *inlink)
     precalculate_fade_factors(s->fade_factors, s->frame_len);
     init_gaussian_filter(s);
 
+    /* Frames of the windows that lie in the future of the current frame;
+     * the remainder of each window is pre-filled at the start. */
+    if (s->lookahead < 0 || s->lookahead > s->filter_size / 2)
+        s->lookahead = s->filter_size / 2;
+    s->prefill = s->filter_size - 1 - s->lookahead;
+
     s->channels = inlink->channels;
-    s->delay = s->filter_size;
+    s->delay = 2 * s->lookahead + 1;
 
     return 0;
 }
@@ -438,7 +447,7 @@ static void update_gain_history(DynamicAudioNormalizerContext *s, int channel,
 {
     if (cqueue_empty(s->gain_history_original[channel]) ||
         cqueue_empty(s->gain_history_minimum[channel])) {
-        const int pre_fill_size = s->filter_size / 2;
+        const int pre_fill_size = s->prefill;
         const double initial_value = s->alt_boundary_mode ? current_gain_factor : 1.0;
 
         s->prev_amplification_factor[channel] = initial_value;
@@ -455,12 +464,15 @@ static void update_gain_history(DynamicAudioNormalizerContext *s, int channel,
         av_assert0(cqueue_size(s->gain_history_original[channel]) == s->filter_size);
 
         if (cqueue_empty(s->gain_history_minimum[channel])) {
-            const int pre_fill_size = s->filter_size / 2;
+            const int pre_fill_size = s->prefill;
             double initial_value = s->alt_boundary_mode ? cqueue_peek(s->gain_history_original[channel], 0) : 1.0;
             int input = pre_fill_size;
 
             while (cqueue_size(s->gain_history_minimum[channel]) < pre_fill_size) {
-                initial_value = FFMIN(initial_value, cqueue_peek(s->gain_history_original[channel], ++input));
+                /* FFMIN() evaluates its arguments twice, so step the index
+                 * outside of it */
+                input++;
+                initial_value = FFMIN(initial_value, cqueue_peek(s->gain_history_original[channel], FFMIN(input, s->filter_size - 1)));
                 cqueue_enqueue(s->gain_history_minimum[channel], initial_value);
             }
         }
@@ -617,11 +629,8 @@ static void analyze_frame(DynamicAudioNormalizerContext *s, AVFrame *frame)
     }
 
     if (s->channels_coupled) {
-        const double current_gain_factor = get_max_local_gain(s, frame, -1);
-        int c;
-
-        for (c = 0; c < s->channels; c++)
-            update_gain_history(s, c, current_gain_factor);
+        /* all channels share one gain history, kept in channel 0 */
+        update_gain_history(s, 0, get_max_local_gain(s, frame, -1));
     } else {
         int c;
 
@@ -632,16 +641,20 @@ static void analyze_frame(DynamicAudioNormalizerContext *s, AVFrame *frame)
 
 static void amplify_frame(DynamicAudioNormalizerContext *s, AVFrame *frame)
 {
+    double prev_amplification_factor = 0.0, current_amplification_factor = 0.0;
     int c, i;
 
     for (c = 0; c < s->channels; c++) {
         double *dst_ptr = (double *)frame->extended_data[c];
-        double current_amplification_factor;
 
-        cqueue_dequeue(s->gain_history_smoothed[c], &current_amplification_factor);
+        if (!s->channels_coupled || !c) {
+            prev_amplification_factor = s->prev_amplification_factor[c];
+            cqueue_dequeue(s->gain_history_smoothed[c], &current_amplification_factor);
+            s->prev_amplification_factor[c] = current_amplification_factor;
+        }
 
         for (i = 0; i < frame->nb_samples; i++) {
-            const double amplification_factor = fade(s->prev_amplification_factor[c],
+            const double amplification_factor = fade(prev_amplification_factor,
                                                      current_amplification_factor, i,
                                                      s->fade_factors);
 
@@ -650,8 +663,6 @@ static void amplify_frame(DynamicAudioNormalizerContext *s, AVFrame *frame)
             if (fabs(dst_ptr[i]) > s->peak_value)
                 dst_ptr[i] = copysign(s->peak_value, dst_ptr[i]);
         }
-
-        s->prev_amplification_factor[c] = current_amplification_factor;
     }
 }
 
@@ -20,11 +20,12 @@
 
 /* http://k.ylo.ph/2016/04/04/loudnorm.html */
 
+#include "libavutil/float_dsp.h"
 #include "libavutil/opt.h"
 #include "avfilter.h"
 #include "internal.h"
 #include "audio.h"
-#include <ebur128.h>
+#include "ebur128.h"
 
 enum FrameType {
     FIRST_FRAME,
@@ -62,6 +63,8 @@ typedef struct LoudNormContext {
     int linear;
     int dual_mono;
     enum PrintFormat print_format;
+    int64_t lookahead;
+    int histogram;
 
     double *buf;
     int buf_size;
@@ -70,6 +73,8 @@ typedef struct LoudNormContext {
 
     double delta[30];
     double weights[21];
+    int nb_delta;           ///< short-term gain slots in the lookahead, 100 ms each
+    int gauss_half;         ///< half width of the gaussian gain smoother
     double prev_delta;
     int index;
 
@@ -91,8 +96,9 @@ typedef struct LoudNormContext {
     int prev_nb_samples;
     int channels;
 
-    ebur128_state *r128_in;
-    ebur128_state *r128_out;
+    FFEBUR128State *r128_in;
+    FFEBUR128State *r128_out;
+    AVFloatDSPContext *fdsp;
 } LoudNormContext;
 
 #define OFFSET(x) offsetof(LoudNormContext, x)
@@ -119,6 +125,8 @@ static const AVOption loudnorm_options[] = {
     {     "none",         0,                                   0,                        AV_OPT_TYPE_CONST,   {.i64 =  NONE},     0,         0,  FLAGS, "print_format" },
     {     "json",         0,                                   0,                        AV_OPT_TYPE_CONST,   {.i64 =  JSON},     0,         0,  FLAGS, "print_format" },
     {     "summary",      0,                                   0,                        AV_OPT_TYPE_CONST,   {.i64 =  SUMMARY},  0,         0,  FLAGS, "print_format" },
+    { "lookahead",        "set dynamic mode lookahead",        OFFSET(lookahead),        AV_OPT_TYPE_DURATION, {.i64 = 3000000}, 1000000, 3000000, FLAGS },
+    { "histogram",        "meter loudness with histograms",    OFFSET(histogram),        AV_OPT_TYPE_BOOL,    {.i64 =  0},        0,         1,  FLAGS },
     { NULL }
 };
 
@@ -133,33 +141,40 @@ static inline int frame_size(int sample_rate, int frame_len_msec)
 static void init_gaussian_filter(LoudNormContext *s)
 {
     double total_weight = 0.0;
-    const double sigma = 3.5;
+    const double sigma = 3.5 * s->gauss_half / 10.;
+    const int taps = 2 * s->gauss_half + 1;
     double adjust;
     int i;
 
-    const int offset = 21 / 2;
+    const int offset = s->gauss_half;
     const double c1 = 1.0 / (sigma * sqrt(2.0 * M_PI));
     const double c2 = 2.0 * pow(sigma, 2.0);
 
-    for (i = 0; i < 21; i++) {
+    for (i = 0; i < taps; i++) {
         const int x = i - offset;
         s->weights[i] = c1 * exp(-(pow(x, 2.0) / c2));
         total_weight += s->weights[i];
     }
 
     adjust = 1.0 / total_weight;
-    for (i = 0; i < 21; i++)
+    for (i = 0; i < taps; i++)
         s->weights[i] *= adjust;
 }
 
 static double gaussian_filter(LoudNormContext *s, int index)
 {
+    const int taps = 2 * s->gauss_half + 1;
     double result = 0.;
-    int i;
+    int i, n;
 
-    index = index - 10 > 0 ? index - 10 : index + 20;
-    for (i = 0; i < 21; i++)
-        result += s->delta[((index + i) < 30) ? (index + i) : (index + i - 30)] * s->weights[i];
+    /* The window starts at the given slot and may wrap around the ring. */
+    if (index >= s->nb_delta)
+        index -= s->nb_delta;
+    n = FFMIN(taps, s->nb_delta - index);
+    for (i = 0; i < n; i++)
+        result += s->delta[index + i] * s->weights[i];
+    for (; i < taps; i++)
+        result += s->delta[index + i - s->nb_delta] * s->weights[i];
 
     return result;
 }
@@ -418,7 +433,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     double *limiter_buf;
     int i, n, c, subframe_length, src_index;
     double gain, gain_next, env_global, env_shortterm,
-    global, shortterm, lra, relative_threshold;
+    global, shortterm, relative_threshold;
 
     if (av_frame_is_writable(in)) {
         out = in;
@@ -437,15 +452,15 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     buf = s->buf;
     limiter_buf = s->limiter_buf;
 
-    ebur128_add_frames_double(s->r128_in, src, in->nb_samples);
+    ff_ebur128_add_frames_double(s->r128_in, src, in->nb_samples);
 
-    if (s->frame_type == FIRST_FRAME && in->nb_samples < frame_size(inlink->sample_rate, 3000)) {
+    if (s->frame_type == FIRST_FRAME && in->nb_samples < frame_size(inlink->sample_rate, s->nb_delta * 100)) {
         double offset, offset_tp, true_peak;
 
-        ebur128_loudness_global(s->r128_in, &global);
+        ff_ebur128_loudness_global(s->r128_in, &global);
         for (c = 0; c < inlink->channels; c++) {
             double tmp;
-            ebur128_sample_peak(s->r128_in, c, &tmp);
+            ff_ebur128_sample_peak(s->r128_in, c, &tmp);
             if (c == 0 || tmp > true_peak)
                 true_peak = tmp;
         }
@@ -467,7 +482,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
             s->buf_index += inlink->channels;
         }
 
-        ebur128_loudness_shortterm(s->r128_in, &shortterm);
+        ff_ebur128_loudness_shortterm(s->r128_in, &shortterm);
 
         if (shortterm < s->measured_thresh) {
             s->above_threshold = 0;
@@ -477,7 +492,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
             env_shortterm = shortterm <= -70. ? 0. : s->target_i - shortterm;
         }
 
-        for (n = 0; n < 30; n++)
+        for (n = 0; n < s->nb_delta; n++)
             s->delta[n] = pow(10., env_shortterm / 20.);
         s->prev_delta = s->delta[s->index];
 
@@ -497,7 +512,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 
         subframe_length = frame_size(inlink->sample_rate, 100);
         true_peak_limiter(s, dst, subframe_length, inlink->channels);
-        ebur128_add_frames_double(s->r128_out, dst, subframe_length);
+        ff_ebur128_add_frames_double(s->r128_out, dst, subframe_length);
 
         s->pts +=
         out->nb_samples =
@@ -509,8 +524,8 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         break;
 
     case INNER_FRAME:
-        gain      = gaussian_filter(s, s->index + 10 < 30 ? s->index + 10 : s->index + 10 - 30);
-        gain_next = gaussian_filter(s, s->index + 11 < 30 ? s->index + 11 : s->index + 11 - 30);
+        gain      = gaussian_filter(s, s->index);
+        gain_next = gaussian_filter(s, s->index + 1);
 
         for (n = 0; n < in->nb_samples; n++) {
             for (c = 0; c < inlink->channels; c++) {
@@ -536,12 +551,13 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         s->limiter_buf_index = s->limiter_buf_index + subframe_length < s->limiter_buf_size ? s->limiter_buf_index + subframe_length : s->limiter_buf_index + subframe_length - s->limiter_buf_size;
 
         true_peak_limiter(s, dst, in->nb_samples, inlink->channels);
-        ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
+        /* The output meter only gates the quiet intro, or feeds the stats. */
+        if (s->above_threshold == 0 || s->print_format != NONE)
+            ff_ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
 
-        ebur128_loudness_range(s->r128_in, &lra);
-        ebur128_loudness_global(s->r128_in, &global);
-        ebur128_loudness_shortterm(s->r128_in, &shortterm);
-        ebur128_relative_threshold(s->r128_in, &relative_threshold);
+        ff_ebur128_loudness_global(s->r128_in, &global);
+        ff_ebur128_loudness_shortterm(s->r128_in, &shortterm);
+        ff_ebur128_relative_threshold(s->r128_in, &relative_threshold);
 
         if (s->above_threshold == 0) {
             double shortterm_out;
@@ -549,7 +565,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
             if (shortterm > s->measured_thresh)
                 s->prev_delta *= 1.0058;
 
-            ebur128_loudness_shortterm(s->r128_out, &shortterm_out);
+            ff_ebur128_loudness_shortterm(s->r128_out, &shortterm_out);
             if (shortterm_out >= s->target_i)
                 s->above_threshold = 1;
         }
@@ -564,14 +580,14 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 
         s->prev_delta = s->delta[s->index];
         s->index++;
-        if (s->index >= 30)
-            s->index -= 30;
+        if (s->index >= s->nb_delta)
+            s->index -= s->nb_delta;
         s->prev_nb_samples = in->nb_samples;
         s->pts += in->nb_samples;
         break;
 
     case FINAL_FRAME:
-        gain = gaussian_filter(s, s->index + 10 < 30 ? s->index + 10 : s->index + 10 - 30);
+        gain = gaussian_filter(s, s->index);
         s->limiter_buf_index = 0;
         src_index = 0;
 
@@ -611,20 +627,18 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         }
 
         dst = (double *)out->data[0];
-        ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
+        ff_ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
         break;
 
     case LINEAR_MODE:
-        for (n = 0; n < in->nb_samples; n++) {
-            for (c = 0; c < inlink->channels; c++) {
-                dst[c] = src[c] * s->offset;
-            }
-            src += inlink->channels;
-            dst += inlink->channels;
-        }
-
-        dst = (double *)out->data[0];
-        ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
+        n = in->nb_samples * inlink->channels;
+        if (n & ~7)
+            s->fdsp->vector_dmul_scalar(dst, src, s->offset, n & ~7);
+        for (i = n & ~7; i < n; i++)
+            dst[i] = src[i] * s->offset;
+
+        if (s->print_format != NONE)
+            ff_ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
         s->pts += in->nb_samples;
         break;
     }
@@ -724,21 +738,30 @@ static int config_input(AVFilterLink *inlink)
 {
     AVFilterContext *ctx = inlink->dst;
     LoudNormContext *s = ctx->priv;
+    int mode = FF_EBUR128_MODE_I | FF_EBUR128_MODE_S | FF_EBUR128_MODE_LRA | FF_EBUR128_MODE_SAMPLE_PEAK;
+
+    /* Histogram mode keeps the gated integrated loudness and LRA queries
+     * constant-time instead of walking every block seen so far. */
+    if (s->histogram)
+        mode |= FF_EBUR128_MODE_HISTOGRAM;
 
-    s->r128_in = ebur128_init(inlink->channels, inlink->sample_rate, EBUR128_MODE_I | EBUR128_MODE_S | EBUR128_MODE_LRA | EBUR128_MODE_SAMPLE_PEAK);
+    s->r128_in = ff_ebur128_init(inlink->channels, inlink->sample_rate, mode);
     if (!s->r128_in)
         return AVERROR(ENOMEM);
 
-    s->r128_out = ebur128_init(inlink->channels, inlink->sample_rate, EBUR128_MODE_I | EBUR128_MODE_S | EBUR128_MODE_LRA | EBUR128_MODE_SAMPLE_PEAK);
+    s->r128_out = ff_ebur128_init(inlink->channels, inlink->sample_rate, mode);
     if (!s->r128_out)
         return AVERROR(ENOMEM);
 
     if (inlink->channels == 1 && s->dual_mono) {
-        ebur128_set_channel(s->r128_in,  0, EBUR128_DUAL_MONO);
-        ebur128_set_channel(s->r128_out, 0, EBUR128_DUAL_MONO);
+        ff_ebur128_set_channel(s->r128_in,  0, FF_EBUR128_DUAL_MONO);
+        ff_ebur128_set_channel(s->r128_out, 0, FF_EBUR128_DUAL_MONO);
     }
 
-    s->buf_size = frame_size(inlink->sample_rate, 3000) * inlink->channels;
+    s->nb_delta   = av_clip(s->lookahead / 100000, 10, FF_ARRAY_ELEMS(s->delta));
+    s->gauss_half = s->nb_delta / 3;
+
+    s->buf_size = frame_size(inlink->sample_rate, s->nb_delta * 100) * inlink->channels;
     s->buf = av_malloc_array(s->buf_size, sizeof(*s->buf));
     if (!s->buf)
         return AVERROR(ENOMEM);
@@ -752,6 +775,10 @@ static int config_input(AVFilterLink *inlink)
     if (!s->prev_smp)
         return AVERROR(ENOMEM);
 
+    s->fdsp = avpriv_float_dsp_alloc(0);
+    if (!s->fdsp)
+        return AVERROR(ENOMEM);
+
     init_gaussian_filter(s);
 
     s->frame_type = FIRST_FRAME;
@@ -772,7 +799,7 @@ static int config_input(AVFilterLink *inlink)
     if (s->frame_type != LINEAR_MODE) {
         inlink->min_samples =
         inlink->max_samples =
-        inlink->partial_buf_size = frame_size(inlink->sample_rate, 3000);
+        inlink->partial_buf_size = frame_size(inlink->sample_rate, s->nb_delta * 100);
     }
 
     s->pts =
@@ -799,22 +826,22 @@ static av_cold void uninit(AVFilterContext *ctx)
     if (!s->r128_in || !s->r128_out)
         goto end;
 
-    ebur128_loudness_range(s->r128_in, &lra_in);
-    ebur128_loudness_global(s->r128_in, &i_in);
-    ebur128_relative_threshold(s->r128_in, &thresh_in);
+    ff_ebur128_loudness_range(s->r128_in, &lra_in);
+    ff_ebur128_loudness_global(s->r128_in, &i_in);
+    ff_ebur128_relative_threshold(s->r128_in, &thresh_in);
     for (c = 0; c < s->channels; c++) {
         double tmp;
-        ebur128_sample_peak(s->r128_in, c, &tmp);
+        ff_ebur128_sample_peak(s->r128_in, c, &tmp);
         if ((c == 0) || (tmp > tp_in))
             tp_in = tmp;
     }
 
-    ebur128_loudness_range(s->r128_out, &lra_out);
-    ebur128_loudness_global(s->r128_out, &i_out);
-    ebur128_relative_threshold(s->r128_out, &thresh_out);
+    ff_ebur128_loudness_range(s->r128_out, &lra_out);
+    ff_ebur128_loudness_global(s->r128_out, &i_out);
+    ff_ebur128_relative_threshold(s->r128_out, &thresh_out);
     for (c = 0; c < s->channels; c++) {
         double tmp;
-        ebur128_sample_peak(s->r128_out, c, &tmp);
+        ff_ebur128_sample_peak(s->r128_out, c, &tmp);
         if ((c == 0) || (tmp > tp_out))
             tp_out = tmp;
     }
@@ -881,12 +908,13 @@ static av_cold void uninit(AVFilterContext *ctx)
 
 end:
     if (s->r128_in)
-        ebur128_destroy(&s->r128_in);
+        ff_ebur128_destroy(&s->r128_in);
     if (s->r128_out)
-        ebur128_destroy(&s->r128_out);
+        ff_ebur128_destroy(&s->r128_out);
     av_freep(&s->limiter_buf);
     av_freep(&s->prev_smp);
     av_freep(&s->buf);
+    av_freep(&s->fdsp);
 }
 
 static const AVFilterPad avfilter_af_loudnorm_inputs[] = {
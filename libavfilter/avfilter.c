@@ -33,6 +33,7 @@
 #include "libavutil/pixdesc.h"
 #include "libavutil/rational.h"
 #include "libavutil/samplefmt.h"
+#include "libavutil/trace.h"
 
 #include "audio.h"
 #include "avfilter.h"
@@ -1131,7 +1132,9 @@ static int ff_filter_frame_framed(AVFilterLink *link, AVFrame *frame)
             (dstctx->filter->flags & AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC))
             filter_frame = default_filter_frame;
     }
+    av_trace_event(AV_TRACE_BEGIN, dstctx->filter->name, "filter", pts);
     ret = filter_frame(link, out);
+    av_trace_event(AV_TRACE_END, dstctx->filter->name, "filter", ret);
     link->frame_count++;
     ff_update_link_current_pts(link, pts);
     return ret;
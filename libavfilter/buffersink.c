@@ -59,9 +59,14 @@ typedef struct BufferSinkContext {
     /* only used for compat API */
     AVAudioFifo *audio_fifo;     ///< FIFO for audio samples
     int64_t next_pts;            ///< interpolating audio pts
+
+    /* only used for fixed size audio frames */
+    int frame_size;              ///< samples per output frame, 0 to pass frames through
+    AVFrame *partial;            ///< frame being assembled across input frames
 } BufferSinkContext;
 
 #define NB_ITEMS(list) (list ## _size / sizeof(*list))
+#define FRAME_ALIGN 32
 #define FIFO_INIT_SIZE 8
 #define FIFO_INIT_ELEMENT_SIZE sizeof(void *)
 
@@ -72,6 +77,7 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     if (sink->audio_fifo)
         av_audio_fifo_free(sink->audio_fifo);
+    av_frame_free(&sink->partial);
 
     if (sink->fifo) {
         while (av_fifo_size(sink->fifo) >= FIFO_INIT_ELEMENT_SIZE) {
@@ -101,13 +107,123 @@ static int add_buffer_ref(AVFilterContext *ctx, AVFrame *ref)
     return 0;
 }
 
+/**
+ * Make frame reference nb_samples samples of src starting at offset, without
+ * copying them. Returns 0 if the resulting data pointers would not be
+ * suitably aligned for SIMD consumers.
+ */
+static int ref_samples(AVFrame *frame, const AVFrame *src, int offset, int nb_samples)
+{
+    int planar   = av_sample_fmt_is_planar(src->format);
+    int channels = av_frame_get_channels(src);
+    int planes   = planar ? channels : 1;
+    int shift    = offset * av_get_bytes_per_sample(src->format) * (planar ? 1 : channels);
+    int i;
+
+    for (i = 0; i < planes; i++)
+        if ((uintptr_t)(src->extended_data[i] + shift) & (FRAME_ALIGN - 1))
+            return 0;
+    if (av_frame_ref(frame, src) < 0)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < planes; i++)
+        frame->extended_data[i] += shift;
+    if (frame->extended_data != frame->data)
+        for (i = 0; i < FFMIN(planes, AV_NUM_DATA_POINTERS); i++)
+            frame->data[i] += shift;
+    frame->nb_samples = nb_samples;
+    return 1;
+}
+
+static int flush_partial(AVFilterContext *ctx)
+{
+    BufferSinkContext *buf = ctx->priv;
+    AVFrame *partial = buf->partial;
+    int ret;
+
+    if (!partial)
+        return 0;
+    buf->partial = NULL;
+    if ((ret = add_buffer_ref(ctx, partial)) < 0)
+        av_frame_free(&partial);
+    return ret;
+}
+
+/**
+ * Cut an input frame into frames of exactly frame_size samples. Whole frames
+ * lying inside the input reference its buffers directly; only samples that
+ * straddle two input frames are copied, into pooled buffers.
+ */
+static int filter_frame_framed(AVFilterLink *link, AVFrame *frame)
+{
+    AVFilterContext *ctx = link->dst;
+    BufferSinkContext *buf = ctx->priv;
+    int channels = av_frame_get_channels(frame);
+    int pos = 0, ret = 0;
+
+    while (pos < frame->nb_samples) {
+        int left = frame->nb_samples - pos;
+        int64_t pts = frame->pts;
+        AVFrame *out;
+
+        if (pts != AV_NOPTS_VALUE)
+            pts += av_rescale_q(pos, (AVRational){ 1, link->sample_rate },
+                                link->time_base);
+
+        if (!buf->partial && left >= buf->frame_size) {
+            if (!(out = av_frame_alloc())) {
+                ret = AVERROR(ENOMEM);
+                break;
+            }
+            if ((ret = ref_samples(out, frame, pos, buf->frame_size)) > 0) {
+                out->pts = pts;
+                pos += buf->frame_size;
+                if ((ret = add_buffer_ref(ctx, out)) < 0) {
+                    av_frame_free(&out);
+                    break;
+                }
+                continue;
+            }
+            av_frame_free(&out);
+            if (ret < 0)
+                break;
+        }
+
+        if (!buf->partial) {
+            if (!(buf->partial = ff_get_audio_buffer(link, buf->frame_size))) {
+                ret = AVERROR(ENOMEM);
+                break;
+            }
+            av_frame_copy_props(buf->partial, frame);
+            buf->partial->pts        = pts;
+            buf->partial->nb_samples = 0;
+        }
+
+        left = FFMIN(left, buf->frame_size - buf->partial->nb_samples);
+        av_samples_copy(buf->partial->extended_data, frame->extended_data,
+                        buf->partial->nb_samples, pos, left, channels, frame->format);
+        buf->partial->nb_samples += left;
+        pos                      += left;
+        if (buf->partial->nb_samples >= buf->frame_size &&
+            (ret = flush_partial(ctx)) < 0)
+            break;
+    }
+
+    av_frame_free(&frame);
+    return ret;
+}
+
 static int filter_frame(AVFilterLink *link, AVFrame *frame)
 {
     AVFilterContext *ctx = link->dst;
     BufferSinkContext *buf = link->dst->priv;
     int ret;
 
-    if ((ret = add_buffer_ref(ctx, frame)) < 0)
+    if (link->type == AVMEDIA_TYPE_AUDIO && buf->frame_size) {
+        ret = filter_frame_framed(link, frame);
+        if (ret < 0)
+            return ret;
+    } else if ((ret = add_buffer_ref(ctx, frame)) < 0)
         return ret;
     if (buf->warning_limit &&
         av_fifo_size(buf->fifo) / FIFO_INIT_ELEMENT_SIZE >= buf->warning_limit) {
@@ -134,8 +250,14 @@ int attribute_align_arg av_buffersink_get_frame_flags(AVFilterContext *ctx, AVFr
 
     /* no picref available, fetch it from the filterchain */
     while (!av_fifo_size(buf->fifo)) {
-        if (inlink->status)
+        if (inlink->status) {
+            if (buf->partial) {
+                if ((ret = flush_partial(ctx)) < 0)
+                    return ret;
+                break;
+            }
             return inlink->status;
+        }
         if (flags & AV_BUFFERSINK_FLAG_NO_REQUEST)
             return AVERROR(EAGAIN);
         if ((ret = ff_request_frame(inlink)) < 0)
@@ -262,10 +384,15 @@ static av_cold int common_init(AVFilterContext *ctx)
 
 void av_buffersink_set_frame_size(AVFilterContext *ctx, unsigned frame_size)
 {
-    AVFilterLink *inlink = ctx->inputs[0];
+    BufferSinkContext *buf = ctx->priv;
 
-    inlink->min_samples = inlink->max_samples =
-    inlink->partial_buf_size = frame_size;
+    /* Framing is done here rather than by the link, so that whole frames can
+     * be handed out without copying the samples. */
+    if (buf->partial && buf->partial->nb_samples && frame_size != buf->frame_size)
+        flush_partial(ctx);
+    if (buf->partial && frame_size != buf->frame_size)
+        av_frame_free(&buf->partial);
+    buf->frame_size = frame_size;
 }
 
 AVRational av_buffersink_get_frame_rate(AVFilterContext *ctx)
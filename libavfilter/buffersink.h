@@ -96,7 +96,9 @@ AVABufferSinkParams *av_abuffersink_params_alloc(void);
  *
  * All calls to av_buffersink_get_buffer_ref will return a buffer with
  * exactly the specified number of samples, or AVERROR(EAGAIN) if there is
- * not enough. The last buffer at EOF will be padded with 0.
+ * not enough. The last buffer at EOF may hold fewer samples; it is not padded.
+ * Returned frames may reference the buffers of the frames the sink received,
+ * so they are not necessarily writable.
  */
 void av_buffersink_set_frame_size(AVFilterContext *ctx, unsigned frame_size);
 
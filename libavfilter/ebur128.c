@@ -0,0 +1,618 @@
+/*
+ * Copyright (c) 2011 Jan Kokemüller
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * This file is based on libebur128 which is available at
+ * https://github.com/jiixyj/libebur128/
+ */
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "ebur128.h"
+
+#define RELATIVE_GATE_FACTOR  0.1   /* -10 LU */
+#define MINUS_20DB            0.01  /* -20 LU, the LRA gate */
+#define HISTOGRAM_BINS        1000
+
+struct FFEBUR128State {
+    int mode;
+    unsigned int channels;
+    unsigned long samplerate;
+    /** K-weighted frames of the last window, a ring of audio_data_frames */
+    double *audio_data;
+    size_t audio_data_frames;
+    size_t audio_data_index;
+    /** frames left until the next 100 ms step */
+    size_t needed_frames;
+    int *channel_map;
+    size_t samples_in_100ms;
+    /** K-weighting filter, direct form II */
+    double b[5];
+    double a[5];
+    double (*v)[5];
+    /** energies of the gating blocks above the absolute gate */
+    double *block_list;
+    size_t nb_blocks, blocks_allocated;
+    double *short_term_block_list;
+    size_t nb_short_term_blocks, short_term_blocks_allocated;
+    /** frames added since the last short-term block */
+    size_t short_term_frame_counter;
+    double *sample_peak;
+    /** used instead of the lists in FF_EBUR128_MODE_HISTOGRAM */
+    unsigned long *block_energy_histogram;
+    unsigned long *short_term_block_energy_histogram;
+};
+
+static double histogram_energies[HISTOGRAM_BINS];
+static double histogram_energy_boundaries[HISTOGRAM_BINS + 1];
+static AVOnce histogram_init_once = AV_ONCE_INIT;
+
+static void init_histogram(void)
+{
+    int i;
+
+    /* bin i covers [-70 + i / 10, -70 + (i + 1) / 10) LUFS */
+    for (i = 0; i <= HISTOGRAM_BINS; i++)
+        histogram_energy_boundaries[i] = pow(10.0, ((double)i / 10.0 - 70.0 + 0.691) / 10.0);
+    for (i = 0; i < HISTOGRAM_BINS; i++)
+        histogram_energies[i] = pow(10.0, ((double)i / 10.0 - 69.95 + 0.691) / 10.0);
+}
+
+static double energy_to_loudness(double energy)
+{
+    return 10 * log10(energy) - 0.691;
+}
+
+static size_t find_histogram_index(double energy)
+{
+    size_t index_min = 0;
+    size_t index_max = HISTOGRAM_BINS;
+
+    do {
+        size_t index_mid = (index_min + index_max) / 2;
+        if (energy >= histogram_energy_boundaries[index_mid])
+            index_min = index_mid;
+        else
+            index_max = index_mid;
+    } while (index_max - index_min != 1);
+
+    return index_min;
+}
+
+static void init_filter(FFEBUR128State *st)
+{
+    double f0 = 1681.974450955533;
+    double G  = 3.999843853973347;
+    double Q  = 0.7071752369554196;
+    double K  = tan(M_PI * f0 / (double)st->samplerate);
+    double Vh = pow(10.0, G / 20.0);
+    double Vb = pow(Vh, 0.4996667741545416);
+    double pb[3], pa[3] = { 1.0, 0.0, 0.0 };
+    double rb[3] = { 1.0, -2.0, 1.0 }, ra[3] = { 1.0, 0.0, 0.0 };
+    double a0 = 1.0 + K / Q + K * K;
+
+    /* high shelf */
+    pb[0] = (Vh + Vb * K / Q + K * K) / a0;
+    pb[1] = 2.0 * (K * K - Vh) / a0;
+    pb[2] = (Vh - Vb * K / Q + K * K) / a0;
+    pa[1] = 2.0 * (K * K - 1.0) / a0;
+    pa[2] = (1.0 - K / Q + K * K) / a0;
+
+    /* RLB high-pass */
+    f0 = 38.13547087602444;
+    Q  = 0.5003270373238773;
+    K  = tan(M_PI * f0 / (double)st->samplerate);
+    ra[1] = 2.0 * (K * K - 1.0) / (1.0 + K / Q + K * K);
+    ra[2] = (1.0 - K / Q + K * K) / (1.0 + K / Q + K * K);
+
+    /* both stages as one 4th order filter */
+    st->b[0] = pb[0] * rb[0];
+    st->b[1] = pb[0] * rb[1] + pb[1] * rb[0];
+    st->b[2] = pb[0] * rb[2] + pb[1] * rb[1] + pb[2] * rb[0];
+    st->b[3] = pb[1] * rb[2] + pb[2] * rb[1];
+    st->b[4] = pb[2] * rb[2];
+
+    st->a[0] = pa[0] * ra[0];
+    st->a[1] = pa[0] * ra[1] + pa[1] * ra[0];
+    st->a[2] = pa[0] * ra[2] + pa[1] * ra[1] + pa[2] * ra[0];
+    st->a[3] = pa[1] * ra[2] + pa[2] * ra[1];
+    st->a[4] = pa[2] * ra[2];
+}
+
+static void init_channel_map(FFEBUR128State *st)
+{
+    unsigned int i;
+
+    if (st->channels == 4) {
+        st->channel_map[0] = FF_EBUR128_LEFT;
+        st->channel_map[1] = FF_EBUR128_RIGHT;
+        st->channel_map[2] = FF_EBUR128_LEFT_SURROUND;
+        st->channel_map[3] = FF_EBUR128_RIGHT_SURROUND;
+    } else if (st->channels == 5) {
+        st->channel_map[0] = FF_EBUR128_LEFT;
+        st->channel_map[1] = FF_EBUR128_RIGHT;
+        st->channel_map[2] = FF_EBUR128_CENTER;
+        st->channel_map[3] = FF_EBUR128_LEFT_SURROUND;
+        st->channel_map[4] = FF_EBUR128_RIGHT_SURROUND;
+    } else {
+        for (i = 0; i < st->channels; i++) {
+            switch (i) {
+            case 0:  st->channel_map[i] = FF_EBUR128_LEFT;           break;
+            case 1:  st->channel_map[i] = FF_EBUR128_RIGHT;          break;
+            case 2:  st->channel_map[i] = FF_EBUR128_CENTER;         break;
+            case 4:  st->channel_map[i] = FF_EBUR128_LEFT_SURROUND;  break;
+            case 5:  st->channel_map[i] = FF_EBUR128_RIGHT_SURROUND; break;
+            default: st->channel_map[i] = FF_EBUR128_UNUSED;         break;
+            }
+        }
+    }
+}
+
+FFEBUR128State *ff_ebur128_init(unsigned int channels,
+                                unsigned long samplerate, int mode)
+{
+    FFEBUR128State *st;
+    size_t window;
+
+    if (!channels || channels > INT_MAX / 8 || samplerate < 16 ||
+        samplerate > 2822400)
+        return NULL;
+    if (ff_thread_once(&histogram_init_once, init_histogram))
+        return NULL;
+
+    st = av_mallocz(sizeof(*st));
+    if (!st)
+        return NULL;
+    st->mode             = mode;
+    st->channels         = channels;
+    st->samplerate       = samplerate;
+    st->samples_in_100ms = (samplerate + 5) / 10;
+
+    if ((mode & FF_EBUR128_MODE_S) == FF_EBUR128_MODE_S)
+        window = 3000;
+    else
+        window = 400;
+    /* a whole number of 100 ms steps, so the ring wraps on a step */
+    st->audio_data_frames = samplerate * window / 1000;
+    if (st->audio_data_frames % st->samples_in_100ms)
+        st->audio_data_frames += st->samples_in_100ms -
+                                 st->audio_data_frames % st->samples_in_100ms;
+
+    st->channel_map = av_malloc_array(channels, sizeof(*st->channel_map));
+    st->v           = av_calloc(channels, sizeof(*st->v));
+    st->sample_peak = av_calloc(channels, sizeof(*st->sample_peak));
+    st->audio_data  = av_calloc(st->audio_data_frames,
+                                channels * sizeof(*st->audio_data));
+    if (!st->channel_map || !st->v || !st->sample_peak || !st->audio_data)
+        goto fail;
+
+    if (mode & FF_EBUR128_MODE_HISTOGRAM) {
+        st->block_energy_histogram =
+            av_calloc(HISTOGRAM_BINS, sizeof(*st->block_energy_histogram));
+        st->short_term_block_energy_histogram =
+            av_calloc(HISTOGRAM_BINS, sizeof(*st->short_term_block_energy_histogram));
+        if (!st->block_energy_histogram || !st->short_term_block_energy_histogram)
+            goto fail;
+    }
+
+    init_channel_map(st);
+    init_filter(st);
+
+    /* the first block is 400 ms, the following ones overlap by 75% */
+    st->needed_frames = st->samples_in_100ms * 4;
+
+    return st;
+
+fail:
+    ff_ebur128_destroy(&st);
+    return NULL;
+}
+
+void ff_ebur128_destroy(FFEBUR128State **st)
+{
+    if (!*st)
+        return;
+    av_freep(&(*st)->audio_data);
+    av_freep(&(*st)->channel_map);
+    av_freep(&(*st)->v);
+    av_freep(&(*st)->sample_peak);
+    av_freep(&(*st)->block_list);
+    av_freep(&(*st)->short_term_block_list);
+    av_freep(&(*st)->block_energy_histogram);
+    av_freep(&(*st)->short_term_block_energy_histogram);
+    av_freep(st);
+}
+
+int ff_ebur128_set_channel(FFEBUR128State *st, unsigned int channel_number,
+                           int value)
+{
+    if (channel_number >= st->channels)
+        return AVERROR(EINVAL);
+    if (value == FF_EBUR128_DUAL_MONO &&
+        (st->channels != 1 || channel_number != 0))
+        return AVERROR(EINVAL);
+    st->channel_map[channel_number] = value;
+    return 0;
+}
+
+static void filter_double(FFEBUR128State *st, const double *src, size_t frames)
+{
+    double *audio_data = st->audio_data + st->audio_data_index * st->channels;
+    unsigned int c;
+    size_t i;
+
+    if ((st->mode & FF_EBUR128_MODE_SAMPLE_PEAK) == FF_EBUR128_MODE_SAMPLE_PEAK) {
+        for (c = 0; c < st->channels; c++) {
+            double max = st->sample_peak[c];
+            for (i = 0; i < frames; i++)
+                max = FFMAX(max, fabs(src[i * st->channels + c]));
+            st->sample_peak[c] = max;
+        }
+    }
+
+    for (c = 0; c < st->channels; c++) {
+        double *v = st->v[c];
+
+        if (st->channel_map[c] == FF_EBUR128_UNUSED)
+            continue;
+        for (i = 0; i < frames; i++) {
+            v[0] = src[i * st->channels + c]
+                 - st->a[1] * v[1]
+                 - st->a[2] * v[2]
+                 - st->a[3] * v[3]
+                 - st->a[4] * v[4];
+            audio_data[i * st->channels + c] =
+                   st->b[0] * v[0]
+                 + st->b[1] * v[1]
+                 + st->b[2] * v[2]
+                 + st->b[3] * v[3]
+                 + st->b[4] * v[4];
+            v[4] = v[3];
+            v[3] = v[2];
+            v[2] = v[1];
+            v[1] = v[0];
+        }
+        /* keep the filter state out of the denormals on silence */
+        for (i = 1; i < 5; i++)
+            if (fabs(v[i]) < DBL_MIN)
+                v[i] = 0.0;
+    }
+}
+
+/**
+ * Mean square of the weighted channels over the last frames_per_block frames
+ * of the ring.
+ */
+static double gating_block_energy(FFEBUR128State *st, size_t frames_per_block)
+{
+    const size_t channels = st->channels;
+    double sum = 0.0;
+    size_t i, c;
+
+    for (c = 0; c < channels; c++) {
+        const double *audio_data = st->audio_data;
+        double channel_sum = 0.0;
+
+        if (st->channel_map[c] == FF_EBUR128_UNUSED)
+            continue;
+        if (st->audio_data_index < frames_per_block) {
+            for (i = 0; i < st->audio_data_index; i++)
+                channel_sum += audio_data[i * channels + c] *
+                               audio_data[i * channels + c];
+            for (i = st->audio_data_frames - (frames_per_block - st->audio_data_index);
+                 i < st->audio_data_frames; i++)
+                channel_sum += audio_data[i * channels + c] *
+                               audio_data[i * channels + c];
+        } else {
+            for (i = st->audio_data_index - frames_per_block;
+                 i < st->audio_data_index; i++)
+                channel_sum += audio_data[i * channels + c] *
+                               audio_data[i * channels + c];
+        }
+        switch (st->channel_map[c]) {
+        case FF_EBUR128_LEFT_SURROUND:
+        case FF_EBUR128_RIGHT_SURROUND:
+            channel_sum *= 1.41;
+            break;
+        case FF_EBUR128_DUAL_MONO:
+            channel_sum *= 2.0;
+            break;
+        }
+        sum += channel_sum;
+    }
+
+    return sum / (double)frames_per_block;
+}
+
+static int add_block(double **list, size_t *nb, size_t *allocated, double energy)
+{
+    if (*nb == *allocated) {
+        size_t new_allocated = FFMAX(2 * *allocated, 64);
+        double *new_list = av_realloc_array(*list, new_allocated, sizeof(**list));
+        if (!new_list)
+            return AVERROR(ENOMEM);
+        *list      = new_list;
+        *allocated = new_allocated;
+    }
+    (*list)[(*nb)++] = energy;
+    return 0;
+}
+
+static int add_gating_block(FFEBUR128State *st)
+{
+    double energy = gating_block_energy(st, st->samples_in_100ms * 4);
+
+    if (energy < histogram_energy_boundaries[0])
+        return 0;
+    if (st->mode & FF_EBUR128_MODE_HISTOGRAM) {
+        st->block_energy_histogram[find_histogram_index(energy)]++;
+        return 0;
+    }
+    return add_block(&st->block_list, &st->nb_blocks, &st->blocks_allocated,
+                     energy);
+}
+
+static int add_short_term_block(FFEBUR128State *st)
+{
+    double energy = gating_block_energy(st, st->samples_in_100ms * 30);
+
+    if (energy < histogram_energy_boundaries[0])
+        return 0;
+    if (st->mode & FF_EBUR128_MODE_HISTOGRAM) {
+        st->short_term_block_energy_histogram[find_histogram_index(energy)]++;
+        return 0;
+    }
+    return add_block(&st->short_term_block_list, &st->nb_short_term_blocks,
+                     &st->short_term_blocks_allocated, energy);
+}
+
+int ff_ebur128_add_frames_double(FFEBUR128State *st, const double *src,
+                                 size_t frames)
+{
+    int ret;
+
+    while (frames > 0) {
+        if (frames >= st->needed_frames) {
+            filter_double(st, src, st->needed_frames);
+            src    += st->needed_frames * st->channels;
+            frames -= st->needed_frames;
+            st->audio_data_index += st->needed_frames;
+            /* a new 400 ms gating block every 100 ms */
+            if ((st->mode & FF_EBUR128_MODE_I) == FF_EBUR128_MODE_I) {
+                if ((ret = add_gating_block(st)) < 0)
+                    return ret;
+            }
+            /* a new 3 s short-term block every second */
+            if ((st->mode & FF_EBUR128_MODE_LRA) == FF_EBUR128_MODE_LRA) {
+                st->short_term_frame_counter += st->needed_frames;
+                if (st->short_term_frame_counter == st->samples_in_100ms * 30) {
+                    if ((ret = add_short_term_block(st)) < 0)
+                        return ret;
+                    st->short_term_frame_counter = st->samples_in_100ms * 20;
+                }
+            }
+            st->needed_frames = st->samples_in_100ms;
+            if (st->audio_data_index == st->audio_data_frames)
+                st->audio_data_index = 0;
+        } else {
+            filter_double(st, src, frames);
+            st->audio_data_index += frames;
+            if ((st->mode & FF_EBUR128_MODE_LRA) == FF_EBUR128_MODE_LRA)
+                st->short_term_frame_counter += frames;
+            st->needed_frames -= frames;
+            frames = 0;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Sum and count the gating blocks at or above the given energy.
+ */
+static void sum_blocks(FFEBUR128State *st, double threshold,
+                       double *sum, size_t *count)
+{
+    size_t i;
+
+    *sum   = 0.0;
+    *count = 0;
+    if (st->mode & FF_EBUR128_MODE_HISTOGRAM) {
+        size_t start = 0;
+
+        if (threshold >= histogram_energy_boundaries[0]) {
+            start = find_histogram_index(threshold);
+            if (threshold > histogram_energies[start])
+                start++;
+        }
+        for (i = start; i < HISTOGRAM_BINS; i++) {
+            *sum   += st->block_energy_histogram[i] * histogram_energies[i];
+            *count += st->block_energy_histogram[i];
+        }
+    } else {
+        for (i = 0; i < st->nb_blocks; i++) {
+            if (st->block_list[i] >= threshold) {
+                *sum += st->block_list[i];
+                (*count)++;
+            }
+        }
+    }
+}
+
+int ff_ebur128_loudness_global(FFEBUR128State *st, double *out)
+{
+    double relative_threshold, gated;
+    size_t count;
+
+    if ((st->mode & FF_EBUR128_MODE_I) != FF_EBUR128_MODE_I)
+        return AVERROR(EINVAL);
+
+    sum_blocks(st, 0.0, &relative_threshold, &count);
+    if (!count) {
+        *out = -HUGE_VAL;
+        return 0;
+    }
+    relative_threshold = relative_threshold / count * RELATIVE_GATE_FACTOR;
+
+    sum_blocks(st, relative_threshold, &gated, &count);
+    *out = count ? energy_to_loudness(gated / count) : -HUGE_VAL;
+    return 0;
+}
+
+int ff_ebur128_relative_threshold(FFEBUR128State *st, double *out)
+{
+    double relative_threshold;
+    size_t count;
+
+    if ((st->mode & FF_EBUR128_MODE_I) != FF_EBUR128_MODE_I)
+        return AVERROR(EINVAL);
+
+    sum_blocks(st, 0.0, &relative_threshold, &count);
+    if (!count) {
+        *out = -70.0;
+        return 0;
+    }
+    *out = energy_to_loudness(relative_threshold / count * RELATIVE_GATE_FACTOR);
+    return 0;
+}
+
+static int loudness_interval(FFEBUR128State *st, size_t interval, double *out)
+{
+    double energy;
+
+    if (interval > st->audio_data_frames)
+        return AVERROR(EINVAL);
+    energy = gating_block_energy(st, interval);
+    *out = energy <= 0.0 ? -HUGE_VAL : energy_to_loudness(energy);
+    return 0;
+}
+
+int ff_ebur128_loudness_momentary(FFEBUR128State *st, double *out)
+{
+    return loudness_interval(st, st->samples_in_100ms * 4, out);
+}
+
+int ff_ebur128_loudness_shortterm(FFEBUR128State *st, double *out)
+{
+    if ((st->mode & FF_EBUR128_MODE_S) != FF_EBUR128_MODE_S)
+        return AVERROR(EINVAL);
+    return loudness_interval(st, st->samples_in_100ms * 30, out);
+}
+
+static int compare_double(const void *p1, const void *p2)
+{
+    const double a = *(const double *)p1;
+    const double b = *(const double *)p2;
+
+    return (a > b) - (a < b);
+}
+
+int ff_ebur128_loudness_range(FFEBUR128State *st, double *out)
+{
+    double stl_power = 0.0, stl_integrated, l_en, h_en;
+    size_t stl_size = 0, percentile_low, percentile_high, i;
+
+    if ((st->mode & FF_EBUR128_MODE_LRA) != FF_EBUR128_MODE_LRA)
+        return AVERROR(EINVAL);
+
+    if (st->mode & FF_EBUR128_MODE_HISTOGRAM) {
+        const unsigned long *hist = st->short_term_block_energy_histogram;
+        size_t index = 0, j;
+
+        for (i = 0; i < HISTOGRAM_BINS; i++) {
+            stl_power += hist[i] * histogram_energies[i];
+            stl_size  += hist[i];
+        }
+        if (!stl_size) {
+            *out = 0.0;
+            return 0;
+        }
+        stl_integrated = stl_power / stl_size * MINUS_20DB;
+
+        if (stl_integrated >= histogram_energy_boundaries[0]) {
+            index = find_histogram_index(stl_integrated);
+            if (stl_integrated > histogram_energies[index])
+                index++;
+        }
+        stl_size = 0;
+        for (j = index; j < HISTOGRAM_BINS; j++)
+            stl_size += hist[j];
+        if (!stl_size) {
+            *out = 0.0;
+            return 0;
+        }
+
+        percentile_low  = (size_t)((stl_size - 1) * 0.1  + 0.5);
+        percentile_high = (size_t)((stl_size - 1) * 0.95 + 0.5);
+
+        stl_size = 0;
+        j = index;
+        while (stl_size <= percentile_low)
+            stl_size += hist[j++];
+        l_en = histogram_energies[j - 1];
+        while (stl_size <= percentile_high)
+            stl_size += hist[j++];
+        h_en = histogram_energies[j - 1];
+    } else {
+        double *stl = st->short_term_block_list;
+        size_t n = st->nb_short_term_blocks;
+
+        if (!n) {
+            *out = 0.0;
+            return 0;
+        }
+        for (i = 0; i < n; i++)
+            stl_power += stl[i];
+        stl_integrated = stl_power / n * MINUS_20DB;
+
+        /* the order of the blocks is not used anywhere else */
+        qsort(stl, n, sizeof(*stl), compare_double);
+        while (n > 0 && *stl < stl_integrated) {
+            stl++;
+            n--;
+        }
+        if (!n) {
+            *out = 0.0;
+            return 0;
+        }
+        l_en = stl[(size_t)((n - 1) * 0.1  + 0.5)];
+        h_en = stl[(size_t)((n - 1) * 0.95 + 0.5)];
+    }
+
+    *out = energy_to_loudness(h_en) - energy_to_loudness(l_en);
+    return 0;
+}
+
+int ff_ebur128_sample_peak(FFEBUR128State *st, unsigned int channel_number,
+                           double *out)
+{
+    if ((st->mode & FF_EBUR128_MODE_SAMPLE_PEAK) != FF_EBUR128_MODE_SAMPLE_PEAK ||
+        channel_number >= st->channels)
+        return AVERROR(EINVAL);
+    *out = st->sample_peak[channel_number];
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2011 Jan Kokemüller
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * This file is based on libebur128 which is available at
+ * https://github.com/jiixyj/libebur128/
+ */
+
+#ifndef AVFILTER_EBUR128_H
+#define AVFILTER_EBUR128_H
+
+/**
+ * @file
+ * EBU R128 loudness measurement (ITU-R BS.1770), as used by the loudnorm
+ * filter.
+ */
+
+#include <stddef.h>
+
+/**
+ * Channel type, sets the weighting of the channel in the measurement.
+ */
+enum FFEBUR128Channel {
+    FF_EBUR128_UNUSED = 0,          ///< unused channel, e.g. LFE
+    FF_EBUR128_LEFT,
+    FF_EBUR128_RIGHT,
+    FF_EBUR128_CENTER,
+    FF_EBUR128_LEFT_SURROUND,
+    FF_EBUR128_RIGHT_SURROUND,
+    FF_EBUR128_DUAL_MONO,           ///< a mono channel played on two speakers
+};
+
+/**
+ * Measurement modes, each sets which of the loudness queries are available.
+ */
+enum FFEBUR128Mode {
+    /** can call ff_ebur128_loudness_momentary() */
+    FF_EBUR128_MODE_M           = (1 << 0),
+    /** can call ff_ebur128_loudness_shortterm() */
+    FF_EBUR128_MODE_S           = (1 << 1) | FF_EBUR128_MODE_M,
+    /** can call ff_ebur128_loudness_global() and ff_ebur128_relative_threshold() */
+    FF_EBUR128_MODE_I           = (1 << 2) | FF_EBUR128_MODE_M,
+    /** can call ff_ebur128_loudness_range() */
+    FF_EBUR128_MODE_LRA         = (1 << 3) | FF_EBUR128_MODE_S,
+    /** can call ff_ebur128_sample_peak() */
+    FF_EBUR128_MODE_SAMPLE_PEAK = (1 << 4) | FF_EBUR128_MODE_M,
+    /**
+     * Keep the gating blocks in 0.1 LU wide histograms instead of lists, so
+     * the I and LRA queries take constant time and memory, at 0.1 LU
+     * resolution.
+     */
+    FF_EBUR128_MODE_HISTOGRAM   = (1 << 6),
+};
+
+typedef struct FFEBUR128State FFEBUR128State;
+
+/**
+ * Allocate a measurement state.
+ *
+ * @param channels   number of interleaved channels
+ * @param samplerate sample rate in Hz
+ * @param mode       a combination of FFEBUR128Mode flags
+ * @return the new state, NULL on error
+ */
+FFEBUR128State *ff_ebur128_init(unsigned int channels,
+                                unsigned long samplerate, int mode);
+
+/**
+ * Free a measurement state and set the pointer to NULL.
+ */
+void ff_ebur128_destroy(FFEBUR128State **st);
+
+/**
+ * Change the type of a channel; by default the channels are, in order,
+ * left, right, center, unused, left surround and right surround, with four
+ * channels mapped as left, right, left surround and right surround and five
+ * as left, right, center, left surround and right surround.
+ *
+ * @return 0 on success, AVERROR(EINVAL) on an invalid channel or value
+ */
+int ff_ebur128_set_channel(FFEBUR128State *st, unsigned int channel_number,
+                           int value);
+
+/**
+ * Add interleaved frames to the measurement.
+ *
+ * @return 0 on success, a negative AVERROR code on allocation failure
+ */
+int ff_ebur128_add_frames_double(FFEBUR128State *st, const double *src,
+                                 size_t frames);
+
+/**
+ * Get the momentary loudness (last 400 ms) in LUFS.
+ */
+int ff_ebur128_loudness_momentary(FFEBUR128State *st, double *out);
+
+/**
+ * Get the short-term loudness (last 3 s) in LUFS.
+ */
+int ff_ebur128_loudness_shortterm(FFEBUR128State *st, double *out);
+
+/**
+ * Get the gated integrated loudness of everything added so far in LUFS,
+ * -HUGE_VAL if no block was above the absolute gate.
+ */
+int ff_ebur128_loudness_global(FFEBUR128State *st, double *out);
+
+/**
+ * Get the relative gate of the integrated loudness in LUFS, -70 if no block
+ * was above the absolute gate.
+ */
+int ff_ebur128_relative_threshold(FFEBUR128State *st, double *out);
+
+/**
+ * Get the loudness range (EBU Tech 3342) in LU.
+ */
+int ff_ebur128_loudness_range(FFEBUR128State *st, double *out);
+
+/**
+ * Get the maximum absolute sample value of a channel seen so far.
+ */
+int ff_ebur128_sample_peak(FFEBUR128State *st, unsigned int channel_number,
+                           double *out);
+
+#endif /* AVFILTER_EBUR128_H */
@@ -0,0 +1,158 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Check that the histogram metering used by loudnorm=histogram=1 measures
+ * the same integrated loudness, loudness range, relative gate and peaks as
+ * the exact metering, within the 0.1 LU resolution of the histograms.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "libavutil/common.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/mem.h"
+
+#include "libavfilter/ebur128.h"
+
+typedef struct Measurement {
+    double i, lra, thresh, peak;
+} Measurement;
+
+typedef struct TestSignal {
+    const char *name;
+    int channels;
+    int sample_rate;
+    int seconds;
+    int dual_mono;
+    int tone;           ///< steady 1 kHz tone instead of varying noise
+} TestSignal;
+
+static const TestSignal signals[] = {
+    { "1 kHz -23 dBFS stereo",  2, 48000, 20, 0, 1 },
+    { "speech-like stereo",     2, 48000, 60, 0, 0 },
+    { "speech-like 5.0",        5, 44100, 40, 0, 0 },
+    { "speech-like dual mono",  1, 32000, 30, 1, 0 },
+};
+
+static void generate(const TestSignal *sig, double *buf, int64_t start,
+                     int nb_frames, unsigned *seed)
+{
+    int n, c;
+
+    for (n = 0; n < nb_frames; n++) {
+        double t = (double)(start + n) / sig->sample_rate;
+
+        for (c = 0; c < sig->channels; c++) {
+            double v;
+
+            if (sig->tone) {
+                v = pow(10, -23 / 20.0) * sin(2 * M_PI * 1000 * t);
+            } else {
+                /* noise under an envelope that varies by about 25 dB,
+                 * with a quiet pause every 10 seconds */
+                *seed = *seed * 1664525 + 1013904223;
+                v = ((*seed >> 8) / (double)(1 << 24) - 0.5) *
+                    (0.02 + 0.4 * fabs(sin((c + 1) * t))) *
+                    (fmod(t, 10) < 8 ? 1.0 : 0.01);
+            }
+            buf[n * sig->channels + c] = v;
+        }
+    }
+}
+
+static int measure(const TestSignal *sig, int histogram, Measurement *m)
+{
+    int mode = FF_EBUR128_MODE_I | FF_EBUR128_MODE_S | FF_EBUR128_MODE_LRA |
+               FF_EBUR128_MODE_SAMPLE_PEAK;
+    const int frame_size = 1024;
+    int64_t total = (int64_t)sig->seconds * sig->sample_rate, pos = 0;
+    FFEBUR128State *st;
+    unsigned seed = 1;
+    double *buf;
+    int c;
+
+    if (histogram)
+        mode |= FF_EBUR128_MODE_HISTOGRAM;
+    st  = ff_ebur128_init(sig->channels, sig->sample_rate, mode);
+    buf = av_malloc_array(frame_size * sig->channels, sizeof(*buf));
+    if (!st || !buf)
+        goto fail;
+    if (sig->dual_mono && ff_ebur128_set_channel(st, 0, FF_EBUR128_DUAL_MONO) < 0)
+        goto fail;
+
+    while (pos < total) {
+        int nb_frames = FFMIN(frame_size, total - pos);
+
+        generate(sig, buf, pos, nb_frames, &seed);
+        if (ff_ebur128_add_frames_double(st, buf, nb_frames) < 0)
+            goto fail;
+        pos += nb_frames;
+    }
+
+    ff_ebur128_loudness_global(st, &m->i);
+    ff_ebur128_loudness_range(st, &m->lra);
+    ff_ebur128_relative_threshold(st, &m->thresh);
+    m->peak = 0;
+    for (c = 0; c < sig->channels; c++) {
+        double tmp;
+        ff_ebur128_sample_peak(st, c, &tmp);
+        m->peak = FFMAX(m->peak, tmp);
+    }
+
+    ff_ebur128_destroy(&st);
+    av_free(buf);
+    return 0;
+
+fail:
+    ff_ebur128_destroy(&st);
+    av_free(buf);
+    return -1;
+}
+
+int main(void)
+{
+    int i, ret = 0;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(signals); i++) {
+        const TestSignal *sig = &signals[i];
+        Measurement exact, hist;
+        int ok;
+
+        if (measure(sig, 0, &exact) < 0 || measure(sig, 1, &hist) < 0) {
+            printf("%s: failed\n", sig->name);
+            return 1;
+        }
+        /* each histogram bin is 0.1 LU wide, and LRA has two ends in bins */
+        ok = fabs(exact.i      - hist.i)      <= 0.1 &&
+             fabs(exact.thresh - hist.thresh) <= 0.1 &&
+             fabs(exact.lra    - hist.lra)    <= 0.2 &&
+             exact.peak == hist.peak;
+        printf("%s: I %.1f LUFS, LRA %.1f LU, threshold %.1f LUFS, peak %.4f, histogram %s\n",
+               sig->name, exact.i, exact.lra, exact.thresh, exact.peak,
+               ok ? "matches" : "differs");
+        if (!ok) {
+            printf("histogram: I %f LUFS, LRA %f LU, threshold %f LUFS, peak %f\n",
+                   hist.i, hist.lra, hist.thresh, hist.peak);
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
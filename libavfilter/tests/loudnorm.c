@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2016 Plex, Inc.
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * loudnorm throughput and startup latency benchmark.
+ *
+ * usage: loudnorm [lookahead [channels [seconds [linear]]]]
+ * Defaults to dynamic normalization of 60 seconds of 48 kHz stereo with the
+ * full 3 second lookahead. The time to the first output frame is the startup
+ * delay a transcode sees.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/common.h"
+#include "libavutil/frame.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+
+int main(int argc, char **argv)
+{
+    const char *lookahead = argc > 1 ? argv[1] : "3";
+    int channels = argc > 2 ? atoi(argv[2]) : 2;
+    int seconds  = argc > 3 ? atoi(argv[3]) : 60;
+    int linear   = argc > 4 ? atoi(argv[4]) : 0;
+    AVFilterGraph *graph = NULL;
+    AVFilterContext *sink = NULL;
+    AVFilterInOut *inputs = NULL;
+    AVFrame *frame = NULL;
+    char desc[1024], expr[256] = "";
+    int64_t t0, t_first = -1, t1, out_total = 0;
+    int i, ret = 1;
+
+    if (channels <= 0 || channels > 8 || seconds <= 0) {
+        fprintf(stderr, "usage: %s [lookahead [channels [seconds [linear]]]]\n", argv[0]);
+        return 1;
+    }
+
+    avfilter_register_all();
+
+    /* A speech-like envelope over noise, so dynamic mode has work to do. */
+    for (i = 0; i < channels; i++)
+        av_strlcatf(expr, sizeof(expr), "%s(0.1+0.4*abs(sin(%d*t)))*(random(%d)-0.5)",
+                    i ? "|" : "", i + 1, i);
+    snprintf(desc, sizeof(desc),
+             "aevalsrc='%s':s=48000:d=%d,loudnorm=lookahead=%s%s,aresample=48000",
+             expr, seconds, lookahead,
+             linear ? ":measured_I=-30:measured_LRA=3:measured_TP=-10:measured_thresh=-40" : "");
+
+    graph  = avfilter_graph_alloc();
+    inputs = avfilter_inout_alloc();
+    frame  = av_frame_alloc();
+    if (!graph || !inputs || !frame)
+        goto end;
+
+    t0 = av_gettime_relative();
+    if (avfilter_graph_create_filter(&sink, avfilter_get_by_name("abuffersink"),
+                                     "out", NULL, NULL, graph) < 0)
+        goto end;
+
+    inputs->name       = av_strdup("out");
+    inputs->filter_ctx = sink;
+    inputs->pad_idx    = 0;
+    inputs->next       = NULL;
+
+    if (avfilter_graph_parse_ptr(graph, desc, &inputs, NULL, NULL) < 0 ||
+        avfilter_graph_config(graph, NULL) < 0) {
+        fprintf(stderr, "failed to set up %s\n", desc);
+        goto end;
+    }
+
+    while ((ret = av_buffersink_get_frame(sink, frame)) >= 0) {
+        if (t_first < 0)
+            t_first = av_gettime_relative();
+        out_total += frame->nb_samples;
+        av_frame_unref(frame);
+    }
+    t1 = av_gettime_relative();
+    if (ret != AVERROR_EOF) {
+        fprintf(stderr, "filtering failed\n");
+        ret = 1;
+        goto end;
+    }
+
+    printf("%d ch %s lookahead %ss: %"PRId64" samples, first frame after %"PRId64" us, "
+           "total %"PRId64" us, %.1fx realtime\n",
+           channels, linear ? "linear" : "dynamic", lookahead, out_total,
+           t_first - t0, t1 - t0, seconds * 1000000.0 / FFMAX(t1 - t0, 1));
+    ret = 0;
+
+end:
+    avfilter_inout_free(&inputs);
+    avfilter_graph_free(&graph);
+    av_frame_free(&frame);
+    return ret;
+}
@@ -48,7 +48,7 @@ AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
     enum AVPixelFormat pool_format = AV_PIX_FMT_NONE;
 
     if (!link->video_frame_pool) {
-        link->video_frame_pool = ff_video_frame_pool_init(av_buffer_allocz, w, h,
+        link->video_frame_pool = ff_video_frame_pool_init(av_buffer_allocz_huge, w, h,
                                                           link->format, BUFFER_ALIGN);
         if (!link->video_frame_pool)
             return NULL;
@@ -63,7 +63,7 @@ AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
             pool_format != link->format || pool_align != BUFFER_ALIGN) {
 
             ff_video_frame_pool_uninit((FFVideoFramePool **)&link->video_frame_pool);
-            link->video_frame_pool = ff_video_frame_pool_init(av_buffer_allocz, w, h,
+            link->video_frame_pool = ff_video_frame_pool_init(av_buffer_allocz_huge, w, h,
                                                               link->format, BUFFER_ALIGN);
             if (!link->video_frame_pool)
                 return NULL;
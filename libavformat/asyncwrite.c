@@ -0,0 +1,285 @@
+/*
+ * Asynchronous file writer for muxers writing many files
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "libavutil/atomic.h"
+#include "libavutil/avstring.h"
+#include "libavutil/buffer.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
+#include "asyncwrite.h"
+#include "internal.h"
+
+#define ASYNC_WRITE_BUFFER_SIZE (256 * 1024)
+/* Buffers pending before the muxing thread blocks, 8 MiB in total. */
+#define ASYNC_WRITE_QUEUE_SIZE  32
+
+typedef struct AsyncWriteJob {
+    AVIOContext *pb;        ///< written to, or closed if buf is NULL
+    AVBufferRef *buf;
+    int size;
+    char *src, *dst;        ///< moved after closing pb, deleted if dst is NULL
+} AsyncWriteJob;
+
+struct FFAsyncWriter {
+    AVFormatContext *s;
+    AVThreadMessageQueue *queue;
+    AVBufferPool *pool;
+    volatile int error;
+#if HAVE_THREADS
+    pthread_t thread;
+#endif
+};
+
+typedef struct AsyncWriteFile {
+    FFAsyncWriter *w;
+    AVIOContext *pb;
+} AsyncWriteFile;
+
+static int move_file(AVFormatContext *s, const char *src, const char *dst)
+{
+    int ret;
+
+    if (!dst) {
+        avpriv_io_delete(src);
+        return 0;
+    }
+    ret = avpriv_io_move(src, dst);
+    if (ret < 0)
+        av_log(s, AV_LOG_ERROR, "Could not move %s to %s: %s\n",
+               src, dst, av_err2str(ret));
+    return ret;
+}
+
+static void free_job(void *msg)
+{
+    AsyncWriteJob *job = msg;
+
+    av_buffer_unref(&job->buf);
+    av_freep(&job->src);
+    av_freep(&job->dst);
+}
+
+#if HAVE_THREADS
+static void *async_writer_thread(void *arg)
+{
+    FFAsyncWriter *w = arg;
+    AsyncWriteJob job;
+
+    while (av_thread_message_queue_recv(w->queue, &job, 0) >= 0) {
+        int ret = 0;
+
+        if (job.buf) {
+            if (!w->error) {
+                avio_write(job.pb, job.buf->data, job.size);
+                ret = job.pb->error;
+            }
+        } else {
+            if (job.pb) {
+                avio_flush(job.pb);
+                ret = job.pb->error;
+                ff_format_io_close(w->s, &job.pb);
+            }
+            /* Never publish a file which may be incomplete. */
+            if (job.src && (!job.dst || (ret >= 0 && !w->error)))
+                ret = move_file(w->s, job.src, job.dst);
+        }
+        free_job(&job);
+
+        if (ret < 0 && !w->error)
+            avpriv_atomic_int_set(&w->error, ret);
+    }
+
+    return NULL;
+}
+#endif
+
+int ff_async_writer_alloc(FFAsyncWriter **pw, AVFormatContext *s)
+{
+#if HAVE_THREADS
+    FFAsyncWriter *w;
+    int ret;
+
+    if (!(w = av_mallocz(sizeof(*w))))
+        return AVERROR(ENOMEM);
+    w->s = s;
+
+    ret = av_thread_message_queue_alloc2(&w->queue, ASYNC_WRITE_QUEUE_SIZE,
+                                         sizeof(AsyncWriteJob),
+                                         AV_THREAD_MESSAGE_QUEUE_SPSC);
+    if (ret < 0)
+        goto fail;
+    av_thread_message_queue_set_free_func(w->queue, free_job);
+
+    if (!(w->pool = av_buffer_pool_init(ASYNC_WRITE_BUFFER_SIZE, NULL))) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    ret = pthread_create(&w->thread, NULL, async_writer_thread, w);
+    if (ret) {
+        av_log(s, AV_LOG_ERROR, "Failed to start writer thread: %s\n",
+               strerror(ret));
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    *pw = w;
+    return 0;
+fail:
+    av_buffer_pool_uninit(&w->pool);
+    av_thread_message_queue_free(&w->queue);
+    av_free(w);
+    return ret;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+static int async_write_packet(void *opaque, uint8_t *buf, int size)
+{
+    AsyncWriteFile *f = opaque;
+    FFAsyncWriter *w = f->w;
+    AsyncWriteJob job = { f->pb };
+    int ret;
+
+    if ((ret = avpriv_atomic_int_get(&w->error)) < 0)
+        return ret;
+
+    if (!(job.buf = av_buffer_pool_get(w->pool)))
+        return AVERROR(ENOMEM);
+    memcpy(job.buf->data, buf, size);
+    job.size = size;
+
+    ret = av_thread_message_queue_send(w->queue, &job, 0);
+    if (ret < 0) {
+        av_buffer_unref(&job.buf);
+        return ret;
+    }
+    return size;
+}
+
+int ff_async_writer_wrap(FFAsyncWriter *w, AVIOContext **pb)
+{
+    AsyncWriteFile *f;
+    uint8_t *buf;
+    AVIOContext *apb = NULL;
+
+    if (!w || !*pb)
+        return 0;
+
+    f   = av_mallocz(sizeof(*f));
+    buf = av_malloc(ASYNC_WRITE_BUFFER_SIZE);
+    if (f && buf)
+        apb = avio_alloc_context(buf, ASYNC_WRITE_BUFFER_SIZE, 1, f,
+                                 NULL, async_write_packet, NULL);
+    if (!apb) {
+        av_free(buf);
+        av_free(f);
+        return AVERROR(ENOMEM);
+    }
+    apb->seekable = 0;
+
+    f->w  = w;
+    f->pb = *pb;
+    /* The buffers handed over are large already, write them out as they are. */
+    f->pb->direct = 1;
+
+    *pb = apb;
+    return 0;
+}
+
+static int queue_job(FFAsyncWriter *w, AVIOContext *pb,
+                     const char *src, const char *dst)
+{
+    AsyncWriteJob job = { pb };
+    int ret = 0;
+
+    if (src && (!(job.src = av_strdup(src)) ||
+                (dst && !(job.dst = av_strdup(dst))))) {
+        av_freep(&job.src);
+        av_freep(&job.dst);
+        ret = AVERROR(ENOMEM);
+        /* Still let the file be closed. */
+        if (!pb)
+            return ret;
+    }
+
+    if (av_thread_message_queue_send(w->queue, &job, 0) < 0)
+        free_job(&job);
+    return ret;
+}
+
+int ff_async_writer_close(FFAsyncWriter *w, AVFormatContext *s, AVIOContext **pb,
+                          const char *src, const char *dst)
+{
+    AVIOContext *apb = *pb;
+    AsyncWriteFile *f;
+    int ret;
+
+    if (!apb || apb->write_packet != async_write_packet) {
+        ff_format_io_close(s, pb);
+        return src ? ff_async_writer_move(w, src, dst) : 0;
+    }
+
+    f = apb->opaque;
+    w = f->w;
+    avio_flush(apb);
+    ret = apb->error;
+    if (queue_job(w, f->pb, src, dst) < 0 && ret >= 0)
+        ret = AVERROR(ENOMEM);
+
+    av_freep(&apb->buffer);
+    av_freep(pb);
+    av_free(f);
+
+    if (ret >= 0)
+        ret = avpriv_atomic_int_get(&w->error);
+    return ret;
+}
+
+int ff_async_writer_move(FFAsyncWriter *w, const char *src, const char *dst)
+{
+    if (!w)
+        return move_file(NULL, src, dst);
+    return queue_job(w, NULL, src, dst);
+}
+
+int ff_async_writer_free(FFAsyncWriter **pw)
+{
+    FFAsyncWriter *w = *pw;
+    int ret;
+
+    if (!w)
+        return 0;
+
+#if HAVE_THREADS
+    av_thread_message_queue_set_err_recv(w->queue, AVERROR_EOF);
+    pthread_join(w->thread, NULL);
+#endif
+    ret = w->error;
+
+    av_thread_message_queue_free(&w->queue);
+    av_buffer_pool_uninit(&w->pool);
+    av_freep(pw);
+    return ret;
+}
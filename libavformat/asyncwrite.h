@@ -0,0 +1,74 @@
+/*
+ * Asynchronous file writer for muxers writing many files
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_ASYNCWRITE_H
+#define AVFORMAT_ASYNCWRITE_H
+
+#include "avformat.h"
+#include "avio.h"
+
+/**
+ * A writer thread doing the filesystem work of a muxer: the writes to the
+ * AVIOContexts wrapped by it, their closing, and moving or deleting files,
+ * all in the order they were queued. The muxing thread only copies the data
+ * into large pooled buffers, and blocks only when too much data is pending.
+ */
+typedef struct FFAsyncWriter FFAsyncWriter;
+
+/**
+ * Start a writer thread.
+ *
+ * @param s the muxer, used to close the AVIOContexts and for logging
+ * @return 0 on success, AVERROR(ENOSYS) if built without threads, or another
+ *         negative error code
+ */
+int ff_async_writer_alloc(FFAsyncWriter **w, AVFormatContext *s);
+
+/**
+ * Make the writes to an AVIOContext opened with s->io_open() go through the
+ * writer thread. *pb is replaced with a non-seekable AVIOContext, which must
+ * be closed with ff_async_writer_close().
+ */
+int ff_async_writer_wrap(FFAsyncWriter *w, AVIOContext **pb);
+
+/**
+ * Close *pb once the data written to it so far is written, then move src to
+ * dst as ff_async_writer_move() does, if src is not NULL. An AVIOContext not
+ * wrapped by ff_async_writer_wrap() is closed right away.
+ *
+ * @return an error of an earlier write, or of the move if done right away
+ */
+int ff_async_writer_close(FFAsyncWriter *w, AVFormatContext *s, AVIOContext **pb,
+                          const char *src, const char *dst);
+
+/**
+ * Move src to dst, or delete src if dst is NULL, after the work queued so far.
+ * This is done right away if w is NULL.
+ */
+int ff_async_writer_move(FFAsyncWriter *w, const char *src, const char *dst);
+
+/**
+ * Wait for the queued work to be done, and stop the writer thread.
+ *
+ * @return the first error the writer thread ran into, 0 otherwise
+ */
+int ff_async_writer_free(FFAsyncWriter **w);
+
+#endif /* AVFORMAT_ASYNCWRITE_H */
@@ -927,6 +927,15 @@ fail:
     return AVERROR(ENOMEM);
 }
 
+URLContext *ffio_geturlcontext(AVIOContext *s)
+{
+    AVIOInternal *internal;
+    if (!s || s->write_packet != io_write_packet)
+        return NULL;
+    internal = s->opaque;
+    return internal->h;
+}
+
 int ffio_ensure_seekback(AVIOContext *s, int64_t buf_size)
 {
     uint8_t *buffer;
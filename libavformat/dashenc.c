@@ -32,6 +32,7 @@
 #include "libavutil/rational.h"
 #include "libavutil/time_internal.h"
 
+#include "asyncwrite.h"
 #include "avc.h"
 #include "avformat.h"
 #include "avio_internal.h"
@@ -50,6 +51,13 @@ typedef enum {
     DASH_TMPL_ID_TIME,
 } DASHTmplId;
 
+typedef struct Part {
+    int64_t start_pos;
+    int range_length;
+    int duration;
+    int independent;
+} Part;
+
 typedef struct Segment {
     char file[1024];
     int64_t start_pos;
@@ -57,6 +65,8 @@ typedef struct Segment {
     int64_t time;
     int duration;
     int n;
+    Part *parts;
+    int nb_parts;
 } Segment;
 
 typedef struct OutputStream {
@@ -64,7 +74,19 @@ typedef struct OutputStream {
     int ctx_inited;
     uint8_t iobuf[32768];
     AVIOContext *out;
+    int64_t pos;
+    int64_t head_pos;
+    uint8_t head[8];
+    int head_len;
     int packets_written;
+    int seg_started;
+    int chunk_packets;
+    int64_t chunk_start_pts;
+    int chunk_independent;
+    int64_t seg_start_pos;
+    char seg_file[1024];
+    Part *parts;
+    int nb_parts;
     char initfile[1024];
     int64_t init_start_pos;
     int init_range_length;
@@ -88,6 +110,8 @@ typedef struct DASHContext {
     int use_template;
     int use_timeline;
     int single_file;
+    int hls_playlist;
+    int64_t frag_duration;
     OutputStream *streams;
     int has_video, has_audio;
     int64_t last_duration;
@@ -99,8 +123,11 @@ typedef struct DASHContext {
     const char *media_seg_name;
     AVRational min_frame_rate, max_frame_rate;
     int ambiguous_frame_rate;
+    int async_write;
+    FFAsyncWriter *writer;
 //PLEX
     int skip_to_segment;
+    int seek_restart;
 //PLEX
 } DASHContext;
 
@@ -109,6 +136,17 @@ static int dash_write(void *opaque, uint8_t *buf, int buf_size)
     OutputStream *os = opaque;
     if (os->out)
         avio_write(os->out, buf, buf_size);
+    // Keep the first bytes of the segment being written, to find its sidx
+    // without reading the file back.
+    if (os->head_pos >= 0 && os->head_len < sizeof(os->head)) {
+        int64_t offset = os->head_pos + os->head_len - os->pos;
+        if (offset < buf_size) {
+            int len = FFMIN((int)sizeof(os->head) - os->head_len, buf_size - offset);
+            memcpy(os->head + os->head_len, buf + offset, len);
+            os->head_len += len;
+        }
+    }
+    os->pos += buf_size;
     return buf_size;
 }
 
@@ -178,6 +216,25 @@ static void set_codec_str(AVFormatContext *s, AVCodecParameters *par,
     }
 }
 
+static void free_segment(Segment **seg)
+{
+    if (*seg)
+        av_free((*seg)->parts);
+    av_freep(seg);
+}
+
+static int dash_io_open(AVFormatContext *s, AVIOContext **pb, const char *filename)
+{
+    DASHContext *c = s->priv_data;
+    int ret;
+
+    if ((ret = s->io_open(s, pb, filename, AVIO_FLAG_WRITE, NULL)) < 0)
+        return ret;
+    if ((ret = ff_async_writer_wrap(c->writer, pb)) < 0)
+        ff_format_io_close(s, pb);
+    return ret;
+}
+
 static void dash_free(AVFormatContext *s)
 {
     DASHContext *c = s->priv_data;
@@ -190,17 +247,27 @@ static void dash_free(AVFormatContext *s)
             av_write_trailer(os->ctx);
         if (os->ctx && os->ctx->pb)
             av_free(os->ctx->pb);
-        ff_format_io_close(s, &os->out);
+        ff_async_writer_close(c->writer, s, &os->out, NULL, NULL);
         if (os->ctx)
             avformat_free_context(os->ctx);
         for (j = 0; j < os->nb_segments; j++)
-            av_free(os->segments[j]);
+            free_segment(&os->segments[j]);
         av_free(os->segments);
+        av_free(os->parts);
     }
     av_freep(&c->streams);
+    ff_async_writer_free(&c->writer);
 }
 
-static void output_segment_list(OutputStream *os, AVIOContext *out, DASHContext *c)
+static void output_chunk_availability(AVIOContext *out, DASHContext *c, int final)
+{
+    // Chunks of a segment are available before the segment is complete.
+    if (c->frag_duration && !final && c->last_duration > c->frag_duration)
+        avio_printf(out, "availabilityTimeOffset=\"%.3f\" availabilityTimeComplete=\"false\" ",
+                    (c->last_duration - c->frag_duration) / (double)AV_TIME_BASE);
+}
+
+static void output_segment_list(OutputStream *os, AVIOContext *out, DASHContext *c, int final)
 {
     int i, start_index = 0, start_number = 1;
     if (c->window_size) {
@@ -213,6 +280,7 @@ static void output_segment_list(OutputStream *os, AVIOContext *out, DASHContext
         avio_printf(out, "\t\t\t\t<SegmentTemplate timescale=\"%d\" ", timescale);
         if (!c->use_timeline)
             avio_printf(out, "duration=\"%"PRId64"\" ", c->last_duration);
+        output_chunk_availability(out, c, final);
         avio_printf(out, "initialization=\"%s\" media=\"%s\" startNumber=\"%d\">\n", c->init_seg_name, c->media_seg_name, c->use_timeline ? start_number : 1);
         if (c->use_timeline) {
             int64_t cur_time = 0;
@@ -241,7 +309,9 @@ static void output_segment_list(OutputStream *os, AVIOContext *out, DASHContext
         avio_printf(out, "\t\t\t\t</SegmentTemplate>\n");
     } else if (c->single_file) {
         avio_printf(out, "\t\t\t\t<BaseURL>%s</BaseURL>\n", os->initfile);
-        avio_printf(out, "\t\t\t\t<SegmentList timescale=\"%d\" duration=\"%"PRId64"\" startNumber=\"%d\">\n", AV_TIME_BASE, c->last_duration, start_number);
+        avio_printf(out, "\t\t\t\t<SegmentList timescale=\"%d\" duration=\"%"PRId64"\" ", AV_TIME_BASE, c->last_duration);
+        output_chunk_availability(out, c, final);
+        avio_printf(out, "startNumber=\"%d\">\n", start_number);
         avio_printf(out, "\t\t\t\t\t<Initialization range=\"%"PRId64"-%"PRId64"\" />\n", os->init_start_pos, os->init_start_pos + os->init_range_length - 1);
         for (i = start_index; i < os->nb_segments; i++) {
             Segment *seg = os->segments[i];
@@ -252,7 +322,9 @@ static void output_segment_list(OutputStream *os, AVIOContext *out, DASHContext
         }
         avio_printf(out, "\t\t\t\t</SegmentList>\n");
     } else {
-        avio_printf(out, "\t\t\t\t<SegmentList timescale=\"%d\" duration=\"%"PRId64"\" startNumber=\"%d\">\n", AV_TIME_BASE, c->last_duration, start_number);
+        avio_printf(out, "\t\t\t\t<SegmentList timescale=\"%d\" duration=\"%"PRId64"\" ", AV_TIME_BASE, c->last_duration);
+        output_chunk_availability(out, c, final);
+        avio_printf(out, "startNumber=\"%d\">\n", start_number);
         avio_printf(out, "\t\t\t\t\t<Initialization sourceURL=\"%s\" />\n", os->initfile);
         for (i = start_index; i < os->nb_segments; i++) {
             Segment *seg = os->segments[i];
@@ -442,6 +514,158 @@ static void format_date_now(char *buf, int size)
     }
 }
 
+// A truncated name could be the one of another file, so fail instead.
+static int get_hls_playlist_name(char *name, int size, const char *dirname, int id)
+{
+    int len;
+    if (id < 0)
+        len = snprintf(name, size, "%smaster.m3u8", dirname);
+    else
+        len = snprintf(name, size, "%smedia_%d.m3u8", dirname, id);
+    return len < size ? 0 : AVERROR(EINVAL);
+}
+
+static void output_hls_parts(AVIOContext *out, DASHContext *c, const Part *parts, int nb_parts,
+                             const char *file, int64_t seg_start_pos, AVRational time_base)
+{
+    int i;
+    // Within a segment file, parts are addressed relative to its start.
+    if (c->single_file)
+        seg_start_pos = 0;
+    for (i = 0; i < nb_parts; i++)
+        avio_printf(out, "#EXT-X-PART:DURATION=%f,URI=\"%s\",BYTERANGE=\"%d@%"PRId64"\"%s\n",
+                    parts[i].duration * av_q2d(time_base), file, parts[i].range_length,
+                    parts[i].start_pos - seg_start_pos, parts[i].independent ? ",INDEPENDENT=YES" : "");
+}
+
+static int write_hls_media_playlist(AVFormatContext *s, int i, int final)
+{
+    DASHContext *c = s->priv_data;
+    OutputStream *os = &c->streams[i];
+    AVRational time_base = s->streams[i]->time_base;
+    AVIOContext *out;
+    char filename[1024], temp_filename[1024];
+    int ret, j, target_duration = 1, start_index = 0, part_index;
+    double part_window = 0;
+
+    if (c->window_size)
+        start_index = FFMAX(os->nb_segments - c->window_size, 0);
+    for (j = start_index; j < os->nb_segments; j++)
+        target_duration = FFMAX(target_duration,
+                                lrint(os->segments[j]->duration * av_q2d(time_base)));
+    // Parts are only listed for the segments of the last three target durations.
+    part_index = os->nb_segments;
+    while (c->frag_duration && !final && part_index > start_index &&
+           part_window < 3 * target_duration)
+        part_window += os->segments[--part_index]->duration * av_q2d(time_base);
+
+    if ((ret = get_hls_playlist_name(filename, sizeof(filename), c->dirname, i)) < 0)
+        return ret;
+    if (snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", filename) >= sizeof(temp_filename))
+        return AVERROR(EINVAL);
+    ret = dash_io_open(s, &out, temp_filename);
+    if (ret < 0) {
+        av_log(s, AV_LOG_ERROR, "Unable to open %s for writing\n", temp_filename);
+        return ret;
+    }
+    avio_printf(out, "#EXTM3U\n");
+    avio_printf(out, "#EXT-X-VERSION:7\n");
+    avio_printf(out, "#EXT-X-TARGETDURATION:%d\n", target_duration);
+    avio_printf(out, "#EXT-X-MEDIA-SEQUENCE:%d\n", os->segment_index - os->nb_segments + start_index);
+    if (!c->window_size)
+        avio_printf(out, "#EXT-X-PLAYLIST-TYPE:%s\n", final ? "VOD" : "EVENT");
+    if (c->frag_duration && !final) {
+        // Players must start at least three parts from the live edge.
+        avio_printf(out, "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=%.3f\n", 3 * c->frag_duration / (double)AV_TIME_BASE);
+        avio_printf(out, "#EXT-X-PART-INF:PART-TARGET=%.3f\n", c->frag_duration / (double)AV_TIME_BASE);
+    }
+    if (c->single_file) {
+        if (os->init_range_length)
+            avio_printf(out, "#EXT-X-MAP:URI=\"%s\",BYTERANGE=\"%d@%"PRId64"\"\n",
+                        os->initfile, os->init_range_length, os->init_start_pos);
+    } else {
+        avio_printf(out, "#EXT-X-MAP:URI=\"%s\"\n", os->initfile);
+    }
+    for (j = start_index; j < os->nb_segments; j++) {
+        Segment *seg = os->segments[j];
+        if (j >= part_index)
+            output_hls_parts(out, c, seg->parts, seg->nb_parts,
+                             c->single_file ? os->initfile : seg->file, seg->start_pos, time_base);
+        avio_printf(out, "#EXTINF:%f,\n", seg->duration * av_q2d(time_base));
+        if (c->single_file)
+            avio_printf(out, "#EXT-X-BYTERANGE:%d@%"PRId64"\n%s\n",
+                        seg->range_length, seg->start_pos, os->initfile);
+        else
+            avio_printf(out, "%s\n", seg->file);
+    }
+    if (c->frag_duration && !final)
+        output_hls_parts(out, c, os->parts, os->nb_parts,
+                         c->single_file ? os->initfile : os->seg_file, os->seg_start_pos, time_base);
+    if (final)
+        avio_printf(out, "#EXT-X-ENDLIST\n");
+    avio_flush(out);
+    return ff_async_writer_close(c->writer, s, &out, temp_filename, filename);
+}
+
+static int write_hls_playlists(AVFormatContext *s, int final)
+{
+    DASHContext *c = s->priv_data;
+    AVIOContext *out;
+    char filename[1024], temp_filename[1024];
+    const char *audio_codec_str = NULL;
+    int ret, i, audio_bit_rate = 0;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        if ((ret = write_hls_media_playlist(s, i, final)) < 0)
+            return ret;
+    }
+
+    if ((ret = get_hls_playlist_name(filename, sizeof(filename), c->dirname, -1)) < 0)
+        return ret;
+    if (snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", filename) >= sizeof(temp_filename))
+        return AVERROR(EINVAL);
+    ret = dash_io_open(s, &out, temp_filename);
+    if (ret < 0) {
+        av_log(s, AV_LOG_ERROR, "Unable to open %s for writing\n", temp_filename);
+        return ret;
+    }
+    avio_printf(out, "#EXTM3U\n");
+    avio_printf(out, "#EXT-X-VERSION:7\n");
+    avio_printf(out, "#EXT-X-INDEPENDENT-SEGMENTS\n");
+    for (i = 0; i < s->nb_streams; i++) {
+        OutputStream *os = &c->streams[i];
+        if (s->streams[i]->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+            continue;
+        if (c->has_video) {
+            avio_printf(out, "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"audio\",NAME=\"audio_%d\","
+                        "DEFAULT=%s,AUTOSELECT=YES,URI=\"media_%d.m3u8\"\n",
+                        i, audio_codec_str ? "NO" : "YES", i);
+            if (!audio_codec_str || os->bit_rate > audio_bit_rate) {
+                audio_codec_str = os->codec_str;
+                audio_bit_rate  = os->bit_rate;
+            }
+        } else {
+            avio_printf(out, "#EXT-X-STREAM-INF:BANDWIDTH=%d,CODECS=\"%s\"\nmedia_%d.m3u8\n",
+                        os->bit_rate, os->codec_str, i);
+        }
+    }
+    for (i = 0; i < s->nb_streams; i++) {
+        AVCodecParameters *par = s->streams[i]->codecpar;
+        OutputStream *os = &c->streams[i];
+        if (par->codec_type != AVMEDIA_TYPE_VIDEO)
+            continue;
+        avio_printf(out, "#EXT-X-STREAM-INF:BANDWIDTH=%d,CODECS=\"%s%s%s\",RESOLUTION=%dx%d",
+                    os->bit_rate + audio_bit_rate, os->codec_str,
+                    audio_codec_str ? "," : "", audio_codec_str ? audio_codec_str : "",
+                    par->width, par->height);
+        if (audio_codec_str)
+            avio_printf(out, ",AUDIO=\"audio\"");
+        avio_printf(out, "\nmedia_%d.m3u8\n", i);
+    }
+    avio_flush(out);
+    return ff_async_writer_close(c->writer, s, &out, temp_filename, filename);
+}
+
 static int write_manifest(AVFormatContext *s, int final)
 {
     DASHContext *c = s->priv_data;
@@ -450,8 +674,9 @@ static int write_manifest(AVFormatContext *s, int final)
     int ret, i;
     AVDictionaryEntry *title = av_dict_get(s->metadata, "title", NULL, 0);
 
-    snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", s->filename);
-    ret = s->io_open(s, &out, temp_filename, AVIO_FLAG_WRITE, NULL);
+    if (snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", s->filename) >= sizeof(temp_filename))
+        return AVERROR(EINVAL);
+    ret = dash_io_open(s, &out, temp_filename);
     if (ret < 0) {
         av_log(s, AV_LOG_ERROR, "Unable to open %s for writing\n", temp_filename);
         return ret;
@@ -527,7 +752,7 @@ static int write_manifest(AVFormatContext *s, int final)
                 avio_printf(out, " frameRate=\"%d/%d\"", st->avg_frame_rate.num, st->avg_frame_rate.den);
             avio_printf(out, ">\n");
 
-            output_segment_list(&c->streams[i], out, c);
+            output_segment_list(&c->streams[i], out, c, final);
             avio_printf(out, "\t\t\t</Representation>\n");
         }
         avio_printf(out, "\t\t</AdaptationSet>\n");
@@ -543,7 +768,7 @@ static int write_manifest(AVFormatContext *s, int final)
 
             avio_printf(out, "\t\t\t<Representation id=\"%d\" mimeType=\"audio/mp4\" codecs=\"%s\"%s audioSamplingRate=\"%d\">\n", i, os->codec_str, os->bandwidth_str, st->codecpar->sample_rate);
             avio_printf(out, "\t\t\t\t<AudioChannelConfiguration schemeIdUri=\"urn:mpeg:dash:23003:3:audio_channel_configuration:2011\" value=\"%d\" />\n", st->codecpar->channels);
-            output_segment_list(&c->streams[i], out, c);
+            output_segment_list(&c->streams[i], out, c, final);
             avio_printf(out, "\t\t\t</Representation>\n");
         }
         avio_printf(out, "\t\t</AdaptationSet>\n");
@@ -551,8 +776,10 @@ static int write_manifest(AVFormatContext *s, int final)
     avio_printf(out, "\t</Period>\n");
     avio_printf(out, "</MPD>\n");
     avio_flush(out);
-    ff_format_io_close(s, &out);
-    return avpriv_io_move(temp_filename, s->filename);
+    ret = ff_async_writer_close(c->writer, s, &out, temp_filename, s->filename);
+    if (ret < 0 || !c->hls_playlist)
+        return ret;
+    return write_hls_playlists(s, final);
 }
 
 static int dash_init(AVFormatContext *s)
@@ -591,6 +818,16 @@ static int dash_init(AVFormatContext *s)
     if (!c->streams)
         return AVERROR(ENOMEM);
 
+//PLEX
+    if (c->async_write) {
+        ret = ff_async_writer_alloc(&c->writer, s);
+        if (ret == AVERROR(ENOSYS))
+            av_log(s, AV_LOG_WARNING, "Asynchronous writes not supported, writing synchronously\n");
+        else if (ret < 0)
+            return ret;
+    }
+//PLEX
+
     for (i = 0; i < s->nb_streams; i++) {
         OutputStream *os = &c->streams[i];
         AVFormatContext *ctx;
@@ -635,13 +872,14 @@ static int dash_init(AVFormatContext *s)
         if (c->single_file) {
             if (c->single_file_name)
                 dash_fill_tmpl_params(os->initfile, sizeof(os->initfile), c->single_file_name, i, 0, os->bit_rate, 0);
-            else
-                snprintf(os->initfile, sizeof(os->initfile), "%s-stream%d.m4s", basename, i);
+            else if (snprintf(os->initfile, sizeof(os->initfile), "%s-stream%d.m4s", basename, i) >= sizeof(os->initfile))
+                return AVERROR(EINVAL);
         } else {
             dash_fill_tmpl_params(os->initfile, sizeof(os->initfile), c->init_seg_name, i, 0, os->bit_rate, 0);
         }
-        snprintf(filename, sizeof(filename), "%s%s", c->dirname, os->initfile);
-        ret = s->io_open(s, &os->out, filename, AVIO_FLAG_WRITE, NULL);
+        if (snprintf(filename, sizeof(filename), "%s%s", c->dirname, os->initfile) >= sizeof(filename))
+            return AVERROR(EINVAL);
+        ret = dash_io_open(s, &os->out, filename);
         if (ret < 0)
             return ret;
         os->init_start_pos = 0;
@@ -652,6 +890,11 @@ static int dash_init(AVFormatContext *s)
         else
             av_dict_set(&opts, "movflags", "frag_custom+dash+delay_moov", 0);
 //PLEX
+        if (c->hls_playlist)
+            av_dict_set(&opts, "movflags", "+cmaf", AV_DICT_APPEND);
+        // Chunks are plain moof/mdat pairs, without a sidx for each of them.
+        if (c->frag_duration)
+            av_dict_set(&opts, "movflags", "-dash+cmaf", AV_DICT_APPEND);
 
         if ((ret = avformat_init_output(ctx, &opts)) < 0)
             return ret;
@@ -662,8 +905,9 @@ static int dash_init(AVFormatContext *s)
         av_log(s, AV_LOG_VERBOSE, "Representation %d init segment will be written to: %s\n", i, filename);
 
 //PLEX
-        if (c->skip_to_segment > 1)
-            av_opt_set_int(os->ctx, "fragments", c->skip_to_segment, AV_OPT_SEARCH_CHILDREN);
+        if (c->skip_to_segment > 1 &&
+            (ret = av_opt_set_int(os->ctx, "fragment_index", c->skip_to_segment, AV_OPT_SEARCH_CHILDREN)) < 0)
+            return ret;
 //PLEX
 
         s->streams[i]->time_base = st->time_base;
@@ -689,6 +933,7 @@ static int dash_init(AVFormatContext *s)
         set_codec_str(s, st->codecpar, os->codec_str, sizeof(os->codec_str));
         os->first_pts = AV_NOPTS_VALUE;
         os->max_pts = AV_NOPTS_VALUE;
+        os->head_pos = -1;
         os->last_dts = AV_NOPTS_VALUE;
         os->segment_index = c->skip_to_segment; //PLEX
     }
@@ -761,29 +1006,6 @@ static void write_styp(AVIOContext *pb)
     ffio_wfourcc(pb, "msix");
 }
 
-static void find_index_range(AVFormatContext *s, const char *full_path,
-                             int64_t pos, int *index_length)
-{
-    uint8_t buf[8];
-    AVIOContext *pb;
-    int ret;
-
-    ret = s->io_open(s, &pb, full_path, AVIO_FLAG_READ, NULL);
-    if (ret < 0)
-        return;
-    if (avio_seek(pb, pos, SEEK_SET) != pos) {
-        ff_format_io_close(s, &pb);
-        return;
-    }
-    ret = avio_read(pb, buf, 8);
-    ff_format_io_close(s, &pb);
-    if (ret < 8)
-        return;
-    if (AV_RL32(&buf[4]) != MKTAG('s', 'i', 'd', 'x'))
-        return;
-    *index_length = AV_RB32(&buf[0]);
-}
-
 static int update_stream_extradata(AVFormatContext *s, OutputStream *os,
                                    AVCodecParameters *par)
 {
@@ -807,6 +1029,68 @@ static int update_stream_extradata(AVFormatContext *s, OutputStream *os,
     return 0;
 }
 
+static int dash_start_segment(AVFormatContext *s, OutputStream *os, int i)
+{
+    DASHContext *c = s->priv_data;
+    char full_path[1024];
+    int ret;
+
+    if (!os->init_range_length) {
+        av_write_frame(os->ctx, NULL);
+        os->init_range_length = avio_tell(os->ctx->pb);
+        if (!c->single_file &&
+            (ret = ff_async_writer_close(c->writer, s, &os->out, NULL, NULL)) < 0)
+            return ret;
+    }
+
+    os->seg_start_pos = avio_tell(os->ctx->pb);
+    os->seg_started   = 1;
+
+    if (!c->single_file) {
+        dash_fill_tmpl_params(os->seg_file, sizeof(os->seg_file), c->media_seg_name, i, os->segment_index, os->bit_rate, os->start_pts);
+        // Chunked segments are written under their final name, so that the
+        // chunks can be read while the segment is still in progress.
+        if (snprintf(full_path, sizeof(full_path), "%s%s%s", c->dirname, os->seg_file,
+                     c->frag_duration ? "" : ".tmp") >= sizeof(full_path))
+            return AVERROR(EINVAL);
+        ret = dash_io_open(s, &os->out, full_path);
+        if (ret < 0)
+            return ret;
+        write_styp(os->ctx->pb);
+    }
+    return 0;
+}
+
+static int dash_flush_chunk(AVFormatContext *s, OutputStream *os, int i)
+{
+    int64_t start_pos;
+    Part *part;
+    int ret;
+
+    if (!os->seg_started && (ret = dash_start_segment(s, os, i)) < 0)
+        return ret;
+    // The first part includes the styp of the segment.
+    start_pos = os->nb_parts ? avio_tell(os->ctx->pb) : os->seg_start_pos;
+
+    av_write_frame(os->ctx, NULL);
+    avio_flush(os->ctx->pb);
+    avio_flush(os->out);
+
+    if ((ret = av_reallocp_array(&os->parts, os->nb_parts + 1, sizeof(*os->parts))) < 0) {
+        os->nb_parts = 0;
+        return ret;
+    }
+    part = &os->parts[os->nb_parts++];
+    part->start_pos    = start_pos;
+    part->range_length = avio_tell(os->ctx->pb) - start_pos;
+    part->duration     = os->max_pts - os->chunk_start_pts;
+    part->independent  = os->chunk_independent;
+
+    os->chunk_start_pts = os->max_pts;
+    os->chunk_packets   = 0;
+    return 0;
+}
+
 static int dash_flush(AVFormatContext *s, int final, int stream)
 {
     DASHContext *c = s->priv_data;
@@ -817,7 +1101,7 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
 
     for (i = 0; i < s->nb_streams; i++) {
         OutputStream *os = &c->streams[i];
-        char filename[1024] = "", full_path[1024], temp_path[1024];
+        char full_path[1024], temp_path[1024];
         int64_t start_pos;
         int range_length, index_length = 0;
 
@@ -836,41 +1120,50 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
                 continue;
         }
 
-        if (!os->init_range_length) {
-            av_write_frame(os->ctx, NULL);
-            os->init_range_length = avio_tell(os->ctx->pb);
-            if (!c->single_file)
-                ff_format_io_close(s, &os->out);
-        }
-
-        start_pos = avio_tell(os->ctx->pb);
-
-        if (!c->single_file) {
-            dash_fill_tmpl_params(filename, sizeof(filename), c->media_seg_name, i, os->segment_index, os->bit_rate, os->start_pts);
-            snprintf(full_path, sizeof(full_path), "%s%s", c->dirname, filename);
-            snprintf(temp_path, sizeof(temp_path), "%s.tmp", full_path);
-            ret = s->io_open(s, &os->out, temp_path, AVIO_FLAG_WRITE, NULL);
-            if (ret < 0)
+        if (c->frag_duration) {
+            if (os->chunk_packets && (ret = dash_flush_chunk(s, os, i)) < 0)
                 break;
-            write_styp(os->ctx->pb);
         } else {
-            snprintf(full_path, sizeof(full_path), "%s%s", c->dirname, os->initfile);
+            if ((ret = dash_start_segment(s, os, i)) < 0)
+                break;
+            os->head_pos = os->seg_start_pos;
+            os->head_len = 0;
+            av_write_frame(os->ctx, NULL);
+            avio_flush(os->ctx->pb);
+            os->head_pos = -1;
         }
-
-        av_write_frame(os->ctx, NULL);
-        avio_flush(os->ctx->pb);
         os->packets_written = 0;
+        os->seg_started = 0;
 
+        start_pos = os->seg_start_pos;
         range_length = avio_tell(os->ctx->pb) - start_pos;
         if (c->single_file) {
-            find_index_range(s, full_path, start_pos, &index_length);
+            if (snprintf(full_path, sizeof(full_path), "%s%s", c->dirname, os->initfile) >= sizeof(full_path)) {
+                ret = AVERROR(EINVAL);
+                break;
+            }
+            if (os->head_len == sizeof(os->head) &&
+                AV_RL32(&os->head[4]) == MKTAG('s', 'i', 'd', 'x'))
+                index_length = AV_RB32(&os->head[0]);
         } else {
-            ff_format_io_close(s, &os->out);
-            ret = avpriv_io_move(temp_path, full_path);
+            if (snprintf(full_path, sizeof(full_path), "%s%s", c->dirname, os->seg_file) >= sizeof(full_path) ||
+                snprintf(temp_path, sizeof(temp_path), "%s.tmp", full_path) >= sizeof(temp_path)) {
+                ret = AVERROR(EINVAL);
+                break;
+            }
+            ret = ff_async_writer_close(c->writer, s, &os->out,
+                                        c->frag_duration ? NULL : temp_path, full_path);
             if (ret < 0)
                 break;
         }
-        add_segment(os, filename, os->start_pts, os->max_pts - os->start_pts, start_pos, range_length, index_length);
+        add_segment(os, c->single_file ? "" : os->seg_file, os->start_pts, os->max_pts - os->start_pts, start_pos, range_length, index_length);
+        if (os->nb_parts && os->nb_segments) {
+            Segment *seg = os->segments[os->nb_segments - 1];
+            seg->parts    = os->parts;
+            seg->nb_parts = os->nb_parts;
+            os->parts     = NULL;
+            os->nb_parts  = 0;
+        }
         av_log(s, AV_LOG_VERBOSE, "Representation %d media segment %d written to: %s\n", i, os->segment_index, full_path);
     }
 
@@ -884,9 +1177,10 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
             if (remove > 0) {
                 for (j = 0; j < remove; j++) {
                     char filename[1024];
-                    snprintf(filename, sizeof(filename), "%s%s", c->dirname, os->segments[j]->file);
-                    unlink(filename);
-                    av_free(os->segments[j]);
+                    if (!c->single_file &&
+                        snprintf(filename, sizeof(filename), "%s%s", c->dirname, os->segments[j]->file) < sizeof(filename))
+                        ff_async_writer_move(c->writer, filename, NULL);
+                    free_segment(&os->segments[j]);
                 }
                 os->nb_segments -= remove;
                 memmove(os->segments, os->segments + remove, os->nb_segments * sizeof(*os->segments));
@@ -899,14 +1193,56 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
     return ret;
 }
 
+//PLEX
+// The caller seeked its input and continues at segment seek_restart: finish
+// the segments in progress and start over as a new process with
+// skip_to_segment would, keeping the files and the fMP4 contexts open.
+static int dash_seek_restart(AVFormatContext *s)
+{
+    DASHContext *c = s->priv_data;
+    int i, j, ret;
+
+    if ((ret = dash_flush(s, 0, -1)) < 0)
+        return ret;
+
+    c->skip_to_segment = FFMAX(c->seek_restart, 1);
+    c->seek_restart = -1;
+    for (i = 0; i < s->nb_streams; i++) {
+        OutputStream *os = &c->streams[i];
+
+        for (j = 0; j < os->nb_segments; j++)
+            free_segment(&os->segments[j]);
+        os->nb_segments = 0;
+        os->segment_index = c->skip_to_segment;
+        os->first_pts = AV_NOPTS_VALUE;
+        os->start_pts = AV_NOPTS_VALUE;
+        os->max_pts = AV_NOPTS_VALUE;
+        os->last_dts = AV_NOPTS_VALUE;
+
+        os->ctx->streams[0]->cur_dts = AV_NOPTS_VALUE;
+        if ((ret = av_opt_set_int(os->ctx, "fragment_index", c->skip_to_segment, AV_OPT_SEARCH_CHILDREN)) < 0 ||
+            (ret = av_opt_set(os->ctx, "movflags", "+frag_discont", AV_OPT_SEARCH_CHILDREN)) < 0)
+            return ret;
+    }
+    av_log(s, AV_LOG_VERBOSE, "Restarting at segment %d\n", c->skip_to_segment);
+    return 0;
+}
+//PLEX
+
 static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     DASHContext *c = s->priv_data;
     AVStream *st = s->streams[pkt->stream_index];
     OutputStream *os = &c->streams[pkt->stream_index];
-    int64_t seg_end_duration = (os->segment_index - c->skip_to_segment + 1) * (int64_t) c->min_seg_duration; //PLEX
+    int64_t seg_end_duration;
     int ret;
 
+//PLEX
+    if (c->seek_restart >= 0 && (ret = dash_seek_restart(s)) < 0)
+        return ret;
+    seg_end_duration = (os->segment_index - c->skip_to_segment + 1) * (int64_t) c->min_seg_duration;
+//PLEX
+
     ret = update_stream_extradata(s, os, st->codecpar);
     if (ret < 0)
         return ret;
@@ -967,17 +1303,36 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
         else
             os->start_pts = pkt->pts;
     }
+
+    // Cut before the chunk would grow past the advertised part target.
+    if (c->frag_duration && os->chunk_packets &&
+        av_compare_ts(pkt->pts + pkt->duration - os->chunk_start_pts, st->time_base,
+                      c->frag_duration, AV_TIME_BASE_Q) > 0) {
+        if ((ret = dash_flush_chunk(s, os, pkt->stream_index)) < 0)
+            return ret;
+        if (c->hls_playlist &&
+            (ret = write_hls_media_playlist(s, pkt->stream_index, 0)) < 0)
+            return ret;
+    }
+    if (!os->chunk_packets) {
+        if (!os->packets_written)
+            os->chunk_start_pts = os->start_pts;
+        os->chunk_independent = !!(pkt->flags & AV_PKT_FLAG_KEY);
+    }
+
     if (os->max_pts == AV_NOPTS_VALUE)
         os->max_pts = pkt->pts + pkt->duration;
     else
         os->max_pts = FFMAX(os->max_pts, pkt->pts + pkt->duration);
     os->packets_written++;
+    os->chunk_packets++;
     return ff_write_chained(os->ctx, 0, pkt, s, 0);
 }
 
 static int dash_write_trailer(AVFormatContext *s)
 {
     DASHContext *c = s->priv_data;
+    int i;
 
     if (s->nb_streams > 0) {
         OutputStream *os = &c->streams[0];
@@ -993,18 +1348,32 @@ static int dash_write_trailer(AVFormatContext *s)
     }
     dash_flush(s, 1, -1);
 
+    for (i = 0; i < s->nb_streams; i++) {
+        OutputStream *os = &c->streams[i];
+        if (os->ctx_inited) {
+            av_write_trailer(os->ctx);
+            os->ctx_inited = 0;
+        }
+        ff_async_writer_close(c->writer, s, &os->out, NULL, NULL);
+    }
+
     if (c->remove_at_exit) {
         char filename[1024];
-        int i;
         for (i = 0; i < s->nb_streams; i++) {
             OutputStream *os = &c->streams[i];
-            snprintf(filename, sizeof(filename), "%s%s", c->dirname, os->initfile);
-            unlink(filename);
+            if (snprintf(filename, sizeof(filename), "%s%s", c->dirname, os->initfile) < sizeof(filename))
+                ff_async_writer_move(c->writer, filename, NULL);
+            if (c->hls_playlist &&
+                get_hls_playlist_name(filename, sizeof(filename), c->dirname, i) >= 0)
+                ff_async_writer_move(c->writer, filename, NULL);
         }
-        unlink(s->filename);
+        if (c->hls_playlist &&
+            get_hls_playlist_name(filename, sizeof(filename), c->dirname, -1) >= 0)
+            ff_async_writer_move(c->writer, filename, NULL);
+        ff_async_writer_move(c->writer, s->filename, NULL);
     }
 
-    return 0;
+    return ff_async_writer_free(&c->writer);
 }
 
 static int dash_check_bitstream(struct AVFormatContext *s, const AVPacket *avpkt)
@@ -1044,8 +1413,12 @@ static const AVOption options[] = {
     { "single_file_name", "DASH-templated name to be used for baseURL. Implies storing all segments in one file, accessed using byte ranges", OFFSET(single_file_name), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
     { "init_seg_name", "DASH-templated name to used for the initialization segment", OFFSET(init_seg_name), AV_OPT_TYPE_STRING, {.str = "init-stream$RepresentationID$.m4s"}, 0, 0, E },
     { "media_seg_name", "DASH-templated name to used for the media segments", OFFSET(media_seg_name), AV_OPT_TYPE_STRING, {.str = "chunk-stream$RepresentationID$-$Number%05d$.m4s"}, 0, 0, E },
+    { "frag_duration", "write the segments in chunks of this duration, which are made available before the segment is complete", OFFSET(frag_duration), AV_OPT_TYPE_DURATION, { .i64 = 0 }, 0, INT64_MAX, E },
+    { "hls_playlist", "Also write HLS playlists for the CMAF segments, using byte ranges with single_file", OFFSET(hls_playlist), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
 //PLEX
     { "skip_to_segment", "first segment number to actually write", OFFSET(skip_to_segment), AV_OPT_TYPE_INT, { .i64 = 1 }, 1, INT_MAX, E },
+    { "async_write", "do the file writes in a separate thread", OFFSET(async_write), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
+    { "seek_restart", "continue at this segment number with the next packet, after the input was seeked", OFFSET(seek_restart), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, INT_MAX, E },
 //PLEX
     { NULL },
 };
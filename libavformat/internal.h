@@ -70,6 +70,23 @@ struct AVFormatInternal {
      */
     int nb_interleaved_streams;
 
+    /**
+     * Number of streams which do not hold back the max_interleave_delta
+     * check while they have no packet queued: attachments, VP8 and VP9.
+     * Muxing only.
+     */
+    int nb_sparse_streams;
+
+    /**
+     * Number of streams with packets queued for interleaving, and how many
+     * of them are sparse. Updated by ff_interleave_add_packet() and
+     * ff_interleave_packet_per_dts(), so that the latter does not need to
+     * scan the streams for every packet.
+     * Muxing only.
+     */
+    int nb_queued_streams;
+    int nb_queued_sparse_streams;
+
     /**
      * This buffer is only needed when packets were already buffered but
      * not decoded, for example to get the codec parameters in MPEG
@@ -140,6 +157,26 @@ struct AVFormatInternal {
      * Whether or not avformat_init_output fully initialized streams
      */
     int streams_initialized;
+
+    /**
+     * Muxing only: set when the default dts interleaver keeps its packets
+     * in per-stream queues merged through interleave_heap instead of the
+     * sorted packet_buffer list.
+     */
+    int use_interleave_heap;
+
+    /**
+     * Min-heap of the streams with queued packets, ordered by the first
+     * packet of each stream.
+     */
+    struct AVStream **interleave_heap;
+    int nb_interleave_heap;
+    int interleave_heap_size;
+
+    /**
+     * Unused AVPacketList nodes kept for reuse by the interleaver.
+     */
+    struct AVPacketList *interleave_pool;
 };
 
 struct AVStreamInternal {
@@ -177,6 +214,12 @@ struct AVStreamInternal {
      * Whether the internal avctx needs to be updated from codecpar (after a late change to codecpar)
      */
     int need_context_update;
+
+    /**
+     * First packet queued for this stream by the heap interleaver, the
+     * last one is AVStream.last_in_packet_buffer.
+     */
+    struct AVPacketList *interleave_head;
 };
 
 #ifdef __GNUC__
@@ -447,6 +490,12 @@ int ff_read_packet(AVFormatContext *s, AVPacket *pkt);
 int ff_interleave_packet_per_dts(AVFormatContext *s, AVPacket *out,
                                  AVPacket *pkt, int flush);
 
+/**
+ * Free the packets still queued by the muxing interleaver and its
+ * internal allocations.
+ */
+void ff_interleave_free(AVFormatContext *s);
+
 void ff_free_stream(AVFormatContext *s, AVStream *st);
 
 /**
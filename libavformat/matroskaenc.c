@@ -146,6 +146,10 @@ typedef struct MatroskaMuxContext {
     int cluster_size_limit;
     int64_t cues_pos;
     int64_t cluster_time_limit;
+    int64_t cues_interval;
+    int64_t cues_written_pts;           ///< cluster pts at which the index was last rewritten
+    int64_t cues_spacing;               ///< minimum pts distance between CuePoints in the reserved index
+    int cues_in_seekhead;
     int is_dash;
     int dash_track_number;
     int is_live;
@@ -447,15 +451,18 @@ static int mkv_add_seekhead_entry(mkv_seekhead *seekhead, unsigned int elementid
 }
 
 /**
- * Write the seek head to the file and free it. If a maximum number of
+ * Write the seek head to the file. If a maximum number of
  * elements was specified to mkv_start_seekhead(), the seek head will
  * be written at the location reserved for it. Otherwise, it is written
  * at the current location in the file.
  *
+ * @param partial leave out the Info and Tags elements, which are only written
+ *                by the trailer of seekable output
+ *
  * @return The file offset where the seekhead was written,
  * -1 if an error occurred.
  */
-static int64_t mkv_write_seekhead(AVIOContext *pb, MatroskaMuxContext *mkv)
+static int64_t mkv_write_seekhead(AVIOContext *pb, MatroskaMuxContext *mkv, int partial)
 {
     AVIOContext *dyn_cp;
     mkv_seekhead *seekhead = mkv->main_seekhead;
@@ -466,21 +473,21 @@ static int64_t mkv_write_seekhead(AVIOContext *pb, MatroskaMuxContext *mkv)
     currentpos = avio_tell(pb);
 
     if (seekhead->reserved_size > 0) {
-        if (avio_seek(pb, seekhead->filepos, SEEK_SET) < 0) {
-            currentpos = -1;
-            goto fail;
-        }
+        if (avio_seek(pb, seekhead->filepos, SEEK_SET) < 0)
+            return -1;
     }
 
     if (start_ebml_master_crc32(pb, &dyn_cp, mkv, &metaseek, MATROSKA_ID_SEEKHEAD,
-                                seekhead->reserved_size) < 0) {
-        currentpos = -1;
-        goto fail;
-    }
+                                seekhead->reserved_size) < 0)
+        return -1;
 
     for (i = 0; i < seekhead->num_entries; i++) {
         mkv_seekhead_entry *entry = &seekhead->entries[i];
 
+        if (partial && (entry->elementid == MATROSKA_ID_INFO ||
+                        entry->elementid == MATROSKA_ID_TAGS))
+            continue;
+
         seekentry = start_ebml_master(dyn_cp, MATROSKA_ID_SEEKENTRY, MAX_SEEKENTRY_SIZE);
 
         put_ebml_id(dyn_cp, MATROSKA_ID_SEEKID);
@@ -499,9 +506,6 @@ static int64_t mkv_write_seekhead(AVIOContext *pb, MatroskaMuxContext *mkv)
 
         currentpos = seekhead->filepos;
     }
-fail:
-    av_freep(&mkv->main_seekhead->entries);
-    av_freep(&mkv->main_seekhead);
 
     return currentpos;
 }
@@ -539,10 +543,11 @@ static int mkv_add_cuepoint(mkv_cues *cues, int stream, int tracknum, int64_t ts
     return 0;
 }
 
-static int64_t mkv_write_cues(AVFormatContext *s, mkv_cues *cues, mkv_track *tracks, int num_tracks)
+static int64_t mkv_write_cues(AVFormatContext *s, AVIOContext *pb, mkv_cues *cues,
+                              mkv_track *tracks, int num_tracks)
 {
     MatroskaMuxContext *mkv = s->priv_data;
-    AVIOContext *dyn_cp, *pb = s->pb;
+    AVIOContext *dyn_cp;
     ebml_master cues_element;
     int64_t currentpos;
     int i, j, ret;
@@ -599,6 +604,84 @@ static int64_t mkv_write_cues(AVFormatContext *s, mkv_cues *cues, mkv_track *tra
     return currentpos;
 }
 
+/**
+ * Drop the CuePoints closer than spacing to the previous one kept, keeping
+ * the first one. Thinning again to the same spacing changes nothing, so
+ * only the CuePoints added since are affected.
+ */
+static void mkv_thin_cues(mkv_cues *cues, int64_t spacing)
+{
+    int64_t last = 0;
+    int i, j;
+
+    if (!spacing)
+        return;
+
+    for (i = j = 0; i < cues->num_entries; i++) {
+        int64_t pts = cues->entries[i].pts;
+        if (j && pts != last && pts - last < spacing)
+            continue;
+        last = pts;
+        cues->entries[j++] = cues->entries[i];
+    }
+    cues->num_entries = j;
+}
+
+/**
+ * Write the cues gathered so far to the space reserved for them, thinning
+ * them out first if they do not fit.
+ */
+static int mkv_write_reserved_cues(AVFormatContext *s)
+{
+    MatroskaMuxContext *mkv = s->priv_data;
+    AVIOContext *dyn_cp, *pb = s->pb;
+    int64_t currentpos = avio_tell(pb);
+    uint8_t *buf;
+    int size, ret;
+
+    mkv_thin_cues(mkv->cues, mkv->cues_spacing);
+    for (;;) {
+        int64_t span;
+
+        if ((ret = avio_open_dyn_buf(&dyn_cp)) < 0)
+            return ret;
+        mkv_write_cues(s, dyn_cp, mkv->cues, mkv->tracks, s->nb_streams);
+        size = avio_close_dyn_buf(dyn_cp, &buf);
+        // what is left has to fit an EBML void element
+        if (size == mkv->reserve_cues_space || size + 2 <= mkv->reserve_cues_space)
+            break;
+        av_free(buf);
+        span = mkv->cues->entries[mkv->cues->num_entries - 1].pts -
+               mkv->cues->entries[0].pts;
+        if (mkv->cues->num_entries <= 1 || mkv->cues_spacing > span) {
+            av_log(s, AV_LOG_ERROR, "Insufficient space reserved for cues: %d "
+                   "(needed: %d).\n", mkv->reserve_cues_space, size);
+            return AVERROR(EINVAL);
+        }
+        // start at about half the CuePoints, then double the spacing
+        mkv->cues_spacing = mkv->cues_spacing ? 2 * mkv->cues_spacing :
+                            FFMAX(2 * span / mkv->cues->num_entries, 1);
+        av_log(s, AV_LOG_VERBOSE, "Thinning the cues to one per %"PRId64" ms\n",
+               mkv->cues_spacing);
+        mkv_thin_cues(mkv->cues, mkv->cues_spacing);
+    }
+
+    avio_seek(pb, mkv->cues_pos, SEEK_SET);
+    avio_write(pb, buf, size);
+    if (size < mkv->reserve_cues_space)
+        put_ebml_void(pb, mkv->reserve_cues_space - size);
+    av_free(buf);
+    avio_seek(pb, currentpos, SEEK_SET);
+
+    if (!mkv->cues_in_seekhead) {
+        ret = mkv_add_seekhead_entry(mkv->main_seekhead, MATROSKA_ID_CUES, mkv->cues_pos);
+        if (ret < 0)
+            return ret;
+        mkv->cues_in_seekhead = 1;
+    }
+    return 0;
+}
+
 static int put_xiph_codecpriv(AVFormatContext *s, AVIOContext *pb, AVCodecParameters *par)
 {
     const uint8_t *header_start[3];
@@ -1819,13 +1902,26 @@ static int mkv_write_header(AVFormatContext *s)
     }
 
     if (!s->pb->seekable && !mkv->is_live)
-        mkv_write_seekhead(pb, mkv);
+        mkv_write_seekhead(pb, mkv, 0);
 
     mkv->cues = mkv_start_cues(mkv->segment_offset);
     if (!mkv->cues) {
         ret = AVERROR(ENOMEM);
         goto fail;
     }
+    if (pb->seekable && mkv->cues_interval && !mkv->reserve_cues_space) {
+        // one CuePoint for each cluster of the expected duration, of which
+        // the size is overestimated enough for keyframes in between
+        int64_t duration = s->duration > 0 ? s->duration : get_metadata_duration(s);
+        int64_t cluster_time = mkv->cluster_time_limit > 0 ? mkv->cluster_time_limit : 5000;
+        int64_t clusters;
+
+        if (duration <= 0)
+            duration = 4 * 3600 * (int64_t)AV_TIME_BASE;
+        clusters = av_rescale(duration, 1000, AV_TIME_BASE) / cluster_time + 1;
+        mkv->reserve_cues_space = FFMIN(clusters * (MAX_CUEPOINT_SIZE(1)) + 16, INT_MAX);
+        av_log(s, AV_LOG_VERBOSE, "Reserving %d bytes for the cues\n", mkv->reserve_cues_space);
+    }
     if (pb->seekable && mkv->reserve_cues_space) {
         mkv->cues_pos = avio_tell(pb);
         put_ebml_void(pb, mkv->reserve_cues_space);
@@ -2058,9 +2154,10 @@ static int mkv_write_vtt_blocks(AVFormatContext *s, AVIOContext *pb, AVPacket *p
     return pkt->duration;
 }
 
-static void mkv_start_new_cluster(AVFormatContext *s, AVPacket *pkt)
+static int mkv_start_new_cluster(AVFormatContext *s, AVPacket *pkt)
 {
     MatroskaMuxContext *mkv = s->priv_data;
+    int ret;
 
     end_ebml_master_crc32(s->pb, &mkv->dyn_bc, mkv, mkv->cluster);
     mkv->cluster_pos = -1;
@@ -2073,7 +2170,19 @@ static void mkv_start_new_cluster(AVFormatContext *s, AVPacket *pkt)
         av_log(s, AV_LOG_DEBUG, "Starting new cluster, "
                "pts %" PRIu64 "dts %" PRIu64 "\n",
                pkt->pts, pkt->dts);
+
+    // keep the file seekable while it grows
+    if (s->pb->seekable && !mkv->is_live && mkv->cues_interval &&
+        mkv->reserve_cues_space && mkv->cues->num_entries &&
+        mkv->cluster_pts - mkv->cues_written_pts >= mkv->cues_interval) {
+        if ((ret = mkv_write_reserved_cues(s)) < 0)
+            return ret;
+        if (mkv_write_seekhead(s->pb, mkv, 1) < 0)
+            return AVERROR(EIO);
+        mkv->cues_written_pts = mkv->cluster_pts;
+    }
     avio_flush(s->pb);
+    return 0;
 }
 
 static int mkv_write_packet_internal(AVFormatContext *s, AVPacket *pkt, int add_cue)
@@ -2206,7 +2315,8 @@ static int mkv_write_packet(AVFormatContext *s, AVPacket *pkt)
     }
 
     if (mkv->cluster_pos != -1 && start_new_cluster) {
-        mkv_start_new_cluster(s, pkt);
+        if ((ret = mkv_start_new_cluster(s, pkt)) < 0)
+            return ret;
     }
 
     if (!mkv->cluster_pos)
@@ -2287,13 +2397,17 @@ static int mkv_write_trailer(AVFormatContext *s)
 
     if (pb->seekable && !mkv->is_live) {
         if (mkv->cues->num_entries) {
-            if (mkv->reserve_cues_space) {
+            if (mkv->reserve_cues_space && mkv->cues_interval) {
+                if ((ret = mkv_write_reserved_cues(s)) < 0)
+                    return ret;
+                cuespos = mkv->cues_pos;
+            } else if (mkv->reserve_cues_space) {
                 int64_t cues_end;
 
                 currentpos = avio_tell(pb);
                 avio_seek(pb, mkv->cues_pos, SEEK_SET);
 
-                cuespos  = mkv_write_cues(s, mkv->cues, mkv->tracks, s->nb_streams);
+                cuespos  = mkv_write_cues(s, pb, mkv->cues, mkv->tracks, s->nb_streams);
                 cues_end = avio_tell(pb);
                 if (cues_end > cuespos + mkv->reserve_cues_space) {
                     av_log(s, AV_LOG_ERROR,
@@ -2309,16 +2423,18 @@ static int mkv_write_trailer(AVFormatContext *s)
 
                 avio_seek(pb, currentpos, SEEK_SET);
             } else {
-                cuespos = mkv_write_cues(s, mkv->cues, mkv->tracks, s->nb_streams);
+                cuespos = mkv_write_cues(s, pb, mkv->cues, mkv->tracks, s->nb_streams);
             }
 
-            ret = mkv_add_seekhead_entry(mkv->main_seekhead, MATROSKA_ID_CUES,
-                                         cuespos);
-            if (ret < 0)
-                return ret;
+            if (!mkv->cues_in_seekhead) {
+                ret = mkv_add_seekhead_entry(mkv->main_seekhead, MATROSKA_ID_CUES,
+                                             cuespos);
+                if (ret < 0)
+                    return ret;
+            }
         }
 
-        mkv_write_seekhead(pb, mkv);
+        mkv_write_seekhead(pb, mkv, 0);
 
         // update the duration
         av_log(s, AV_LOG_DEBUG, "end duration = %" PRIu64 "\n", mkv->duration);
@@ -2455,6 +2571,7 @@ static const AVOption options[] = {
     { "reserve_index_space", "Reserve a given amount of space (in bytes) at the beginning of the file for the index (cues).", OFFSET(reserve_cues_space), AV_OPT_TYPE_INT,   { .i64 = 0 },   0, INT_MAX,   FLAGS },
     { "cluster_size_limit",  "Store at most the provided amount of bytes in a cluster. ",                                     OFFSET(cluster_size_limit), AV_OPT_TYPE_INT  , { .i64 = -1 }, -1, INT_MAX,   FLAGS },
     { "cluster_time_limit",  "Store at most the provided number of milliseconds in a cluster.",                               OFFSET(cluster_time_limit), AV_OPT_TYPE_INT64, { .i64 = -1 }, -1, INT64_MAX, FLAGS },
+    { "cues_interval",       "Rewrite the index in its reserved space every given number of milliseconds, sizing it from the expected duration if not set.", OFFSET(cues_interval), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, FLAGS },
     { "dash", "Create a WebM file conforming to WebM DASH specification", OFFSET(is_dash), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, FLAGS },
     { "dash_track_number", "Track number for the DASH stream", OFFSET(dash_track_number), AV_OPT_TYPE_INT, { .i64 = 1 }, 0, 127, FLAGS },
     { "live", "Write files assuming it is a live stream.", OFFSET(is_live), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, FLAGS },
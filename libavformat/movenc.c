@@ -52,10 +52,16 @@
 #include "mov_chan.h"
 #include "vpcc.h"
 
+#if HAVE_LINUX_FS_H
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
 static const AVOption options[] = {
     { "movflags", "MOV muxer flags", offsetof(MOVMuxContext, flags), AV_OPT_TYPE_FLAGS, {.i64 = 0}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "rtphint", "Add RTP hint tracks", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_RTP_HINT}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "moov_size", "maximum moov size so it can be placed at the begin", offsetof(MOVMuxContext, reserved_moov_size), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, 0 },
+    { "faststart_duration", "Expected output duration, used to reserve room for the moov atom with faststart", offsetof(MOVMuxContext, faststart_duration), AV_OPT_TYPE_DURATION, {.i64 = 0}, 0, INT64_MAX, AV_OPT_FLAG_ENCODING_PARAM, 0 },
     { "empty_moov", "Make the initial moov atom empty", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_EMPTY_MOOV}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "frag_keyframe", "Fragment at video keyframes", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FRAG_KEYFRAME}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "separate_moof", "Write separate moof/mdat atoms for each track", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_SEPARATE_MOOF}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
@@ -72,6 +78,7 @@ static const AVOption options[] = {
     { "write_colr", "Write colr atom (Experimental, may be renamed or changed, do not use from scripts)", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_WRITE_COLR}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "write_gama", "Write deprecated gama atom", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_WRITE_GAMA}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "use_metadata_tags", "Use mdta atom for metadata.", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_USE_MDTA}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
+    { "cmaf", "Write CMAF compatible fragmented MP4", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_CMAF}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     FF_RTP_FLAG_OPTS(MOVMuxContext, rtp_flags),
     { "skip_iods", "Skip writing iods atom.", offsetof(MOVMuxContext, iods_skip), AV_OPT_TYPE_BOOL, {.i64 = 1}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
     { "iods_audio_profile", "iods audio profile atom.", offsetof(MOVMuxContext, iods_audio_profile), AV_OPT_TYPE_INT, {.i64 = -1}, -1, 255, AV_OPT_FLAG_ENCODING_PARAM},
@@ -4261,6 +4268,9 @@ static int mov_write_ftyp_tag(AVIOContext *pb, AVFormatContext *s)
     if (mov->flags & FF_MOV_FLAG_DASH && mov->flags & FF_MOV_FLAG_GLOBAL_SIDX)
         ffio_wfourcc(pb, "dash");
 
+    if (mov->flags & FF_MOV_FLAG_CMAF)
+        ffio_wfourcc(pb, "cmfc");
+
     return update_size(pb, pos);
 }
 
@@ -5001,11 +5011,10 @@ static int mov_write_single_packet(AVFormatContext *s, AVPacket *pkt)
         AVCodecParameters *par = trk->par;
         int64_t frag_duration = 0;
         int size = pkt->size;
+        int ret;
 
-        int ret = check_pkt(s, pkt);
-        if (ret < 0)
-            return ret;
-
+        /* Mark the tracks before checking the packet, so that a
+         * discontinuity may also go back in time. */
         if (mov->flags & FF_MOV_FLAG_FRAG_DISCONT) {
             int i;
             for (i = 0; i < s->nb_streams; i++)
@@ -5013,6 +5022,10 @@ static int mov_write_single_packet(AVFormatContext *s, AVPacket *pkt)
             mov->flags &= ~FF_MOV_FLAG_FRAG_DISCONT;
         }
 
+        ret = check_pkt(s, pkt);
+        if (ret < 0)
+            return ret;
+
         if (!pkt->size) {
             if (trk->start_dts == AV_NOPTS_VALUE && trk->frag_discont) {
                 trk->start_dts = pkt->dts;
@@ -5498,7 +5511,7 @@ static int mov_init(AVFormatContext *s)
     if (mov->mode == MODE_ISM)
         mov->flags |= FF_MOV_FLAG_EMPTY_MOOV | FF_MOV_FLAG_SEPARATE_MOOF |
                       FF_MOV_FLAG_FRAGMENT;
-    if (mov->flags & FF_MOV_FLAG_DASH)
+    if (mov->flags & (FF_MOV_FLAG_DASH | FF_MOV_FLAG_CMAF))
         mov->flags |= FF_MOV_FLAG_FRAGMENT | FF_MOV_FLAG_EMPTY_MOOV |
                       FF_MOV_FLAG_DEFAULT_BASE_MOOF;
 
@@ -5776,6 +5789,101 @@ static int mov_init(AVFormatContext *s)
     return 0;
 }
 
+#define MOV_FASTSTART_ALIGN 4096
+
+static int64_t estimate_nb_samples(AVStream *st, int64_t duration)
+{
+    AVCodecParameters *par = st->codecpar;
+    AVRational rate = { 1, 1 };
+
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+        rate = st->avg_frame_rate.num > 0 ? st->avg_frame_rate : st->r_frame_rate;
+        if (rate.num <= 0 || rate.den <= 0)
+            rate = (AVRational){ 60, 1 };
+    } else if (par->codec_type == AVMEDIA_TYPE_AUDIO && par->sample_rate > 0) {
+        rate = (AVRational){ par->sample_rate, par->frame_size > 0 ? par->frame_size : 1024 };
+    }
+    return av_rescale(duration, rate.num, (int64_t)rate.den * AV_TIME_BASE) + 1;
+}
+
+/**
+ * Estimate the moov size from the expected duration, so that the moov can be
+ * written in place with faststart. The sample tables are sized for the chunks
+ * the dts interleaving produces, and for a table entry per sample only where
+ * the durations or the chunk lengths are expected to vary.
+ *
+ * @return the estimate, or 0 if no duration was given
+ */
+static int64_t estimate_moov_size(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int64_t duration = mov->faststart_duration;
+    int64_t size = 4096, bit_rate = 0;
+    AVDictionaryEntry *t = NULL;
+    int i, j, offset_size;
+
+    if (!duration)
+        return 0;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVCodecParameters *par = s->streams[i]->codecpar;
+        bit_rate += par->bit_rate;
+        size     += 1024 + par->extradata_size;
+    }
+    if (s->bit_rate > 0)
+        bit_rate = s->bit_rate;
+    offset_size = !bit_rate || av_rescale(duration, bit_rate, 8LL * AV_TIME_BASE) > UINT32_MAX / 2 ? 8 : 4;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        AVCodecParameters *par = st->codecpar;
+        const AVCodecDescriptor *desc = avcodec_descriptor_get(par->codec_id);
+        int64_t nb_samples = estimate_nb_samples(st, duration);
+        int64_t nb_chunks = 1;
+        int constant_duration = 0;
+
+        /* a chunk ends where samples of the other tracks are interleaved,
+         * which happens about as often as the most frequent of them comes */
+        for (j = 0; j < s->nb_streams; j++)
+            if (j != i)
+                nb_chunks = FFMAX(nb_chunks, estimate_nb_samples(s->streams[j], duration));
+        if (par->bit_rate > 0)
+            nb_chunks = FFMAX(nb_chunks, av_rescale(duration, par->bit_rate, 8LL * AV_TIME_BASE << 20) + 1);
+        nb_chunks = FFMIN(nb_chunks, nb_samples);
+
+        /* stsz and the chunk offsets, an stsc entry for each chunk if the
+         * number of samples in them varies */
+        size += nb_samples * 4 + nb_chunks * offset_size;
+        if (nb_chunks < nb_samples)
+            size += nb_chunks * 12;
+
+        /* stts: constant sample durations only take a few entries, which
+         * needs a whole number of track time units per sample */
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+            AVRational rate = st->avg_frame_rate.num > 0 ? st->avg_frame_rate : st->r_frame_rate;
+            if (rate.num > 0 && rate.den > 0 &&
+                !((int64_t)mov->tracks[i].timescale * rate.den % rate.num))
+                constant_duration = 1;
+        } else if (par->codec_type == AVMEDIA_TYPE_AUDIO && par->frame_size > 0) {
+            constant_duration = 1;
+        }
+        size += constant_duration ? nb_samples / 2 + 8 : nb_samples * 8;
+
+        /* ctts and stss */
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO &&
+            (!desc || !(desc->props & AV_CODEC_PROP_INTRA_ONLY)))
+            size += nb_samples * 8 + nb_samples / 2;
+    }
+
+    while ((t = av_dict_get(s->metadata, "", t, AV_DICT_IGNORE_SUFFIX)))
+        size += strlen(t->key) + strlen(t->value) + 32;
+    size += s->nb_chapters * 1024;
+    if (mov->flags & FF_MOV_FLAG_RTP_HINT)
+        size *= 2;
+
+    return size + size / 8;
+}
+
 static int mov_write_header(AVFormatContext *s)
 {
     AVIOContext *pb = s->pb;
@@ -5858,8 +5966,21 @@ static int mov_write_header(AVFormatContext *s)
             !mov->max_fragment_duration && !mov->max_fragment_size)
             mov->flags |= FF_MOV_FLAG_FRAG_KEYFRAME;
     } else {
-        if (mov->flags & FF_MOV_FLAG_FASTSTART)
+        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+            int64_t estimate = estimate_moov_size(s);
             mov->reserved_header_pos = avio_tell(pb);
+            if (estimate > 0 && estimate < INT_MAX / 2) {
+                /* Keep the media data block aligned, so that it can be
+                 * cloned if the moov turns out not to fit. */
+                mov->faststart_reserve = FFALIGN(mov->reserved_header_pos + estimate,
+                                                 MOV_FASTSTART_ALIGN) - mov->reserved_header_pos;
+                av_log(s, AV_LOG_VERBOSE, "Reserving %d bytes for the moov atom\n",
+                       mov->faststart_reserve);
+                avio_wb32(pb, mov->faststart_reserve);
+                ffio_wfourcc(pb, "free");
+                ffio_fill(pb, 0, mov->faststart_reserve - 8);
+            }
+        }
         mov_write_mdat_tag(pb, mov);
     }
 
@@ -5994,28 +6115,23 @@ static int compute_sidx_size(AVFormatContext *s)
     return sidx_size;
 }
 
-static int shift_data(AVFormatContext *s)
+/*
+ * Move the data in [start, end) of the output forward by shift bytes.
+ */
+static int shift_data_range(AVFormatContext *s, int64_t start, int64_t end, int shift)
 {
-    int ret = 0, moov_size;
-    MOVMuxContext *mov = s->priv_data;
-    int64_t pos, pos_end = avio_tell(s->pb);
+    int ret = 0;
+    int64_t pos, read_pos;
     uint8_t *buf, *read_buf[2];
     int read_buf_id = 0;
     int read_size[2];
     AVIOContext *read_pb;
 
-    if (mov->flags & FF_MOV_FLAG_FRAGMENT)
-        moov_size = compute_sidx_size(s);
-    else
-        moov_size = compute_moov_size(s);
-    if (moov_size < 0)
-        return moov_size;
-
-    buf = av_malloc(moov_size * 2);
+    buf = av_malloc(shift * 2);
     if (!buf)
         return AVERROR(ENOMEM);
     read_buf[0] = buf;
-    read_buf[1] = buf + moov_size;
+    read_buf[1] = buf + shift;
 
     /* Shift the data: the AVIO context of the output can only be used for
      * writing, so we re-open the same output, but for reading. It also avoids
@@ -6028,21 +6144,21 @@ static int shift_data(AVFormatContext *s)
         goto end;
     }
 
-    /* mark the end of the shift to up to the last data we wrote, and get ready
-     * for writing */
-    pos_end = avio_tell(s->pb);
-    avio_seek(s->pb, mov->reserved_header_pos + moov_size, SEEK_SET);
+    /* get ready for writing at the destination of the shift */
+    avio_seek(s->pb, start + shift, SEEK_SET);
 
     /* start reading at where the new moov will be placed */
-    avio_seek(read_pb, mov->reserved_header_pos, SEEK_SET);
-    pos = avio_tell(read_pb);
+    avio_seek(read_pb, start, SEEK_SET);
+    pos = read_pos = avio_tell(read_pb);
 
 #define READ_BLOCK do {                                                             \
-    read_size[read_buf_id] = avio_read(read_pb, read_buf[read_buf_id], moov_size);  \
+    read_size[read_buf_id] = avio_read(read_pb, read_buf[read_buf_id],              \
+                                       FFMIN(shift, end - read_pos));               \
+    read_pos += FFMAX(read_size[read_buf_id], 0);                                   \
     read_buf_id ^= 1;                                                               \
 } while (0)
 
-    /* shift data by chunk of at most moov_size */
+    /* shift data by chunk of at most shift bytes */
     READ_BLOCK;
     do {
         int n;
@@ -6052,7 +6168,7 @@ static int shift_data(AVFormatContext *s)
             break;
         avio_write(s->pb, read_buf[read_buf_id], n);
         pos += n;
-    } while (pos < pos_end);
+    } while (pos < end);
     ff_format_io_close(s, &read_pb);
 
 end:
@@ -6060,6 +6176,122 @@ end:
     return ret;
 }
 
+static int shift_data(AVFormatContext *s)
+{
+    int moov_size;
+    MOVMuxContext *mov = s->priv_data;
+
+    if (mov->flags & FF_MOV_FLAG_FRAGMENT)
+        moov_size = compute_sidx_size(s);
+    else
+        moov_size = compute_moov_size(s);
+    if (moov_size < 0)
+        return moov_size;
+
+    /* mark the end of the shift to up to the last data we wrote */
+    avio_flush(s->pb);
+    return shift_data_range(s, mov->reserved_header_pos, avio_tell(s->pb), moov_size);
+}
+
+/*
+ * Move the data in [start, *end) forward by shift bytes by cloning the file
+ * blocks, on filesystems supporting reflinks. The data is cloned from the end
+ * in pieces of shift bytes, so that source and destination never overlap;
+ * *end is updated to the part that still remains to be moved.
+ */
+static int clone_data_range(AVFormatContext *s, int64_t start, int64_t *end, int shift)
+{
+#if HAVE_LINUX_FS_H && defined(FICLONERANGE)
+    URLContext *h = ffio_geturlcontext(s->pb);
+    AVIOContext *read_pb;
+    int ret, fd, read_fd;
+
+    if (!h || (fd = ffurl_get_file_handle(h)) < 0)
+        return AVERROR(ENOSYS);
+    /* the output is write-only, but the clone source has to be readable */
+    if ((ret = s->io_open(s, &read_pb, s->filename, AVIO_FLAG_READ, NULL)) < 0)
+        return ret;
+    h = ffio_geturlcontext(read_pb);
+    if (!h || (read_fd = ffurl_get_file_handle(h)) < 0) {
+        ret = AVERROR(ENOSYS);
+        goto end;
+    }
+
+    avio_flush(s->pb);
+    while (*end > start) {
+        struct file_clone_range range = { 0 };
+        int64_t len = (*end - start) % shift;
+
+        if (!len)
+            len = shift;
+        range.src_fd      = read_fd;
+        range.src_offset  = *end - len;
+        range.src_length  = len;
+        range.dest_offset = range.src_offset + shift;
+        if (ioctl(fd, FICLONERANGE, &range) < 0) {
+            ret = AVERROR(errno);
+            goto end;
+        }
+        *end -= len;
+    }
+
+end:
+    ff_format_io_close(s, &read_pb);
+    return ret;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+/*
+ * Write the moov into the free atom reserved by mov_write_header() with
+ * faststart. If it does not fit, the media data is moved forward by a block
+ * aligned amount, by cloning it where possible.
+ */
+static int mov_write_reserved_moov(AVFormatContext *s, int64_t end)
+{
+    MOVMuxContext *mov = s->priv_data;
+    AVIOContext *pb = s->pb;
+    int64_t start = mov->reserved_header_pos + mov->faststart_reserve;
+    int i, ret, moov_size, size, shift = 0;
+
+    for (;;) {
+        moov_size = get_moov_size(s);
+        if (moov_size < 0)
+            return moov_size;
+        size = mov->faststart_reserve + shift;
+        if (moov_size == size || moov_size + 8 <= size)
+            break;
+        /* the chunk offsets depend on the shift, so the moov size can still
+         * change when switching from stco to co64 */
+        size = FFALIGN(moov_size + 8 - mov->faststart_reserve, MOV_FASTSTART_ALIGN);
+        for (i = 0; i < mov->nb_streams; i++)
+            mov->tracks[i].data_offset += size - shift;
+        shift = size;
+    }
+
+    if (shift) {
+        av_log(s, AV_LOG_INFO, "Reserved space for the moov atom is %d bytes too "
+               "small, moving the media data\n", moov_size + 8 - mov->faststart_reserve);
+        ret = clone_data_range(s, start, &end, shift);
+        if (ret < 0)
+            av_log(s, AV_LOG_VERBOSE, "Cannot clone the media data (%s), copying it\n",
+                   av_err2str(ret));
+        if (end > start && (ret = shift_data_range(s, start, end, shift)) < 0)
+            return ret;
+    }
+
+    avio_seek(pb, mov->reserved_header_pos, SEEK_SET);
+    if ((ret = mov_write_moov_tag(pb, mov, s)) < 0)
+        return ret;
+    if (size > moov_size) {
+        avio_wb32(pb, size - moov_size);
+        ffio_wfourcc(pb, "free");
+        ffio_fill(pb, 0, size - moov_size - 8);
+    }
+    return 0;
+}
+
 static int mov_write_trailer(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -6124,7 +6356,10 @@ static int mov_write_trailer(AVFormatContext *s)
         }
         avio_seek(pb, mov->reserved_moov_size > 0 ? mov->reserved_header_pos : moov_pos, SEEK_SET);
 
-        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+        if (mov->flags & FF_MOV_FLAG_FASTSTART && mov->faststart_reserve) {
+            if ((res = mov_write_reserved_moov(s, moov_pos)) < 0)
+                return res;
+        } else if (mov->flags & FF_MOV_FLAG_FASTSTART) {
             av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the beginning of the file\n");
             res = shift_data(s);
             if (res < 0)
@@ -196,6 +196,8 @@ typedef struct MOVMuxContext {
 
     int reserved_moov_size; ///< 0 for disabled, -1 for automatic, size otherwise
     int64_t reserved_header_pos;
+    int64_t faststart_duration;
+    int faststart_reserve; ///< size of the free atom reserved for the moov with faststart
 
     char *major_brand;
 
@@ -243,6 +245,7 @@ typedef struct MOVMuxContext {
 #define FF_MOV_FLAG_WRITE_COLR            (1 << 15)
 #define FF_MOV_FLAG_WRITE_GAMA            (1 << 16)
 #define FF_MOV_FLAG_USE_MDTA              (1 << 17)
+#define FF_MOV_FLAG_CMAF                  (1 << 18)
 
 int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt);
 
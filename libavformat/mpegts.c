@@ -159,6 +159,28 @@ struct MpegTSContext {
     /** filters for various streams specified by PMT + for the PAT and PMT */
     MpegTSFilter *pids[NB_PID_MAX];
     int current_pid;
+
+    /** set when at least one AVProgram is discarded */
+    int discard_programs;
+    /** AVProgram.discard values discard_cache was computed with */
+    int *prog_discard;
+    int nb_prog_discard;
+    /** per-PID discard_pid() results, valid when their upper bits match
+     *  discard_gen */
+    unsigned discard_gen;
+    unsigned discard_cache[NB_PID_MAX];
+
+    /** pools for PES buffers, indexed by log2 of their size */
+    AVBufferPool *pools[32];
+
+    /** random_access_indicator of the TS packet being handled */
+    int current_random_access;
+
+    /** index video key frames while reading and use them to seek */
+    int seek_index;
+    /** key frame index written by the muxer, read again on each seek */
+    char *index_file;
+    int64_t index_file_pos;
 };
 
 #define MPEGTS_OPTIONS \
@@ -176,6 +198,10 @@ static const AVOption options[] = {
      {.i64 = 0}, 0, 1, 0 },
     {"skip_clear", "skip clearing programs", offsetof(MpegTSContext, skip_clear), AV_OPT_TYPE_BOOL,
      {.i64 = 0}, 0, 1, 0 },
+    {"seek_index", "seek using the video key frames seen so far", offsetof(MpegTSContext, seek_index), AV_OPT_TYPE_BOOL,
+     {.i64 = 0}, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    {"index_file", "seek using the key frame index written by the mpegts muxer", offsetof(MpegTSContext, index_file), AV_OPT_TYPE_STRING,
+     {.str = NULL}, 0, 0, AV_OPT_FLAG_DECODING_PARAM },
     { NULL },
 };
 
@@ -238,6 +264,7 @@ typedef struct PESContext {
     uint8_t stream_id;
     int64_t pts, dts;
     int64_t ts_packet_pos; /**< position of first TS packet of this PES packet */
+    int random_access; /**< first TS packet of this PES packet is a random access point */
     uint8_t header[MAX_PES_HEADER_SIZE];
     AVBufferRef *buffer;
     SLConfigDescr sl;
@@ -275,6 +302,7 @@ static void clear_program(MpegTSContext *ts, unsigned int programid)
 {
     int i;
 
+    ts->discard_gen++;
     clear_avprogram(ts, programid);
     for (i = 0; i < ts->nb_prg; i++)
         if (ts->prg[i].id == programid) {
@@ -287,6 +315,7 @@ static void clear_programs(MpegTSContext *ts)
 {
     av_freep(&ts->prg);
     ts->nb_prg = 0;
+    ts->discard_gen++;
 }
 
 static void add_pat_entry(MpegTSContext *ts, unsigned int programid)
@@ -301,6 +330,7 @@ static void add_pat_entry(MpegTSContext *ts, unsigned int programid)
     p->nb_pids = 0;
     p->pmt_found = 0;
     ts->nb_prg++;
+    ts->discard_gen++;
 }
 
 static void add_pid_to_pmt(MpegTSContext *ts, unsigned int programid,
@@ -319,6 +349,7 @@ static void add_pid_to_pmt(MpegTSContext *ts, unsigned int programid,
             return;
 
     p->pids[p->nb_pids++] = pid;
+    ts->discard_gen++;
 }
 
 static void set_pmt_found(MpegTSContext *ts, unsigned int programid)
@@ -341,6 +372,40 @@ static void set_pcr_pid(AVFormatContext *s, unsigned int programid, unsigned int
     }
 }
 
+#define DISCARD_GEN_MASK (UINT_MAX >> 1)
+
+/**
+ * Check whether any program is discarded and drop the cached discard_pid()
+ * results if the programs changed since the last call.
+ */
+static void update_discard_state(MpegTSContext *ts)
+{
+    AVFormatContext *s = ts->stream;
+    int k, changed = s->nb_programs != ts->nb_prog_discard;
+
+    if (changed &&
+        av_reallocp_array(&ts->prog_discard, s->nb_programs,
+                          sizeof(*ts->prog_discard)) < 0) {
+        ts->nb_prog_discard = 0;
+        ts->discard_programs = 0;
+        return;
+    }
+    ts->nb_prog_discard = s->nb_programs;
+
+    ts->discard_programs = 0;
+    for (k = 0; k < s->nb_programs; k++) {
+        if (ts->prog_discard[k] != s->programs[k]->discard) {
+            ts->prog_discard[k] = s->programs[k]->discard;
+            changed = 1;
+        }
+        if (s->programs[k]->discard == AVDISCARD_ALL)
+            ts->discard_programs = 1;
+    }
+    /* a zero generation would match the initial cache contents */
+    if (changed || !(ts->discard_gen & DISCARD_GEN_MASK))
+        ts->discard_gen++;
+}
+
 /**
  * @brief discard_pid() decides if the pid is to be discarded according
  *                      to caller's programs selection
@@ -354,15 +419,17 @@ static int discard_pid(MpegTSContext *ts, unsigned int pid)
     int i, j, k;
     int used = 0, discarded = 0;
     struct Program *p;
+    unsigned cached;
 
     /* If none of the programs have .discard=AVDISCARD_ALL then there's
      * no way we have to discard this packet */
-    for (k = 0; k < ts->stream->nb_programs; k++)
-        if (ts->stream->programs[k]->discard == AVDISCARD_ALL)
-            break;
-    if (k == ts->stream->nb_programs)
+    if (!ts->discard_programs)
         return 0;
 
+    cached = ts->discard_cache[pid];
+    if (cached >> 1 == (ts->discard_gen & DISCARD_GEN_MASK))
+        return cached & 1;
+
     for (i = 0; i < ts->nb_prg; i++) {
         p = &ts->prg[i];
         for (j = 0; j < p->nb_pids; j++) {
@@ -380,6 +447,7 @@ static int discard_pid(MpegTSContext *ts, unsigned int pid)
         }
     }
 
+    ts->discard_cache[pid] = ts->discard_gen << 1 | (!used && discarded);
     return !used && discarded;
 }
 
@@ -885,6 +953,44 @@ static void new_data_packet(const uint8_t *buffer, int len, AVPacket *pkt)
     pkt->size = len;
 }
 
+static AVBufferRef *buffer_pool_get(MpegTSContext *ts, int size)
+{
+    int index = av_log2(size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!ts->pools[index]) {
+        int pool_size = FFMIN(MAX_PES_PAYLOAD + AV_INPUT_BUFFER_PADDING_SIZE, 2 << index);
+        ts->pools[index] = av_buffer_pool_init(pool_size, NULL);
+        if (!ts->pools[index])
+            return NULL;
+    }
+    return av_buffer_pool_get(ts->pools[index]);
+}
+
+/* Maximum distance between a seek target and the index entry used for it,
+ * farther entries may be separated from the target by parts of the file
+ * that were never indexed. */
+#define MAX_INDEX_GAP (10 * AV_TIME_BASE)
+
+static void add_index_entry(AVFormatContext *s, AVStream *st, int64_t pos,
+                            int64_t timestamp)
+{
+    if (pos < 0 || timestamp == AV_NOPTS_VALUE)
+        return;
+
+    /* same unwrapping as libavformat applies to the packet timestamps */
+    if (st->pts_wrap_behavior != AV_PTS_WRAP_IGNORE &&
+        st->pts_wrap_reference != AV_NOPTS_VALUE) {
+        if (st->pts_wrap_behavior == AV_PTS_WRAP_ADD_OFFSET &&
+            timestamp < st->pts_wrap_reference)
+            timestamp += 1ULL << st->pts_wrap_bits;
+        else if (st->pts_wrap_behavior == AV_PTS_WRAP_SUB_OFFSET &&
+                 timestamp >= st->pts_wrap_reference)
+            timestamp -= 1ULL << st->pts_wrap_bits;
+    }
+
+    ff_reduce_index(s, st->index);
+    av_add_index_entry(st, pos, timestamp, 0, 0, AVINDEX_KEYFRAME);
+}
+
 static int new_pes_packet(PESContext *pes, AVPacket *pkt)
 {
     char *sd;
@@ -914,6 +1020,11 @@ static int new_pes_packet(PESContext *pes, AVPacket *pkt)
     pkt->pos   = pes->ts_packet_pos;
     pkt->flags = pes->flags;
 
+    if (pes->random_access && pes->ts->seek_index &&
+        pes->stream->streams[pkt->stream_index]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        add_index_entry(pes->stream, pes->stream->streams[pkt->stream_index],
+                        pkt->pos, pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts);
+
     pes->buffer = NULL;
     reset_pes_packet_state(pes);
 
@@ -1027,6 +1138,7 @@ static int mpegts_push_data(MpegTSFilter *filter,
         }
         pes->state         = MPEGTS_HEADER;
         pes->ts_packet_pos = pos;
+        pes->random_access = ts->current_random_access;
     }
     p = buf;
     while (buf_size > 0) {
@@ -1075,8 +1187,7 @@ static int mpegts_push_data(MpegTSFilter *filter,
                         pes->total_size = MAX_PES_PAYLOAD;
 
                     /* allocate pes buffer */
-                    pes->buffer = av_buffer_alloc(pes->total_size +
-                                                  AV_INPUT_BUFFER_PADDING_SIZE);
+                    pes->buffer = buffer_pool_get(ts, pes->total_size);
                     if (!pes->buffer)
                         return AVERROR(ENOMEM);
 
@@ -1236,8 +1347,7 @@ skip:
                     if (ret < 0)
                         return ret;
                     pes->total_size = MAX_PES_PAYLOAD;
-                    pes->buffer = av_buffer_alloc(pes->total_size +
-                                                  AV_INPUT_BUFFER_PADDING_SIZE);
+                    pes->buffer = buffer_pool_get(ts, pes->total_size);
                     if (!pes->buffer)
                         return AVERROR(ENOMEM);
                     ts->stop_parse = 1;
@@ -2247,13 +2357,13 @@ static int parse_pcr(int64_t *ppcr_high, int *ppcr_low,
                      const uint8_t *packet);
 
 /* handle one TS packet */
-static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
+/* handle one TS packet, pos is the position of the byte following it */
+static int handle_packet(MpegTSContext *ts, const uint8_t *packet, int64_t pos)
 {
     MpegTSFilter *tss;
     int len, pid, cc, expected_cc, cc_ok, afc, is_start, is_discontinuity,
         has_adaptation, has_payload;
     const uint8_t *p, *p_end;
-    int64_t pos;
 
     pid = AV_RB16(packet + 1) & 0x1fff;
     if (pid && discard_pid(ts, pid))
@@ -2276,6 +2386,8 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
     is_discontinuity = has_adaptation &&
                        packet[4] != 0 && /* with length > 0 */
                        (packet[5] & 0x80); /* and discontinuity indicated */
+    ts->current_random_access = has_adaptation && packet[4] != 0 &&
+                                (packet[5] & 0x40);
 
     /* continuity check (currently not used) */
     cc = (packet[3] & 0xf);
@@ -2310,7 +2422,6 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
     if (p >= p_end || !has_payload)
         return 0;
 
-    pos = avio_tell(ts->stream->pb);
     if (pos >= 0) {
         av_assert0(pos >= TS_PACKET_SIZE);
         ts->pos47_full = pos - TS_PACKET_SIZE;
@@ -2480,9 +2591,11 @@ static void finished_reading_packet(AVFormatContext *s, int raw_packet_size)
 static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
 {
     AVFormatContext *s = ts->stream;
+    AVIOContext *pb = s->pb;
     uint8_t packet[TS_PACKET_SIZE + AV_INPUT_BUFFER_PADDING_SIZE];
-    const uint8_t *data;
-    int64_t packet_num;
+    const uint8_t *data, *buf = NULL;
+    int64_t packet_num, buf_pos = 0;
+    int buf_left = 0, consumed = 0;
     int ret = 0;
 
     if (avio_tell(s->pb) != ts->last_pos) {
@@ -2505,6 +2618,8 @@ static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
         }
     }
 
+    update_discard_state(ts);
+
     ts->stop_parse = 0;
     packet_num = 0;
     memset(packet + TS_PACKET_SIZE, 0, AV_INPUT_BUFFER_PADDING_SIZE);
@@ -2518,14 +2633,41 @@ static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
         if (ts->stop_parse > 0)
             break;
 
-        ret = read_packet(s, packet, ts->raw_packet_size, &data);
-        if (ret != 0)
-            break;
-        ret = handle_packet(ts, data);
-        finished_reading_packet(s, ts->raw_packet_size);
+        /* Handle the packets already in the AVIOContext buffer in place and
+         * only update its position once per batch, falling back to
+         * read_packet() near the end of the buffer and to resync. */
+        if (buf_left < ts->raw_packet_size || buf[0] != 0x47) {
+            if (consumed) {
+                avio_skip(pb, consumed);
+                consumed = 0;
+            }
+            buf_left = 0;
+            if (!pb->write_flag && pb->buf_end - pb->buf_ptr >= 2 * ts->raw_packet_size &&
+                pb->buf_ptr[0] == 0x47) {
+                buf      = pb->buf_ptr;
+                buf_left = pb->buf_end - pb->buf_ptr;
+                buf_pos  = avio_tell(pb);
+            }
+        }
+
+        if (buf_left >= ts->raw_packet_size && buf[0] == 0x47) {
+            data      = buf;
+            buf      += ts->raw_packet_size;
+            buf_left -= ts->raw_packet_size;
+            consumed += ts->raw_packet_size;
+            ret = handle_packet(ts, data, buf_pos + consumed - ts->raw_packet_size + TS_PACKET_SIZE);
+        } else {
+            ret = read_packet(s, packet, ts->raw_packet_size, &data);
+            if (ret != 0)
+                break;
+            ret = handle_packet(ts, data, avio_tell(pb));
+            finished_reading_packet(s, ts->raw_packet_size);
+        }
         if (ret != 0)
             break;
     }
+    if (consumed)
+        avio_skip(pb, consumed);
     ts->last_pos = avio_tell(s->pb);
     return ret;
 }
@@ -2789,6 +2931,10 @@ static void mpegts_free(MpegTSContext *ts)
     int i;
 
     clear_programs(ts);
+    av_freep(&ts->prog_discard);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(ts->pools); i++)
+        av_buffer_pool_uninit(&ts->pools[i]);
 
     for (i = 0; i < NB_PID_MAX; i++)
         if (ts->pids[i])
@@ -2870,6 +3016,78 @@ static int64_t mpegts_get_dts(AVFormatContext *s, int stream_index,
     return AV_NOPTS_VALUE;
 }
 
+/* Add the records appended to the index file since the last call. */
+static void read_index_file(AVFormatContext *s)
+{
+    MpegTSContext *ts = s->priv_data;
+    AVIOContext *pb = NULL;
+    uint8_t rec[MPEGTS_INDEX_RECORD_SIZE];
+    int i;
+
+    if (s->io_open(s, &pb, ts->index_file, AVIO_FLAG_READ, NULL) < 0) {
+        av_log(s, AV_LOG_WARNING, "Could not open index file '%s'\n", ts->index_file);
+        return;
+    }
+
+    if (!ts->index_file_pos) {
+        if (avio_read(pb, rec, MPEGTS_INDEX_HEADER_SIZE) != MPEGTS_INDEX_HEADER_SIZE ||
+            memcmp(rec, MPEGTS_INDEX_MAGIC, MPEGTS_INDEX_HEADER_SIZE)) {
+            av_log(s, AV_LOG_WARNING, "Invalid index file '%s'\n", ts->index_file);
+            goto end;
+        }
+        ts->index_file_pos = MPEGTS_INDEX_HEADER_SIZE;
+    }
+
+    if (avio_seek(pb, ts->index_file_pos, SEEK_SET) < 0)
+        goto end;
+
+    while (avio_read(pb, rec, sizeof(rec)) == sizeof(rec)) {
+        int pid = AV_RB16(rec + 16);
+
+        for (i = 0; i < s->nb_streams; i++) {
+            if (s->streams[i]->id == pid) {
+                add_index_entry(s, s->streams[i], AV_RB64(rec), AV_RB64(rec + 8));
+                break;
+            }
+        }
+        ts->index_file_pos += sizeof(rec);
+    }
+
+end:
+    ff_format_io_close(s, &pb);
+}
+
+static int mpegts_read_seek(AVFormatContext *s, int stream_index,
+                            int64_t target_ts, int flags)
+{
+    MpegTSContext *ts = s->priv_data;
+    AVStream *st = s->streams[stream_index];
+    AVIndexEntry *e;
+    int index;
+
+    if (!ts->seek_index && !ts->index_file)
+        return -1;
+
+    if (ts->index_file)
+        read_index_file(s);
+
+    index = av_index_search_timestamp(st, target_ts, flags);
+    if (index < 0)
+        return -1;
+    e = &st->index_entries[index];
+
+    /* too far from the target, let the binary search find a closer packet */
+    if (av_compare_ts(FFABS(target_ts - e->timestamp), st->time_base,
+                      MAX_INDEX_GAP, AV_TIME_BASE_Q) > 0)
+        return -1;
+
+    if (avio_seek(s->pb, e->pos, SEEK_SET) < 0)
+        return -1;
+
+    ff_update_cur_dts(s, st, e->timestamp);
+    return 0;
+}
+
 /**************************************************************/
 /* parsing functions - called from other demuxers such as RTP */
 
@@ -2899,6 +3117,7 @@ int avpriv_mpegts_parse_packet(MpegTSContext *ts, AVPacket *pkt,
 
     len1 = len;
     ts->pkt = pkt;
+    update_discard_state(ts);
     for (;;) {
         ts->stop_parse = 0;
         if (len < TS_PACKET_SIZE)
@@ -2907,7 +3126,7 @@ int avpriv_mpegts_parse_packet(MpegTSContext *ts, AVPacket *pkt,
             buf++;
             len--;
         } else {
-            handle_packet(ts, buf);
+            handle_packet(ts, buf, avio_tell(ts->stream->pb));
             buf += TS_PACKET_SIZE;
             len -= TS_PACKET_SIZE;
             if (ts->stop_parse == 1)
@@ -2931,6 +3150,7 @@ AVInputFormat ff_mpegts_demuxer = {
     .read_header    = mpegts_read_header,
     .read_packet    = mpegts_read_packet,
     .read_close     = mpegts_read_close,
+    .read_seek      = mpegts_read_seek,
     .read_timestamp = mpegts_get_dts,
     .flags          = AVFMT_SHOW_IDS | AVFMT_TS_DISCONT,
     .priv_class     = &mpegts_class,
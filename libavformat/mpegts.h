@@ -63,6 +63,14 @@
 #define STREAM_TYPE_AUDIO_TRUEHD    0x83
 #define STREAM_TYPE_AUDIO_EAC3      0x87
 
+/* keyframe index sidecar written by the muxer with -index_file: an 8 byte
+ * header followed by fixed size records of byte offset (64 bits), 33 bit
+ * timestamp as written in the PES header (64 bits), PID (16 bits) and
+ * flags (16 bits), all big-endian */
+#define MPEGTS_INDEX_MAGIC       "FFTSIDX1"
+#define MPEGTS_INDEX_HEADER_SIZE 8
+#define MPEGTS_INDEX_RECORD_SIZE 20
+
 typedef struct MpegTSContext MpegTSContext;
 
 MpegTSContext *avpriv_mpegts_parse_open(AVFormatContext *s);
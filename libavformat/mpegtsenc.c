@@ -114,6 +114,9 @@ typedef struct MpegTSWrite {
 
     int omit_video_pes_length;
     int include_sdt; // PLEX
+
+    char *index_file;
+    AVIOContext *index_pb;
 } MpegTSWrite;
 
 /* a PES packet header is generated every DEFAULT_PES_HEADER_FREQ packets */
@@ -769,6 +772,15 @@ static int mpegts_init(AVFormatContext *s)
     if (s->max_delay < 0) /* Not set by the caller */
         s->max_delay = 0;
 
+    if (ts->index_file) {
+        if ((ret = s->io_open(s, &ts->index_pb, ts->index_file, AVIO_FLAG_WRITE, NULL)) < 0) {
+            av_log(s, AV_LOG_ERROR, "Failed to open index file '%s'\n", ts->index_file);
+            return ret;
+        }
+        avio_write(ts->index_pb, MPEGTS_INDEX_MAGIC, MPEGTS_INDEX_HEADER_SIZE);
+        avio_flush(ts->index_pb);
+    }
+
     // round up to a whole number of TS packets
     ts->pes_payload_size = (ts->pes_payload_size + 14 + 183) / 184 * 184 - 14;
 
@@ -1144,6 +1156,22 @@ static uint8_t *get_ts_payload_start(uint8_t *pkt)
         return pkt + 4;
 }
 
+/* Record the key frame written at pos as a seek point, so that a reader of a
+ * file still being recorded does not have to search it. The TS data is
+ * flushed first, so that the index never points past the end of the file. */
+static void mpegts_write_index_entry(AVFormatContext *s, int pid,
+                                     int64_t pos, int64_t ts)
+{
+    MpegTSWrite *ts_ctx = s->priv_data;
+
+    avio_flush(s->pb);
+    avio_wb64(ts_ctx->index_pb, pos);
+    avio_wb64(ts_ctx->index_pb, ts & 0x1ffffffffLL);
+    avio_wb16(ts_ctx->index_pb, pid);
+    avio_wb16(ts_ctx->index_pb, 0);
+    avio_flush(ts_ctx->index_pb);
+}
+
 /* Add a PES header to the front of the payload, and segment into an integer
  * number of TS packets. The final TS packet is padded using an oversized
  * adaptation header to exactly fill the last TS packet.
@@ -1160,6 +1188,7 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
     int afc_len, stuffing_len;
     int64_t pcr = -1; /* avoid warning */
     int64_t delay = av_rescale(s->max_delay, 90000, AV_TIME_BASE);
+    int64_t index_pos = -1;
     int force_pat = st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && key && !ts_st->prev_payload_key;
 
     av_assert0(ts_st->payload != buf || st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO);
@@ -1210,6 +1239,8 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
                 write_pcr = 1;
             set_af_flag(buf, 0x40);
             q = get_ts_payload_start(buf);
+            if (ts->index_pb && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+                index_pos = avio_tell(s->pb);
         }
         if (write_pcr) {
             set_af_flag(buf, 0x10);
@@ -1402,6 +1433,9 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
         mpegts_prefix_m2ts_header(s);
         avio_write(s->pb, buf, TS_PACKET_SIZE);
     }
+    if (index_pos >= 0)
+        mpegts_write_index_entry(s, ts_st->pid, index_pos,
+                                 dts != AV_NOPTS_VALUE ? dts : pts);
     ts_st->prev_payload_key = key;
 }
 
@@ -1804,6 +1838,8 @@ static void mpegts_deinit(AVFormatContext *s)
         av_freep(&service);
     }
     av_freep(&ts->services);
+
+    ff_format_io_close(s, &ts->index_pb);
 }
 
 static int mpegts_check_bitstream(struct AVFormatContext *s, const AVPacket *pkt)
@@ -1917,6 +1953,9 @@ static const AVOption options[] = {
     { "sdt_period", "SDT retransmission time limit in seconds",
       offsetof(MpegTSWrite, sdt_period), AV_OPT_TYPE_DOUBLE,
       { .dbl = INT_MAX }, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
+    { "index_file", "Write the positions of video key frames to this file",
+      offsetof(MpegTSWrite, index_file), AV_OPT_TYPE_STRING,
+      { .str = NULL }, 0, 0, AV_OPT_FLAG_ENCODING_PARAM },
     { NULL },
 };
 
@@ -36,6 +36,7 @@
 #include "libavutil/mathematics.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/time.h"
+#include "libavutil/trace.h"
 #include "riff.h"
 #include "audiointerleave.h"
 #include "url.h"
@@ -231,6 +232,16 @@ static int validate_codec_tag(AVFormatContext *s, AVStream *st)
     return 1;
 }
 
+/**
+ * Return nonzero for the streams that the max_interleave_delta check does
+ * not wait for while they have no packet queued.
+ */
+static int interleave_is_sparse(const AVStream *st)
+{
+    return st->codecpar->codec_type == AVMEDIA_TYPE_ATTACHMENT ||
+           st->codecpar->codec_id == AV_CODEC_ID_VP8 ||
+           st->codecpar->codec_id == AV_CODEC_ID_VP9;
+}
 
 static int init_muxer(AVFormatContext *s, AVDictionary **options)
 {
@@ -391,8 +402,15 @@ FF_ENABLE_DEPRECATION_WARNINGS
 
         if (par->codec_type != AVMEDIA_TYPE_ATTACHMENT)
             s->internal->nb_interleaved_streams++;
+        if (interleave_is_sparse(st))
+            s->internal->nb_sparse_streams++;
     }
 
+    /* Muxers with their own interleave_packet() and chunked interleaving
+     * work on the packet_buffer list directly. */
+    s->internal->use_interleave_heap = !of->interleave_packet &&
+                                       !s->max_chunk_size && !s->max_chunk_duration;
+
     if (!s->priv_data && of->priv_data_size > 0) {
         s->priv_data = av_mallocz(of->priv_data_size);
         if (!s->priv_data) {
@@ -769,7 +787,9 @@ static int write_packet(AVFormatContext *s, AVPacket *pkt)
         ret = s->oformat->write_uncoded_frame(s, pkt->stream_index, &frame, 0);
         av_frame_free(&frame);
     } else {
+        av_trace_event(AV_TRACE_BEGIN, s->oformat->name, "mux", pkt->stream_index);
         ret = s->oformat->write_packet(s, pkt);
+        av_trace_event(AV_TRACE_END, s->oformat->name, "mux", ret);
     }
 
     if (s->pb && ret >= 0) {
@@ -981,6 +1001,18 @@ int av_write_frame(AVFormatContext *s, AVPacket *pkt)
 
 #define CHUNK_START 0x1000
 
+static void interleave_stream_queued(AVFormatContext *s, AVStream *st)
+{
+    s->internal->nb_queued_streams++;
+    s->internal->nb_queued_sparse_streams += interleave_is_sparse(st);
+}
+
+static void interleave_stream_drained(AVFormatContext *s, AVStream *st)
+{
+    s->internal->nb_queued_streams--;
+    s->internal->nb_queued_sparse_streams -= interleave_is_sparse(st);
+}
+
 int ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
                              int (*compare)(AVFormatContext *, AVPacket *, AVPacket *))
 {
@@ -1010,6 +1042,7 @@ int ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
         next_point = &(st->last_in_packet_buffer->next);
     } else {
         next_point = &s->internal->packet_buffer;
+        interleave_stream_queued(s, st);
     }
 
     if (chunked) {
@@ -1082,39 +1115,227 @@ static int interleave_compare_dts(AVFormatContext *s, AVPacket *next,
     return comp > 0;
 }
 
+/**
+ * Return nonzero if the first queued packet of stream a must be muxed
+ * before the first queued packet of stream b.
+ */
+static int interleave_heap_before(AVFormatContext *s, AVStream *a, AVStream *b)
+{
+    return interleave_compare_dts(s, &b->internal->interleave_head->pkt,
+                                     &a->internal->interleave_head->pkt);
+}
+
+static void interleave_heap_up(AVFormatContext *s, int i)
+{
+    AVStream **heap = s->internal->interleave_heap;
+    AVStream *st    = heap[i];
+
+    while (i > 0) {
+        int parent = (i - 1) >> 1;
+        if (!interleave_heap_before(s, st, heap[parent]))
+            break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = st;
+}
+
+static void interleave_heap_down(AVFormatContext *s, int i)
+{
+    AVStream **heap = s->internal->interleave_heap;
+    AVStream *st    = heap[i];
+    int n           = s->internal->nb_interleave_heap;
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && interleave_heap_before(s, heap[child + 1], heap[child]))
+            child++;
+        if (!interleave_heap_before(s, heap[child], st))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = st;
+}
+
+/**
+ * Queue a packet at the end of its stream for the heap interleaver.
+ * Each stream queue is in dts order, so merging the stream queues through
+ * the heap gives the same order as inserting into the sorted packet_buffer
+ * list, without walking the list for every packet.
+ */
+static int interleave_heap_add_packet(AVFormatContext *s, AVPacket *pkt)
+{
+    AVFormatInternal *si = s->internal;
+    AVStream *st         = s->streams[pkt->stream_index];
+    AVPacketList *pktl   = si->interleave_pool;
+    int ret;
+
+    if (!st->last_in_packet_buffer && si->nb_interleave_heap >= si->interleave_heap_size) {
+        AVStream **heap = av_realloc_array(si->interleave_heap, s->nb_streams,
+                                           sizeof(*heap));
+        if (!heap)
+            return AVERROR(ENOMEM);
+        si->interleave_heap      = heap;
+        si->interleave_heap_size = s->nb_streams;
+    }
+
+    if (pktl) {
+        si->interleave_pool = pktl->next;
+        memset(pktl, 0, sizeof(*pktl));
+    } else if (!(pktl = av_mallocz(sizeof(*pktl)))) {
+        return AVERROR(ENOMEM);
+    }
+
+    if ((pkt->flags & AV_PKT_FLAG_UNCODED_FRAME)) {
+        av_assert0(pkt->size == UNCODED_FRAME_PACKET_SIZE);
+        av_assert0(((AVFrame *)pkt->data)->buf);
+        pktl->pkt = *pkt;
+        pkt->buf = NULL;
+        pkt->side_data = NULL;
+        pkt->side_data_elems = 0;
+    } else if ((ret = av_packet_ref(&pktl->pkt, pkt)) < 0) {
+        pktl->next = si->interleave_pool;
+        si->interleave_pool = pktl;
+        return ret;
+    }
+
+    if (st->last_in_packet_buffer) {
+        st->last_in_packet_buffer->next = pktl;
+    } else {
+        st->internal->interleave_head = pktl;
+        interleave_stream_queued(s, st);
+        si->interleave_heap[si->nb_interleave_heap++] = st;
+        interleave_heap_up(s, si->nb_interleave_heap - 1);
+    }
+    st->last_in_packet_buffer = pktl;
+
+    av_packet_unref(pkt);
+
+    return 0;
+}
+
+static AVPacket *interleave_top(AVFormatContext *s)
+{
+    AVFormatInternal *si = s->internal;
+
+    if (si->use_interleave_heap)
+        return si->nb_interleave_heap ?
+               &si->interleave_heap[0]->internal->interleave_head->pkt : NULL;
+    return si->packet_buffer ? &si->packet_buffer->pkt : NULL;
+}
+
+/**
+ * Unlink the first packet in interleaving order; the node must be given
+ * back with interleave_release() once its packet has been taken.
+ */
+static AVPacketList *interleave_pop(AVFormatContext *s)
+{
+    AVFormatInternal *si = s->internal;
+    AVPacketList *pktl;
+    AVStream *st;
+
+    if (si->use_interleave_heap) {
+        st   = si->interleave_heap[0];
+        pktl = st->internal->interleave_head;
+
+        st->internal->interleave_head = pktl->next;
+        if (!pktl->next) {
+            st->last_in_packet_buffer = NULL;
+            interleave_stream_drained(s, st);
+            si->interleave_heap[0] = si->interleave_heap[--si->nb_interleave_heap];
+        }
+        if (si->nb_interleave_heap)
+            interleave_heap_down(s, 0);
+        return pktl;
+    }
+
+    pktl = si->packet_buffer;
+    st   = s->streams[pktl->pkt.stream_index];
+
+    si->packet_buffer = pktl->next;
+    if (!si->packet_buffer)
+        si->packet_buffer_end = NULL;
+
+    if (st->last_in_packet_buffer == pktl) {
+        st->last_in_packet_buffer = NULL;
+        interleave_stream_drained(s, st);
+    }
+
+    return pktl;
+}
+
+static void interleave_release(AVFormatContext *s, AVPacketList *pktl)
+{
+    if (s->internal->use_interleave_heap) {
+        pktl->next = s->internal->interleave_pool;
+        s->internal->interleave_pool = pktl;
+    } else {
+        av_free(pktl);
+    }
+}
+
+void ff_interleave_free(AVFormatContext *s)
+{
+    AVFormatInternal *si = s->internal;
+    AVPacketList *pktl;
+    int i;
+
+    if (!si)
+        return;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        if (!st->internal)
+            continue;
+        while ((pktl = st->internal->interleave_head)) {
+            st->internal->interleave_head = pktl->next;
+            av_packet_unref(&pktl->pkt);
+            av_free(pktl);
+        }
+        st->last_in_packet_buffer = NULL;
+    }
+    while ((pktl = si->interleave_pool)) {
+        si->interleave_pool = pktl->next;
+        av_free(pktl);
+    }
+    av_freep(&si->interleave_heap);
+    si->nb_interleave_heap = si->interleave_heap_size = 0;
+    si->nb_queued_streams = si->nb_queued_sparse_streams = 0;
+}
+
 int ff_interleave_packet_per_dts(AVFormatContext *s, AVPacket *out,
                                  AVPacket *pkt, int flush)
 {
+    AVFormatInternal *si = s->internal;
     AVPacketList *pktl;
-    int stream_count = 0;
-    int noninterleaved_count = 0;
+    AVPacket *top_pkt;
     int i, ret;
     int eof = flush;
 
     if (pkt) {
-        if ((ret = ff_interleave_add_packet(s, pkt, interleave_compare_dts)) < 0)
+        if (s->internal->use_interleave_heap)
+            ret = interleave_heap_add_packet(s, pkt);
+        else
+            ret = ff_interleave_add_packet(s, pkt, interleave_compare_dts);
+        if (ret < 0)
             return ret;
     }
 
-    for (i = 0; i < s->nb_streams; i++) {
-        if (s->streams[i]->last_in_packet_buffer) {
-            ++stream_count;
-        } else if (s->streams[i]->codecpar->codec_type != AVMEDIA_TYPE_ATTACHMENT &&
-                   s->streams[i]->codecpar->codec_id != AV_CODEC_ID_VP8 &&
-                   s->streams[i]->codecpar->codec_id != AV_CODEC_ID_VP9) {
-            ++noninterleaved_count;
-        }
-    }
-
-    if (s->internal->nb_interleaved_streams == stream_count)
+    if (si->nb_interleaved_streams == si->nb_queued_streams)
         flush = 1;
 
+    top_pkt = interleave_top(s);
+
     if (s->max_interleave_delta > 0 &&
-        s->internal->packet_buffer &&
+        top_pkt &&
         !flush &&
-        s->internal->nb_interleaved_streams == stream_count+noninterleaved_count
+        /* all the streams have packets queued, except sparse ones */
+        si->nb_interleaved_streams == s->nb_streams - si->nb_sparse_streams +
+                                      si->nb_queued_sparse_streams
     ) {
-        AVPacket *top_pkt = &s->internal->packet_buffer->pkt;
         int64_t delta_dts = INT64_MIN;
         int64_t top_dts = av_rescale_q(top_pkt->dts,
                                        s->streams[top_pkt->stream_index]->time_base,
@@ -1142,21 +1363,17 @@ int ff_interleave_packet_per_dts(AVFormatContext *s, AVPacket *out,
         }
     }
 
-    if (s->internal->packet_buffer &&
+    if (top_pkt &&
         eof &&
         (s->flags & AVFMT_FLAG_SHORTEST) &&
         s->internal->shortest_end == AV_NOPTS_VALUE) {
-        AVPacket *top_pkt = &s->internal->packet_buffer->pkt;
-
         s->internal->shortest_end = av_rescale_q(top_pkt->dts,
                                        s->streams[top_pkt->stream_index]->time_base,
                                        AV_TIME_BASE_Q);
     }
 
     if (s->internal->shortest_end != AV_NOPTS_VALUE) {
-        while (s->internal->packet_buffer) {
-            AVPacket *top_pkt = &s->internal->packet_buffer->pkt;
-            AVStream *st;
+        while ((top_pkt = interleave_top(s))) {
             int64_t top_dts = av_rescale_q(top_pkt->dts,
                                         s->streams[top_pkt->stream_index]->time_base,
                                         AV_TIME_BASE_Q);
@@ -1164,35 +1381,17 @@ int ff_interleave_packet_per_dts(AVFormatContext *s, AVPacket *out,
             if (s->internal->shortest_end + 1 >= top_dts)
                 break;
 
-            pktl = s->internal->packet_buffer;
-            st   = s->streams[pktl->pkt.stream_index];
-
-            s->internal->packet_buffer = pktl->next;
-            if (!s->internal->packet_buffer)
-                s->internal->packet_buffer_end = NULL;
-
-            if (st->last_in_packet_buffer == pktl)
-                st->last_in_packet_buffer = NULL;
-
+            pktl = interleave_pop(s);
             av_packet_unref(&pktl->pkt);
-            av_freep(&pktl);
+            interleave_release(s, pktl);
             flush = 0;
         }
     }
 
-    if (stream_count && flush) {
-        AVStream *st;
-        pktl = s->internal->packet_buffer;
+    if (si->nb_queued_streams && flush) {
+        pktl = interleave_pop(s);
         *out = pktl->pkt;
-        st   = s->streams[out->stream_index];
-
-        s->internal->packet_buffer = pktl->next;
-        if (!s->internal->packet_buffer)
-            s->internal->packet_buffer_end = NULL;
-
-        if (st->last_in_packet_buffer == pktl)
-            st->last_in_packet_buffer = NULL;
-        av_freep(&pktl);
+        interleave_release(s, pktl);
 
         return 1;
     } else {
@@ -1204,6 +1403,10 @@ int ff_interleave_packet_per_dts(AVFormatContext *s, AVPacket *out,
 const AVPacket *ff_interleaved_peek(AVFormatContext *s, int stream, int64_t *ts_offset)
 {
     AVPacketList *pktl = s->internal->packet_buffer;
+
+    if (s->internal->use_interleave_heap)
+        pktl = s->streams[stream]->internal->interleave_head;
+
     while (pktl) {
         if (pktl->pkt.stream_index == stream) {
             AVPacket *pkt = &pktl->pkt;
@@ -29,6 +29,7 @@
 #include <float.h>
 #include <time.h>
 
+#include "asyncwrite.h"
 #include "avformat.h"
 #include "avio_internal.h"
 #include "internal.h"
@@ -129,6 +130,18 @@ typedef struct SegmentContext {
     SegmentListEntry *segment_list_entries_end;
 
     int segment_copyts;    ///< PLEX
+    int seek_restart;      ///< PLEX segment number to continue at after the input was seeked
+    int async_write;       ///< PLEX write the files in a separate thread
+    FFAsyncWriter *writer; ///< PLEX
+
+    //PLEX
+    char *vtt_filename;    ///< filename template of the WebVTT segments
+    int vtt_stream_index;  ///< WebVTT stream written to its own segments, or -1
+    int *stream_map;       ///< index of each stream in avf, -1 for the WebVTT stream
+    AVFormatContext *vtt_avf; ///< WebVTT segment in progress, muxed to memory
+    AVPacket *vtt_cues;    ///< cues which may last past the segment in progress
+    int nb_vtt_cues;
+    int64_t vtt_mpegts_delay; ///< offset of the MPEG-TS timestamps to the packet ones
 } SegmentContext;
 
 static void print_csv_escaped_str(AVIOContext *ctx, const char *str)
@@ -147,6 +160,18 @@ static void print_csv_escaped_str(AVIOContext *ctx, const char *str)
         avio_w8(ctx, '"');
 }
 
+static int segment_io_open(AVFormatContext *s, AVIOContext **pb, const char *filename)
+{
+    SegmentContext *seg = s->priv_data;
+    int ret;
+
+    if ((ret = s->io_open(s, pb, filename, AVIO_FLAG_WRITE, NULL)) < 0)
+        return ret;
+    if ((ret = ff_async_writer_wrap(seg->writer, pb)) < 0)
+        ff_format_io_close(s, pb);
+    return ret;
+}
+
 static int segment_mux_init(AVFormatContext *s)
 {
     SegmentContext *seg = s->priv_data;
@@ -167,10 +192,21 @@ static int segment_mux_init(AVFormatContext *s)
     oc->io_open            = s->io_open;
     oc->flags              = s->flags;
 
+    if (!seg->stream_map &&
+        !(seg->stream_map = av_malloc_array(s->nb_streams, sizeof(*seg->stream_map))))
+        return AVERROR(ENOMEM);
+
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *st;
         AVCodecParameters *ipar, *opar;
 
+        //PLEX
+        if (i == seg->vtt_stream_index) {
+            seg->stream_map[i] = -1;
+            continue;
+        }
+        seg->stream_map[i] = oc->nb_streams;
+
         if (!(st = avformat_new_stream(oc, NULL)))
             return AVERROR(ENOMEM);
         ipar = s->streams[i]->codecpar;
@@ -191,6 +227,167 @@ static int segment_mux_init(AVFormatContext *s)
     return 0;
 }
 
+//PLEX
+/* The cues of the WebVTT stream are muxed into memory, and written out in one
+ * go as a file with the index of the media segment when it ends. Cues lasting
+ * past the end of a segment are repeated at the start of the next one. */
+static void vtt_segment_free(SegmentContext *seg)
+{
+    uint8_t *buf;
+
+    if (!seg->vtt_avf)
+        return;
+    if (seg->vtt_avf->pb) {
+        avio_close_dyn_buf(seg->vtt_avf->pb, &buf);
+        av_free(buf);
+        seg->vtt_avf->pb = NULL;
+    }
+    avformat_free_context(seg->vtt_avf);
+    seg->vtt_avf = NULL;
+}
+
+static int vtt_write_cue(AVFormatContext *s, const AVPacket *cue, int64_t start)
+{
+    SegmentContext *seg = s->priv_data;
+    AVStream *st = s->streams[cue->stream_index];
+    AVPacket pkt = *cue;
+
+    if (pkt.pts < start) {
+        pkt.duration -= start - pkt.pts;
+        pkt.pts       = start;
+    }
+    pkt.pts += av_rescale_q(seg->initial_offset - (seg->reset_timestamps ? seg->cur_entry.start_pts : 0),
+                            AV_TIME_BASE_Q, st->time_base);
+    pkt.dts  = pkt.pts;
+    return ff_write_chained(seg->vtt_avf, 0, &pkt, s, 0);
+}
+
+static int vtt_segment_open(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+    AVStream *ist = s->streams[seg->vtt_stream_index];
+    AVDictionary *options = NULL;
+    AVFormatContext *vtt;
+    AVStream *st;
+    int64_t start, local;
+    int i, j, ret;
+
+    ret = avformat_alloc_output_context2(&seg->vtt_avf, NULL, "webvtt", NULL);
+    if (ret < 0)
+        return ret;
+    vtt = seg->vtt_avf;
+    vtt->interrupt_callback = s->interrupt_callback;
+    vtt->flags              = s->flags;
+
+    if (!(st = avformat_new_stream(vtt, NULL))) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    if ((ret = avcodec_parameters_copy(st->codecpar, ist->codecpar)) < 0)
+        goto fail;
+    st->time_base = ist->time_base;
+
+    /* Map the whole second before the segment start to its MPEG-TS timestamp. */
+    local = seg->initial_offset + (seg->reset_timestamps ? 0 : seg->cur_entry.start_pts);
+    local = FFMAX(local, 0) / AV_TIME_BASE;
+    av_dict_set_int(&options, "sync_vtt", local, 0);
+    av_dict_set_int(&options, "sync_mpeg",
+                    (local * 90000 + seg->vtt_mpegts_delay) & ((1LL << 33) - 1), 0);
+
+    if ((ret = avio_open_dyn_buf(&vtt->pb)) < 0)
+        goto fail;
+    if ((ret = avformat_write_header(vtt, &options)) < 0)
+        goto fail;
+
+    start = av_rescale_q(seg->cur_entry.start_pts, AV_TIME_BASE_Q, ist->time_base);
+    for (i = j = 0; i < seg->nb_vtt_cues; i++) {
+        AVPacket *cue = &seg->vtt_cues[i];
+        if (cue->pts + cue->duration <= start) {
+            av_packet_unref(cue);
+            continue;
+        }
+        if ((ret = vtt_write_cue(s, cue, start)) < 0)
+            break;
+        seg->vtt_cues[j++] = *cue;
+    }
+    /* keep the cue which failed and those not looked at after an error */
+    memmove(seg->vtt_cues + j, seg->vtt_cues + i, (seg->nb_vtt_cues - i) * sizeof(*seg->vtt_cues));
+    seg->nb_vtt_cues = j + seg->nb_vtt_cues - i;
+    if (ret < 0)
+        goto fail;
+
+    av_dict_free(&options);
+    return 0;
+fail:
+    av_dict_free(&options);
+    vtt_segment_free(seg);
+    return ret;
+}
+
+static int vtt_add_cue(AVFormatContext *s, const AVPacket *pkt)
+{
+    SegmentContext *seg = s->priv_data;
+    int ret;
+
+    if (pkt->pts == AV_NOPTS_VALUE)
+        return 0;
+    if (!seg->vtt_avf && (ret = vtt_segment_open(s)) < 0)
+        return ret;
+
+    if ((ret = av_reallocp_array(&seg->vtt_cues, seg->nb_vtt_cues + 1,
+                                 sizeof(*seg->vtt_cues))) < 0) {
+        seg->nb_vtt_cues = 0;
+        return ret;
+    }
+    av_init_packet(&seg->vtt_cues[seg->nb_vtt_cues]);
+    if ((ret = av_packet_ref(&seg->vtt_cues[seg->nb_vtt_cues], pkt)) < 0)
+        return ret;
+    seg->nb_vtt_cues++;
+
+    return vtt_write_cue(s, pkt, INT64_MIN);
+}
+
+static int vtt_segment_close(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+    char filename[1024], temp_filename[1024];
+    AVIOContext *pb = NULL;
+    uint8_t *buf = NULL;
+    int ret, size;
+
+    if (!seg->vtt_avf && (ret = vtt_segment_open(s)) < 0)
+        return ret;
+
+    ret  = av_write_trailer(seg->vtt_avf);
+    size = avio_close_dyn_buf(seg->vtt_avf->pb, &buf);
+    seg->vtt_avf->pb = NULL;
+    vtt_segment_free(seg);
+    if (ret < 0)
+        goto end;
+
+    if (av_get_frame_filename(filename, sizeof(filename), seg->vtt_filename, seg->segment_idx) < 0) {
+        av_log(s, AV_LOG_ERROR, "Invalid WebVTT segment filename template '%s'\n", seg->vtt_filename);
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    if (snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", filename) >= sizeof(temp_filename)) {
+        av_log(s, AV_LOG_ERROR, "WebVTT segment filename '%s' too long\n", filename);
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    if ((ret = segment_io_open(s, &pb, temp_filename)) < 0) {
+        av_log(s, AV_LOG_ERROR, "Failed to open WebVTT segment '%s'\n", temp_filename);
+        goto end;
+    }
+    avio_write(pb, buf, size);
+    ret = ff_async_writer_close(seg->writer, s, &pb, temp_filename, filename);
+
+end:
+    av_free(buf);
+    return ret;
+}
+//PLEX
+
 static int set_segment_filename(AVFormatContext *s)
 {
     SegmentContext *seg = s->priv_data;
@@ -256,7 +453,7 @@ static int segment_start(AVFormatContext *s, int write_header)
     if ((err = set_segment_filename(s)) < 0)
         return err;
 
-    if ((err = s->io_open(s, &oc->pb, oc->filename, AVIO_FLAG_WRITE, NULL)) < 0) {
+    if ((err = segment_io_open(s, &oc->pb, oc->filename)) < 0) {
         av_log(s, AV_LOG_ERROR, "Failed to open segment '%s'\n", oc->filename);
         return err;
     }
@@ -286,7 +483,7 @@ static int segment_list_open(AVFormatContext *s)
     int ret;
 
     snprintf(seg->temp_list_filename, sizeof(seg->temp_list_filename), seg->use_rename ? "%s.tmp" : "%s", seg->list);
-    ret = s->io_open(s, &seg->list_pb, seg->temp_list_filename, AVIO_FLAG_WRITE, NULL);
+    ret = segment_io_open(s, &seg->list_pb, seg->temp_list_filename);
     if (ret < 0) {
         av_log(s, AV_LOG_ERROR, "Failed to open segment list '%s'\n", seg->list);
         return ret;
@@ -370,6 +567,12 @@ static int segment_end(AVFormatContext *s, int write_trailer, int is_last)
         av_log(s, AV_LOG_ERROR, "Failure occurred when ending segment '%s'\n",
                oc->filename);
 
+    //PLEX
+    if (seg->vtt_stream_index >= 0 && (err = vtt_segment_close(s)) < 0) {
+        ret = err;
+        goto end;
+    }
+
     if (seg->list) {
         if (seg->list_size || seg->list_type == LIST_TYPE_M3U8) {
             SegmentListEntry *entry = av_mallocz(sizeof(*entry));
@@ -401,9 +604,9 @@ static int segment_end(AVFormatContext *s, int write_trailer, int is_last)
                 segment_list_print_entry(seg->list_pb, seg->list_type, entry, s);
             if (seg->list_type == LIST_TYPE_M3U8 && is_last)
                 avio_printf(seg->list_pb, "#EXT-X-ENDLIST\n");
-            ff_format_io_close(s, &seg->list_pb);
-            if (seg->use_rename)
-                ff_rename(seg->temp_list_filename, seg->list, s);
+            ret = ff_async_writer_close(seg->writer, s, &seg->list_pb,
+                                        seg->use_rename ? seg->temp_list_filename : NULL,
+                                        seg->list);
         } else {
             segment_list_print_entry(seg->list_pb, seg->list_type, &seg->cur_entry, s);
             avio_flush(seg->list_pb);
@@ -438,17 +641,19 @@ static int segment_end(AVFormatContext *s, int write_trailer, int is_last)
     }
 
 end:
-    ff_format_io_close(oc, &oc->pb);
-
     // PLEX
 
     // Now rename the temporary file.
     if (!seg->list) {
         char* final_filename = av_strdup(oc->filename);
         final_filename[strlen(final_filename)-4] = '\0';
-        rename(oc->filename, final_filename);
+        err = ff_async_writer_close(seg->writer, oc, &oc->pb, oc->filename, final_filename);
         av_free(final_filename);
+    } else {
+        err = ff_async_writer_close(seg->writer, oc, &oc->pb, NULL, NULL);
     }
+    if (ret >= 0)
+        ret = err;
 
     // PLEX
 
@@ -652,9 +857,16 @@ static int select_reference_stream(AVFormatContext *s)
 static void seg_free(AVFormatContext *s)
 {
     SegmentContext *seg = s->priv_data;
-    ff_format_io_close(seg->avf, &seg->list_pb);
+    ff_async_writer_close(seg->writer, seg->avf, &seg->list_pb, NULL, NULL);
     avformat_free_context(seg->avf);
     seg->avf = NULL;
+    //PLEX
+    vtt_segment_free(seg);
+    while (seg->nb_vtt_cues)
+        av_packet_unref(&seg->vtt_cues[--seg->nb_vtt_cues]);
+    av_freep(&seg->vtt_cues);
+    av_freep(&seg->stream_map);
+    ff_async_writer_free(&seg->writer);
 }
 
 static int seg_init(AVFormatContext *s)
@@ -666,6 +878,7 @@ static int seg_init(AVFormatContext *s)
     int i;
 
     seg->segment_count = 0;
+    seg->vtt_stream_index = -1; //PLEX
     if (!seg->write_header_trailer)
         seg->individual_header_trailer = 0;
 
@@ -751,6 +964,24 @@ static int seg_init(AVFormatContext *s)
            seg->reference_stream_index,
            av_get_media_type_string(s->streams[seg->reference_stream_index]->codecpar->codec_type));
 
+    //PLEX
+    if (seg->vtt_filename) {
+        for (i = 0; i < s->nb_streams; i++) {
+            if (s->streams[i]->codecpar->codec_id != AV_CODEC_ID_WEBVTT)
+                continue;
+            if (seg->vtt_stream_index >= 0) {
+                av_log(s, AV_LOG_ERROR, "Only one WebVTT stream can be written to WebVTT segments\n");
+                return AVERROR(EINVAL);
+            }
+            seg->vtt_stream_index = i;
+        }
+        if (seg->vtt_stream_index < 0 || seg->vtt_stream_index == seg->reference_stream_index) {
+            av_log(s, AV_LOG_ERROR, "segment_vtt_filename needs a WebVTT stream, "
+                   "besides the reference stream\n");
+            return AVERROR(EINVAL);
+        }
+    }
+
     seg->oformat = av_guess_format(seg->format, s->filename, NULL);
 
     if (!seg->oformat)
@@ -768,10 +999,18 @@ static int seg_init(AVFormatContext *s)
         return ret;
     oc = seg->avf;
 
+    //PLEX
+    if (seg->async_write) {
+        ret = ff_async_writer_alloc(&seg->writer, s);
+        if (ret == AVERROR(ENOSYS))
+            av_log(s, AV_LOG_WARNING, "Asynchronous writes not supported, writing synchronously\n");
+        else if (ret < 0)
+            return ret;
+    }
+
     if (seg->write_header_trailer) {
-        if ((ret = s->io_open(s, &oc->pb,
-                              seg->header_filename ? seg->header_filename : oc->filename,
-                              AVIO_FLAG_WRITE, NULL)) < 0) {
+        if ((ret = segment_io_open(s, &oc->pb,
+                                   seg->header_filename ? seg->header_filename : oc->filename)) < 0) {
             av_log(s, AV_LOG_ERROR, "Failed to open segment '%s'\n", oc->filename);
             return ret;
         }
@@ -794,12 +1033,21 @@ static int seg_init(AVFormatContext *s)
     av_dict_free(&options);
 
     if (ret < 0) {
-        ff_format_io_close(oc, &oc->pb);
+        ff_async_writer_close(seg->writer, oc, &oc->pb, NULL, NULL);
         return ret;
     }
     seg->segment_frame_count = 0;
 
-    av_assert0(s->nb_streams == oc->nb_streams);
+    av_assert0(s->nb_streams == oc->nb_streams + (seg->vtt_stream_index >= 0));
+
+    //PLEX
+    /* the MPEG-TS muxer delays the timestamps, unless told not to */
+    if (seg->vtt_stream_index >= 0 && !strcmp(oc->oformat->name, "mpegts")) {
+        int64_t copyts = -1;
+        av_opt_get_int(oc->priv_data, "mpegts_copyts", 0, &copyts);
+        if (copyts < 1)
+            seg->vtt_mpegts_delay = av_rescale(oc->max_delay, 90000, AV_TIME_BASE) * 2;
+    }
     if (ret == AVSTREAM_INIT_IN_WRITE_HEADER) {
         ret = avformat_write_header(oc, NULL);
         if (ret < 0)
@@ -808,8 +1056,14 @@ static int seg_init(AVFormatContext *s)
     }
 
     for (i = 0; i < s->nb_streams; i++) {
-        AVStream *inner_st  = oc->streams[i];
+        AVStream *inner_st;
         AVStream *outer_st = s->streams[i];
+        //PLEX
+        if (seg->stream_map[i] < 0) {
+            avpriv_set_pts_info(outer_st, 64, 1, 1000);
+            continue;
+        }
+        inner_st = oc->streams[seg->stream_map[i]];
         avpriv_set_pts_info(outer_st, inner_st->pts_wrap_bits, inner_st->time_base.num, inner_st->time_base.den);
     }
 
@@ -827,11 +1081,14 @@ static int seg_write_header(AVFormatContext *s)
 
     if (!seg->header_written) {
         for (i = 0; i < s->nb_streams; i++) {
-            AVStream *st = oc->streams[i];
+            AVStream *st;
             AVCodecParameters *ipar, *opar;
 
+            if (seg->stream_map[i] < 0) //PLEX
+                continue;
+            st   = oc->streams[seg->stream_map[i]];
             ipar = s->streams[i]->codecpar;
-            opar = oc->streams[i]->codecpar;
+            opar = st->codecpar;
             avcodec_parameters_copy(opar, ipar);
             if (!oc->oformat->codec_tag ||
                 av_codec_get_id (oc->oformat->codec_tag, ipar->codec_tag) == opar->codec_id ||
@@ -851,11 +1108,12 @@ static int seg_write_header(AVFormatContext *s)
     if (!seg->write_header_trailer || seg->header_filename) {
         if (seg->header_filename) {
             av_write_frame(oc, NULL);
-            ff_format_io_close(oc, &oc->pb);
+            if ((ret = ff_async_writer_close(seg->writer, oc, &oc->pb, NULL, NULL)) < 0)
+                return ret;
         } else {
             close_null_ctxp(&oc->pb);
         }
-        if ((ret = oc->io_open(oc, &oc->pb, oc->filename, AVIO_FLAG_WRITE, NULL)) < 0)
+        if ((ret = segment_io_open(s, &oc->pb, oc->filename)) < 0)
             return ret;
         if (!seg->individual_header_trailer)
             oc->pb->seekable = 0;
@@ -864,6 +1122,51 @@ static int seg_write_header(AVFormatContext *s)
     return 0;
 }
 
+//PLEX
+/* The caller seeked its input and continues at segment seek_restart: end the
+ * segment in progress and start over as a new process with
+ * segment_start_number would, with an empty segment list. */
+static int seg_seek_restart(AVFormatContext *s, AVPacket *pkt)
+{
+    SegmentContext *seg = s->priv_data;
+    AVStream *st = s->streams[pkt->stream_index];
+    SegmentListEntry *entry;
+    int i, ret;
+
+    if ((ret = segment_end(s, seg->individual_header_trailer, 0)) < 0)
+        return ret;
+
+    while ((entry = seg->segment_list_entries)) {
+        seg->segment_list_entries = entry->next;
+        av_freep(&entry->filename);
+        av_freep(&entry);
+    }
+    seg->segment_list_entries_end = NULL;
+    while (seg->nb_vtt_cues)
+        av_packet_unref(&seg->vtt_cues[--seg->nb_vtt_cues]);
+
+    /* segment_start() moves on to the next index */
+    seg->segment_idx = seg->seek_restart - 1;
+    seg->segment_count = seg->segment_copyts ? seg->seek_restart : 0;
+    seg->seek_restart = -1;
+    if ((ret = segment_start(s, seg->individual_header_trailer)) < 0)
+        return ret;
+    for (i = 0; i < seg->avf->nb_streams; i++)
+        seg->avf->streams[i]->cur_dts = AV_NOPTS_VALUE;
+    /* a shared fragmented mp4 context has to be told the timeline jumps */
+    if (!seg->individual_header_trailer)
+        av_opt_set(seg->avf, "movflags", "+frag_discont", AV_OPT_SEARCH_CHILDREN);
+
+    seg->cut_pending = 0;
+    seg->cur_entry.index = seg->segment_idx + seg->segment_idx_wrap * seg->segment_idx_wrap_nb;
+    seg->cur_entry.start_time = (double)pkt->pts * av_q2d(st->time_base);
+    seg->cur_entry.start_pts = av_rescale_q(pkt->pts, st->time_base, AV_TIME_BASE_Q);
+    seg->cur_entry.end_time = seg->cur_entry.start_time;
+    av_log(s, AV_LOG_VERBOSE, "Restarting at segment %d\n", seg->segment_idx);
+    return 0;
+}
+//PLEX
+
 static int seg_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     SegmentContext *seg = s->priv_data;
@@ -878,6 +1181,13 @@ static int seg_write_packet(AVFormatContext *s, AVPacket *pkt)
     if (!seg->avf)
         return AVERROR(EINVAL);
 
+//PLEX
+    if (seg->seek_restart >= 0 && (ret = seg_seek_restart(s, pkt)) < 0)
+        return ret;
+    if (pkt->stream_index == seg->vtt_stream_index)
+        return vtt_add_cue(s, pkt);
+//PLEX
+
 calc_times:
     if (seg->times) {
         end_pts = seg->segment_count < seg->nb_times ?
@@ -966,7 +1276,7 @@ calc_times:
            av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &st->time_base),
            av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &st->time_base));
 
-    ret = ff_write_chained(seg->avf, pkt->stream_index, pkt, s, seg->initial_offset || seg->reset_timestamps);
+    ret = ff_write_chained(seg->avf, seg->stream_map[pkt->stream_index], pkt, s, seg->initial_offset || seg->reset_timestamps);
 
 fail:
     if (pkt->stream_index == seg->reference_stream_index) {
@@ -982,7 +1292,7 @@ static int seg_write_trailer(struct AVFormatContext *s)
     SegmentContext *seg = s->priv_data;
     AVFormatContext *oc = seg->avf;
     SegmentListEntry *cur, *next;
-    int ret = 0;
+    int ret = 0, err;
 
     if (!oc)
         goto fail;
@@ -999,7 +1309,11 @@ static int seg_write_trailer(struct AVFormatContext *s)
     }
 fail:
     if (seg->list)
-        ff_format_io_close(s, &seg->list_pb);
+        ff_async_writer_close(seg->writer, s, &seg->list_pb, NULL, NULL);
+    //PLEX
+    err = ff_async_writer_free(&seg->writer);
+    if (ret >= 0)
+        ret = err;
 
     av_dict_free(&seg->format_options);
     av_opt_free(seg);
@@ -1024,11 +1338,16 @@ static int seg_check_bitstream(struct AVFormatContext *s, const AVPacket *pkt)
 {
     SegmentContext *seg = s->priv_data;
     AVFormatContext *oc = seg->avf;
+    if (seg->stream_map[pkt->stream_index] < 0) //PLEX
+        return 1;
     if (oc->oformat->check_bitstream) {
-        int ret = oc->oformat->check_bitstream(oc, pkt);
+        AVPacket ipkt = *pkt;
+        int ret;
+        ipkt.stream_index = seg->stream_map[pkt->stream_index];
+        ret = oc->oformat->check_bitstream(oc, &ipkt);
         if (ret == 1) {
             AVStream *st = s->streams[pkt->stream_index];
-            AVStream *ost = oc->streams[pkt->stream_index];
+            AVStream *ost = oc->streams[ipkt.stream_index];
             st->internal->bsfcs = ost->internal->bsfcs;
             st->internal->nb_bsfcs = ost->internal->nb_bsfcs;
             ost->internal->bsfcs = NULL;
@@ -1074,6 +1393,9 @@ static const AVOption options[] = {
     { "segment_start_number", "set the sequence number of the first segment", OFFSET(segment_idx), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, E },
     { "segment_wrap_number", "set the number of wrap before the first segment", OFFSET(segment_idx_wrap_nb), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, E },
     { "segment_copyts",    "adjust timestamps for -copyts setting",      OFFSET(segment_copyts), AV_OPT_TYPE_BOOL,   {.i64 = 0}, 0, 1,       E }, //PLEX
+    { "seek_restart",      "continue at this segment number with the next packet, after the input was seeked", OFFSET(seek_restart), AV_OPT_TYPE_INT, {.i64 = -1}, -1, INT_MAX, E }, //PLEX
+    { "segment_vtt_filename", "write the WebVTT stream to segments of its own, named with the index of the media segments", OFFSET(vtt_filename), AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, E }, //PLEX
+    { "async_write",       "write the files in a separate thread, segments are written non-seekable", OFFSET(async_write), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, E }, //PLEX
     { "strftime",          "set filename expansion with strftime at segment creation", OFFSET(use_strftime), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, E },
     { "increment_tc", "increment timecode between each segment", OFFSET(increment_tc), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, E },
     { "break_non_keyframes", "allow breaking segments on non-keyframes", OFFSET(break_non_keyframes), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, E },
@@ -0,0 +1,168 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Check that the heap based dts interleaver outputs the packets in the same
+ * order as the sorted packet_buffer list it replaces.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avassert.h"
+#include "libavutil/mem.h"
+
+#include "libavformat/avformat.h"
+#include "libavformat/internal.h"
+
+typedef struct TestStream {
+    enum AVMediaType type;
+    enum AVCodecID codec_id;
+    AVRational time_base;
+    int64_t duration;   ///< of each packet, in time_base units
+    int64_t gap;        ///< extra time after each packet, in time_base units
+    int nb_packets;
+} TestStream;
+
+static const TestStream streams[] = {
+    { AVMEDIA_TYPE_VIDEO,    AV_CODEC_ID_MPEG4,  {    1, 90000 },  3600,     0, 25 },
+    { AVMEDIA_TYPE_AUDIO,    AV_CODEC_ID_AAC,    {    1, 48000 },  1024,     0, 47 },
+    { AVMEDIA_TYPE_AUDIO,    AV_CODEC_ID_MP2,    {    1, 44100 },  1152,     0, 38 },
+    /* subtitles with a long gap between the cues */
+    { AVMEDIA_TYPE_SUBTITLE, AV_CODEC_ID_SUBRIP, {    1,  1000 },   200,   600,  2 },
+    /* sparse, the max_interleave_delta check does not wait for it */
+    { AVMEDIA_TYPE_VIDEO,    AV_CODEC_ID_VP8,    { 1001, 30000 },     1,     1,  8 },
+};
+
+#define NB_STREAMS FF_ARRAY_ELEMS(streams)
+
+/**
+ * Check the queued stream counts kept by the interleaver against the
+ * per-stream queues it used to scan for every packet.
+ */
+static void check_queued_streams(AVFormatContext *s)
+{
+    int i, queued = 0, queued_sparse = 0;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        if (!s->streams[i]->last_in_packet_buffer)
+            continue;
+        queued++;
+        queued_sparse += streams[i].codec_id == AV_CODEC_ID_VP8;
+    }
+    av_assert0(s->internal->nb_queued_streams == queued);
+    av_assert0(s->internal->nb_queued_sparse_streams == queued_sparse);
+}
+
+/**
+ * Mux the test streams to framecrc, feeding their packets in a pseudo random
+ * order which keeps each stream in dts order.
+ */
+static int mux(int use_heap, int64_t max_interleave_delta, int audio_preload,
+               uint8_t **buf)
+{
+    AVFormatContext *s = NULL;
+    int sent[NB_STREAMS] = { 0 };
+    unsigned seed = 1;
+    int i, ret, left = 0;
+
+    if ((ret = avformat_alloc_output_context2(&s, NULL, "framecrc", NULL)) < 0)
+        return ret;
+    s->max_interleave_delta = max_interleave_delta;
+    s->audio_preload        = audio_preload;
+    s->flags               |= AVFMT_FLAG_BITEXACT;
+    for (i = 0; i < NB_STREAMS; i++) {
+        AVStream *st = avformat_new_stream(s, NULL);
+        av_assert0(st);
+        st->time_base            = streams[i].time_base;
+        st->codecpar->codec_type = streams[i].type;
+        st->codecpar->codec_id   = streams[i].codec_id;
+        if (streams[i].type == AVMEDIA_TYPE_VIDEO) {
+            st->codecpar->width  = 64;
+            st->codecpar->height = 64;
+        } else if (streams[i].type == AVMEDIA_TYPE_AUDIO) {
+            st->codecpar->sample_rate = streams[i].time_base.den;
+            st->codecpar->channels    = 2;
+        }
+        left += streams[i].nb_packets;
+    }
+    av_assert0(avio_open_dyn_buf(&s->pb) >= 0);
+    if ((ret = avformat_write_header(s, NULL)) < 0)
+        goto end;
+    av_assert0(s->internal->use_interleave_heap);
+    s->internal->use_interleave_heap = use_heap;
+
+    while (left--) {
+        const TestStream *ts;
+        AVPacket pkt;
+
+        do {
+            seed = seed * 1664525 + 1013904223;
+            i = (seed >> 16) % NB_STREAMS;
+        } while (sent[i] == streams[i].nb_packets);
+        ts = &streams[i];
+
+        av_assert0(av_new_packet(&pkt, 4) >= 0);
+        memset(pkt.data, i, pkt.size);
+        pkt.stream_index = i;
+        pkt.dts = pkt.pts = sent[i] * (ts->duration + ts->gap);
+        pkt.duration = ts->duration;
+        pkt.flags = AV_PKT_FLAG_KEY;
+        sent[i]++;
+        av_packet_rescale_ts(&pkt, ts->time_base, s->streams[i]->time_base);
+        if ((ret = av_interleaved_write_frame(s, &pkt)) < 0)
+            goto end;
+        check_queued_streams(s);
+    }
+    ret = av_write_trailer(s);
+
+end:
+    avio_close_dyn_buf(s->pb, buf);
+    avformat_free_context(s);
+    return ret;
+}
+
+int main(void)
+{
+    static const struct {
+        int64_t max_interleave_delta;
+        int audio_preload;
+    } tests[] = {
+        { 10000000,      0 },
+        {   100000,      0 },
+        { 10000000, 300000 },
+        {        0,      0 },
+    };
+    int i;
+
+    av_register_all();
+
+    for (i = 0; i < FF_ARRAY_ELEMS(tests); i++) {
+        uint8_t *heap = NULL, *list = NULL;
+
+        av_assert0(mux(1, tests[i].max_interleave_delta, tests[i].audio_preload, &heap) >= 0);
+        av_assert0(mux(0, tests[i].max_interleave_delta, tests[i].audio_preload, &list) >= 0);
+        printf("max_interleave_delta %"PRId64" audio_preload %d: %s\n",
+               tests[i].max_interleave_delta, tests[i].audio_preload,
+               strcmp((char *)heap, (char *)list) ? "different" : "same");
+        printf("%s", heap);
+        av_free(heap);
+        av_free(list);
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * MPEG-TS demuxing benchmark.
+ *
+ * usage: mpegts capture.ts [program_id [runs]]
+ * The capture is loaded into memory and demuxed runs times, so only the
+ * demuxer is measured. If program_id is given, all other programs are
+ * discarded, as when a single channel is played from a multiplex.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/file.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+#include "libavformat/avformat.h"
+
+typedef struct MemBuffer {
+    const uint8_t *data;
+    size_t size, pos;
+} MemBuffer;
+
+static int mem_read(void *opaque, uint8_t *buf, int size)
+{
+    MemBuffer *mb = opaque;
+    size = FFMIN(size, mb->size - mb->pos);
+    if (!size)
+        return AVERROR_EOF;
+    memcpy(buf, mb->data + mb->pos, size);
+    mb->pos += size;
+    return size;
+}
+
+static int64_t mem_seek(void *opaque, int64_t offset, int whence)
+{
+    MemBuffer *mb = opaque;
+    if (whence == AVSEEK_SIZE)
+        return mb->size;
+    if (whence == SEEK_CUR)
+        offset += mb->pos;
+    else if (whence == SEEK_END)
+        offset += mb->size;
+    if (offset < 0 || offset > mb->size)
+        return AVERROR(EINVAL);
+    mb->pos = offset;
+    return offset;
+}
+
+static int demux(MemBuffer *mb, int program_id, int64_t *nb_packets, int64_t *nb_bytes)
+{
+    AVFormatContext *s = NULL;
+    AVIOContext *pb;
+    AVPacket pkt;
+    int i, ret;
+
+    mb->pos = 0;
+    pb = avio_alloc_context(av_malloc(32768), 32768, 0, mb, mem_read, NULL, mem_seek);
+    s  = avformat_alloc_context();
+    if (!pb || !s) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    s->pb = pb;
+
+    if ((ret = avformat_open_input(&s, NULL, av_find_input_format("mpegts"), NULL)) < 0)
+        goto end;
+    if ((ret = avformat_find_stream_info(s, NULL)) < 0)
+        goto end;
+
+    if (program_id >= 0) {
+        for (i = 0; i < s->nb_programs; i++)
+            if (s->programs[i]->id != program_id)
+                s->programs[i]->discard = AVDISCARD_ALL;
+        for (i = 0; i < s->nb_streams; i++)
+            s->streams[i]->discard = AVDISCARD_ALL;
+        for (i = 0; i < s->nb_programs; i++) {
+            AVProgram *p = s->programs[i];
+            int j;
+            if (p->id != program_id)
+                continue;
+            for (j = 0; j < p->nb_stream_indexes; j++)
+                s->streams[p->stream_index[j]]->discard = AVDISCARD_DEFAULT;
+        }
+    }
+
+    while ((ret = av_read_frame(s, &pkt)) >= 0) {
+        (*nb_packets)++;
+        *nb_bytes += pkt.size;
+        av_packet_unref(&pkt);
+    }
+    if (ret == AVERROR_EOF)
+        ret = 0;
+
+end:
+    avformat_close_input(&s);
+    if (pb)
+        av_freep(&pb->buffer);
+    av_freep(&pb);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    MemBuffer mb = { 0 };
+    uint8_t *data;
+    size_t size;
+    int program_id = argc > 2 ? atoi(argv[2]) : -1;
+    int runs       = argc > 3 ? atoi(argv[3]) : 10;
+    int64_t t0, t1, nb_packets = 0, nb_bytes = 0;
+    int i, ret;
+
+    if (argc < 2 || runs <= 0) {
+        fprintf(stderr, "usage: %s capture.ts [program_id [runs]]\n", argv[0]);
+        return 1;
+    }
+
+    av_register_all();
+
+    if (av_file_map(argv[1], &data, &size, 0, NULL) < 0) {
+        fprintf(stderr, "could not read %s\n", argv[1]);
+        return 1;
+    }
+    mb.data = data;
+    mb.size = size;
+
+    t0 = av_gettime_relative();
+    for (i = 0; i < runs; i++) {
+        if ((ret = demux(&mb, program_id, &nb_packets, &nb_bytes)) < 0) {
+            fprintf(stderr, "demuxing failed: %s\n", av_err2str(ret));
+            av_file_unmap(data, size);
+            return 1;
+        }
+    }
+    t1 = av_gettime_relative();
+
+    printf("%"PRId64" packets, %"PRId64" payload bytes per run, "
+           "%.1f MB/s of transport stream\n",
+           nb_packets / runs, nb_bytes / runs,
+           (double)size * runs / FFMAX(t1 - t0, 1));
+
+    av_file_unmap(data, size);
+    return 0;
+}
@@ -16,9 +16,24 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#define _DEFAULT_SOURCE
+#define _SVID_SOURCE // needed for MAP_ANONYMOUS and MADV_HUGEPAGE
+
 #include <stdint.h>
 #include <string.h>
 
+#include "config.h"
+
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 #include "atomic.h"
 #include "buffer_internal.h"
 #include "common.h"
@@ -89,6 +104,71 @@ AVBufferRef *av_buffer_allocz(int size)
     return ret;
 }
 
+#if HAVE_MMAP && HAVE_SYSCONF && defined(MAP_ANONYMOUS) && defined(MADV_HUGEPAGE)
+#define HUGE_PAGE_SIZE (2 << 20)
+
+static size_t huge_page_threshold;
+
+void av_buffer_huge_page_threshold(size_t size)
+{
+    huge_page_threshold = size;
+}
+
+static void huge_page_free(void *opaque, uint8_t *data)
+{
+    munmap(data, (size_t)opaque);
+}
+
+AVBufferRef *av_buffer_allocz_huge(int size)
+{
+    AVBufferRef *ret;
+    uint8_t *map, *data;
+    size_t page_size, len, head, tail;
+
+    if (!huge_page_threshold || size < huge_page_threshold)
+        return av_buffer_allocz(size);
+
+    page_size = sysconf(_SC_PAGESIZE);
+    len       = FFALIGN((size_t)size, page_size);
+
+    /* Map one huge page more than needed, and keep only the part starting
+     * at a huge page boundary. Only the huge pages fully inside the buffer
+     * can be backed by huge pages, the rest are normal ones. */
+    map = mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+        return av_buffer_allocz(size);
+
+    data = (uint8_t *)FFALIGN((uintptr_t)map, HUGE_PAGE_SIZE);
+    head = data - map;
+    tail = HUGE_PAGE_SIZE - head;
+    if (head)
+        munmap(map, head);
+    if (tail)
+        munmap(data + len, tail);
+
+    /* Without transparent huge page support, this fails and the mapping
+     * is simply backed by normal pages. */
+    madvise(data, len, MADV_HUGEPAGE);
+
+    /* anonymous mappings are zeroed already */
+    ret = av_buffer_create(data, size, huge_page_free, (void *)len, 0);
+    if (!ret)
+        munmap(data, len);
+
+    return ret;
+}
+#else
+void av_buffer_huge_page_threshold(size_t size)
+{
+}
+
+AVBufferRef *av_buffer_allocz_huge(int size)
+{
+    return av_buffer_allocz(size);
+}
+#endif
+
 AVBufferRef *av_buffer_ref(AVBufferRef *buf)
 {
     AVBufferRef *ret = av_mallocz(sizeof(*ret));
@@ -214,6 +294,16 @@ int av_buffer_realloc(AVBufferRef **pbuf, int size)
     return 0;
 }
 
+static void pool_init_magazines(AVBufferPool *pool)
+{
+#if !USE_ATOMICS
+    int i;
+
+    for (i = 0; i < POOL_MAGAZINES; i++)
+        ff_mutex_init(&pool->magazines[i].mutex, NULL);
+#endif
+}
+
 AVBufferPool *av_buffer_pool_init2(int size, void *opaque,
                                    AVBufferRef* (*alloc)(void *opaque, int size),
                                    void (*pool_free)(void *opaque))
@@ -223,6 +313,7 @@ AVBufferPool *av_buffer_pool_init2(int size, void *opaque,
         return NULL;
 
     ff_mutex_init(&pool->mutex, NULL);
+    pool_init_magazines(pool);
 
     pool->size      = size;
     pool->opaque    = opaque;
@@ -241,28 +332,47 @@ AVBufferPool *av_buffer_pool_init(int size, AVBufferRef* (*alloc)(int size))
         return NULL;
 
     ff_mutex_init(&pool->mutex, NULL);
+    pool_init_magazines(pool);
 
     pool->size     = size;
     pool->alloc    = alloc ? alloc : av_buffer_alloc;
+#if !USE_ATOMICS
+    pool->use_magazines = pool->alloc == av_buffer_alloc  ||
+                          pool->alloc == av_buffer_allocz ||
+                          pool->alloc == av_buffer_allocz_huge;
+#endif
 
     avpriv_atomic_int_set(&pool->refcount, 1);
 
     return pool;
 }
 
+static void free_entries(BufferPoolEntry *buf)
+{
+    while (buf) {
+        BufferPoolEntry *next = buf->next;
+
+        buf->free(buf->opaque, buf->data);
+        av_free(buf);
+        buf = next;
+    }
+}
+
 /*
  * This function gets called when the pool has been uninited and
  * all the buffers returned to it.
  */
 static void buffer_pool_free(AVBufferPool *pool)
 {
-    while (pool->pool) {
-        BufferPoolEntry *buf = pool->pool;
-        pool->pool = buf->next;
+#if !USE_ATOMICS
+    int i;
 
-        buf->free(buf->opaque, buf->data);
-        av_freep(&buf);
+    for (i = 0; i < POOL_MAGAZINES; i++) {
+        free_entries(pool->magazines[i].entries);
+        ff_mutex_destroy(&pool->magazines[i].mutex);
     }
+#endif
+    free_entries(pool->pool);
     ff_mutex_destroy(&pool->mutex);
 
     if (pool->pool_free)
@@ -320,6 +430,132 @@ static void add_to_pool(BufferPoolEntry *buf)
             end = end->next;
     }
 }
+#else
+static BufferPoolMagazine *get_magazine(AVBufferPool *pool)
+{
+    /* The stacks of different threads lie far apart, so the address of a
+     * local variable tells the threads apart. */
+    int local;
+    uint32_t id = (uintptr_t)&local >> 16;
+
+    return &pool->magazines[(id * 0x9E3779B1U >> 24) % POOL_MAGAZINES];
+}
+
+/* take up to n buffers off the shared list, and return the last in *last */
+static BufferPoolEntry *get_batch(AVBufferPool *pool, int n,
+                                  BufferPoolEntry **last, int *nb_entries)
+{
+    BufferPoolEntry *buf, *end;
+
+    ff_mutex_lock(&pool->mutex);
+    buf = end = pool->pool;
+    *nb_entries = 0;
+    if (buf) {
+        *nb_entries = 1;
+        while (end->next && *nb_entries < n) {
+            end = end->next;
+            (*nb_entries)++;
+        }
+        pool->pool = end->next;
+        end->next  = NULL;
+    }
+    ff_mutex_unlock(&pool->mutex);
+
+    *last = end;
+    return buf;
+}
+
+static void add_to_pool(BufferPoolEntry *buf)
+{
+    AVBufferPool *pool = buf->pool;
+    BufferPoolMagazine *m;
+    BufferPoolEntry *batch = NULL, *end;
+    int i;
+
+    if (!pool->use_magazines) {
+        ff_mutex_lock(&pool->mutex);
+        buf->next = pool->pool;
+        pool->pool = buf;
+        ff_mutex_unlock(&pool->mutex);
+        return;
+    }
+
+    m = get_magazine(pool);
+    ff_mutex_lock(&m->mutex);
+    buf->next = m->entries;
+    m->entries = buf;
+    if (++m->nb_entries > POOL_MAGAZINE_SIZE) {
+        /* keep the most recently used half, release the rest at once */
+        for (end = m->entries, i = 1; i < POOL_MAGAZINE_SIZE / 2; i++)
+            end = end->next;
+        batch = end->next;
+        end->next = NULL;
+        m->nb_entries = POOL_MAGAZINE_SIZE / 2;
+    }
+    ff_mutex_unlock(&m->mutex);
+
+    if (batch) {
+        for (end = batch; end->next; end = end->next)
+            ;
+        ff_mutex_lock(&pool->mutex);
+        end->next = pool->pool;
+        pool->pool = batch;
+        ff_mutex_unlock(&pool->mutex);
+    }
+}
+
+static BufferPoolEntry *get_from_magazines(AVBufferPool *pool)
+{
+    BufferPoolMagazine *m = get_magazine(pool), *other;
+    BufferPoolEntry *buf, *last;
+    int i, nb_entries;
+
+    ff_mutex_lock(&m->mutex);
+    buf = m->entries;
+    if (buf) {
+        m->entries = buf->next;
+        m->nb_entries--;
+        m->hits++;
+    }
+    ff_mutex_unlock(&m->mutex);
+    if (buf)
+        return buf;
+
+    /* refill the magazine from the shared list */
+    buf = get_batch(pool, POOL_MAGAZINE_SIZE / 2, &last, &nb_entries);
+
+    /* rather than allocating while other threads cache free buffers,
+     * take one of them */
+    for (i = 0; !buf && i < POOL_MAGAZINES; i++) {
+        other = &pool->magazines[i];
+        if (other == m)
+            continue;
+        ff_mutex_lock(&other->mutex);
+        buf = other->entries;
+        if (buf) {
+            other->entries = buf->next;
+            other->nb_entries--;
+        }
+        ff_mutex_unlock(&other->mutex);
+        last = buf;
+        nb_entries = !!buf;
+    }
+
+    ff_mutex_lock(&m->mutex);
+    if (buf) {
+        if (buf != last) {
+            last->next = m->entries;
+            m->entries = buf->next;
+            m->nb_entries += nb_entries - 1;
+        }
+        m->hits++;
+    } else {
+        m->misses++;
+    }
+    ff_mutex_unlock(&m->mutex);
+
+    return buf;
+}
 #endif
 
 static void pool_release_buffer(void *opaque, uint8_t *data)
@@ -330,14 +566,7 @@ static void pool_release_buffer(void *opaque, uint8_t *data)
     if(CONFIG_MEMORY_POISONING)
         memset(buf->data, FF_MEMORY_POISON, pool->size);
 
-#if USE_ATOMICS
     add_to_pool(buf);
-#else
-    ff_mutex_lock(&pool->mutex);
-    buf->next = pool->pool;
-    pool->pool = buf;
-    ff_mutex_unlock(&pool->mutex);
-#endif
 
     if (!avpriv_atomic_int_add_and_fetch(&pool->refcount, -1))
         buffer_pool_free(pool);
@@ -377,6 +606,18 @@ static AVBufferRef *pool_alloc_buffer(AVBufferPool *pool)
     return ret;
 }
 
+static void pool_update_peak(AVBufferPool *pool, int in_use)
+{
+    /* only taking the lock while the peak is still growing */
+    if (in_use <= avpriv_atomic_int_get(&pool->peak))
+        return;
+
+    ff_mutex_lock(&pool->mutex);
+    if (in_use > pool->peak)
+        pool->peak = in_use;
+    ff_mutex_unlock(&pool->mutex);
+}
+
 AVBufferRef *av_buffer_pool_get(AVBufferPool *pool)
 {
     AVBufferRef *ret;
@@ -391,8 +632,12 @@ AVBufferRef *av_buffer_pool_get(AVBufferPool *pool)
             buf = get_pool(pool);
     }
 
-    if (!buf)
+    /* not atomic, the counts are approximate if threads share the pool */
+    if (!buf) {
+        pool->misses++;
         return pool_alloc_buffer(pool);
+    }
+    pool->hits++;
 
     /* keep the first entry, return the rest of the list to the pool */
     add_to_pool(buf->next);
@@ -405,23 +650,67 @@ AVBufferRef *av_buffer_pool_get(AVBufferPool *pool)
         return NULL;
     }
 #else
-    ff_mutex_lock(&pool->mutex);
-    buf = pool->pool;
-    if (buf) {
-        ret = av_buffer_create(buf->data, pool->size, pool_release_buffer,
-                               buf, 0);
-        if (ret) {
-            pool->pool = buf->next;
+    if (pool->use_magazines) {
+        buf = get_from_magazines(pool);
+        if (buf) {
             buf->next = NULL;
+            ret = av_buffer_create(buf->data, pool->size, pool_release_buffer,
+                                   buf, 0);
+            if (!ret)
+                add_to_pool(buf);
+        } else {
+            ff_mutex_lock(&pool->mutex);
+            ret = pool_alloc_buffer(pool);
+            ff_mutex_unlock(&pool->mutex);
         }
     } else {
-        ret = pool_alloc_buffer(pool);
+        ff_mutex_lock(&pool->mutex);
+        buf = pool->pool;
+        if (buf) {
+            ret = av_buffer_create(buf->data, pool->size, pool_release_buffer,
+                                   buf, 0);
+            if (ret) {
+                pool->pool = buf->next;
+                buf->next = NULL;
+            }
+            pool->hits++;
+        } else {
+            ret = pool_alloc_buffer(pool);
+            pool->misses++;
+        }
+        ff_mutex_unlock(&pool->mutex);
     }
-    ff_mutex_unlock(&pool->mutex);
 #endif
 
     if (ret)
-        avpriv_atomic_int_add_and_fetch(&pool->refcount, 1);
+        pool_update_peak(pool, avpriv_atomic_int_add_and_fetch(&pool->refcount, 1) - 1);
 
     return ret;
 }
+
+void av_buffer_pool_get_stats(AVBufferPool *pool, AVBufferPoolStats *stats)
+{
+#if !USE_ATOMICS
+    int i;
+#endif
+
+    memset(stats, 0, sizeof(*stats));
+
+#if !USE_ATOMICS
+    for (i = 0; i < POOL_MAGAZINES; i++) {
+        BufferPoolMagazine *m = &pool->magazines[i];
+
+        ff_mutex_lock(&m->mutex);
+        stats->hits   += m->hits;
+        stats->misses += m->misses;
+        ff_mutex_unlock(&m->mutex);
+    }
+#endif
+    ff_mutex_lock(&pool->mutex);
+    stats->hits   += pool->hits;
+    stats->misses += pool->misses;
+    ff_mutex_unlock(&pool->mutex);
+    /* the caller holds the reference of the pool itself */
+    stats->in_use  = avpriv_atomic_int_get(&pool->refcount) - 1;
+    stats->peak    = avpriv_atomic_int_get(&pool->peak);
+}
@@ -25,6 +25,7 @@
 #ifndef AVUTIL_BUFFER_H
 #define AVUTIL_BUFFER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -106,6 +107,22 @@ AVBufferRef *av_buffer_alloc(int size);
  */
 AVBufferRef *av_buffer_allocz(int size);
 
+/**
+ * Same as av_buffer_allocz(), except that buffers of at least the size set
+ * with av_buffer_huge_page_threshold() are mapped at a 2 MiB boundary and
+ * advised to be backed by transparent huge pages, where the system supports
+ * them. This reduces the TLB misses when accessing large buffers such as
+ * the planes of high resolution video frames.
+ */
+AVBufferRef *av_buffer_allocz_huge(int size);
+
+/**
+ * Set the size from which av_buffer_allocz_huge() uses huge pages. The default
+ * of 0 disables them. This function is not thread-safe, it should be called
+ * before any buffers are allocated.
+ */
+void av_buffer_huge_page_threshold(size_t size);
+
 /**
  * Always treat the buffer as read-only, even when it has only one
  * reference.
@@ -283,6 +300,38 @@ void av_buffer_pool_uninit(AVBufferPool **pool);
  */
 AVBufferRef *av_buffer_pool_get(AVBufferPool *pool);
 
+/**
+ * Statistics of a buffer pool, as returned by av_buffer_pool_get_stats().
+ * It is allocated by the caller, so its size is part of the public ABI: new
+ * fields are only appended, with a major version bump.
+ */
+typedef struct AVBufferPoolStats {
+    /**
+     * Number of av_buffer_pool_get() calls served with a buffer returned to
+     * the pool earlier.
+     */
+    int64_t hits;
+    /**
+     * Number of av_buffer_pool_get() calls for which a new buffer was
+     * allocated.
+     */
+    int64_t misses;
+    /**
+     * Number of buffers currently in use.
+     */
+    int in_use;
+    /**
+     * Largest number of buffers in use at the same time.
+     */
+    int peak;
+} AVBufferPoolStats;
+
+/**
+ * Get the statistics of a buffer pool. This function may be called while
+ * other threads use the pool, the counts are then only approximate.
+ */
+void av_buffer_pool_get_stats(AVBufferPool *pool, AVBufferPoolStats *stats);
+
 /**
  * @}
  */
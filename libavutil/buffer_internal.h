@@ -72,10 +72,51 @@ typedef struct BufferPoolEntry {
     struct BufferPoolEntry *next;
 } BufferPoolEntry;
 
+/*
+ * Number of magazines in front of the shared free list of a pool, and how
+ * many buffers each may cache. Buffers move between a magazine and the
+ * shared list in batches of half that size.
+ */
+#define POOL_MAGAZINES      8
+#define POOL_MAGAZINE_SIZE  8
+
+/*
+ * A small cache of free buffers, used by the threads hashed to it. Taking
+ * its lock is uncontended as long as the threads get different magazines.
+ */
+typedef struct BufferPoolMagazine {
+    AVMutex mutex;
+    BufferPoolEntry *entries;
+    int nb_entries;
+
+    int64_t hits;
+    int64_t misses;
+
+    /* keep the magazines of different threads off each other's cache lines */
+    uint8_t padding[64];
+} BufferPoolMagazine;
+
 struct AVBufferPool {
     AVMutex mutex;
     BufferPoolEntry *pool;
 
+#if !USE_ATOMICS
+    /*
+     * Only used by pools of plain memory: a pool with a custom allocator may
+     * fail to allocate while buffers are kept in the magazines.
+     */
+    int use_magazines;
+    BufferPoolMagazine magazines[POOL_MAGAZINES];
+#endif
+
+    /*
+     * Statistics of the buffers not counted in a magazine, updated under
+     * mutex, and the most buffers in use at once.
+     */
+    int64_t hits;
+    int64_t misses;
+    volatile int peak;
+
     /*
      * This is used to track when the pool is to be freed.
      * The pointer to the pool itself held by the caller is considered to
@@ -27,9 +27,20 @@
 #include "time_internal.h"
 #include "bprint.h"
 
+/* Number of entries from which the keys are hashed. */
+#define DICT_INDEX_MIN 16
+
 struct AVDictionary {
     int count;
     AVDictionaryEntry *elems;
+
+    /*
+     * Open addressing hash table of the keys, folded to upper case, holding
+     * their index in elems plus 1. It is only kept for dictionaries of at
+     * least DICT_INDEX_MIN entries, and used for lookups of whole keys.
+     */
+    unsigned *index;
+    unsigned index_mask;
 };
 
 int av_dict_count(const AVDictionary *m)
@@ -37,6 +48,59 @@ int av_dict_count(const AVDictionary *m)
     return m ? m->count : 0;
 }
 
+static unsigned hash_key(const char *key)
+{
+    unsigned h = 2166136261U;
+
+    for (; *key; key++)
+        h = (h ^ (uint8_t)av_toupper(*key)) * 16777619U;
+    return h;
+}
+
+static void index_insert(AVDictionary *m, unsigned i)
+{
+    unsigned h = hash_key(m->elems[i].key) & m->index_mask;
+
+    while (m->index[h])
+        h = (h + 1) & m->index_mask;
+    m->index[h] = i + 1;
+}
+
+/* rebuild the index after entries were moved, lookups stay linear on failure */
+static void index_rebuild(AVDictionary *m)
+{
+    unsigned size = 2 * DICT_INDEX_MIN, i;
+
+    av_freep(&m->index);
+    if (m->count < DICT_INDEX_MIN)
+        return;
+
+    while (size < 2 * m->count)
+        size <<= 1;
+    if (!(m->index = av_mallocz_array(size, sizeof(*m->index))))
+        return;
+    m->index_mask = size - 1;
+    for (i = 0; i < m->count; i++)
+        index_insert(m, i);
+}
+
+static int match_key(const char *s, const char *key, int flags)
+{
+    unsigned int j;
+
+    if (flags & AV_DICT_MATCH_CASE)
+        for (j = 0; s[j] == key[j] && key[j]; j++)
+            ;
+    else
+        for (j = 0; av_toupper(s[j]) == av_toupper(key[j]) && key[j]; j++)
+            ;
+    if (key[j])
+        return 0;
+    if (s[j] && !(flags & AV_DICT_IGNORE_SUFFIX))
+        return 0;
+    return 1;
+}
+
 AVDictionaryEntry *av_dict_get(const AVDictionary *m, const char *key,
                                const AVDictionaryEntry *prev, int flags)
 {
@@ -50,20 +114,19 @@ AVDictionaryEntry *av_dict_get(const AVDictionary *m, const char *key,
     else
         i = 0;
 
-    for (; i < m->count; i++) {
-        const char *s = m->elems[i].key;
-        if (flags & AV_DICT_MATCH_CASE)
-            for (j = 0; s[j] == key[j] && key[j]; j++)
-                ;
-        else
-            for (j = 0; av_toupper(s[j]) == av_toupper(key[j]) && key[j]; j++)
-                ;
-        if (key[j])
-            continue;
-        if (s[j] && !(flags & AV_DICT_IGNORE_SUFFIX))
-            continue;
-        return &m->elems[i];
+    if (m->index && !(flags & AV_DICT_IGNORE_SUFFIX)) {
+        /* the first match after prev, as the linear search finds it */
+        unsigned first = m->count, h;
+
+        for (h = hash_key(key) & m->index_mask; (j = m->index[h]); h = (h + 1) & m->index_mask)
+            if (--j >= i && j < first && match_key(m->elems[j].key, key, flags))
+                first = j;
+        return first < m->count ? &m->elems[first] : NULL;
     }
+
+    for (; i < m->count; i++)
+        if (match_key(m->elems[i].key, key, flags))
+            return &m->elems[i];
     return NULL;
 }
 
@@ -102,6 +165,8 @@ int av_dict_set(AVDictionary **pm, const char *key, const char *value,
             av_free(tag->value);
         av_free(tag->key);
         *tag = m->elems[--m->count];
+        /* the last entry was moved */
+        av_freep(&m->index);
     } else if (copy_value) {
         AVDictionaryEntry *tmp = av_realloc(m->elems,
                                             (m->count + 1) * sizeof(*m->elems));
@@ -124,8 +189,14 @@ int av_dict_set(AVDictionary **pm, const char *key, const char *value,
             av_freep(&copy_value);
         }
         m->count++;
+        if (m->index && 2 * m->count <= m->index_mask + 1)
+            index_insert(m, m->count - 1);
+        else
+            index_rebuild(m);
     } else {
         av_freep(&copy_key);
+        if (!m->index)
+            index_rebuild(m);
     }
     if (!m->count) {
         av_freep(&m->elems);
@@ -138,6 +209,8 @@ err_out:
     if (m && !m->count) {
         av_freep(&m->elems);
         av_freep(pm);
+    } else if (m && !m->index) {
+        index_rebuild(m);
     }
     av_free(copy_key);
     av_free(copy_value);
@@ -210,6 +283,7 @@ void av_dict_free(AVDictionary **pm)
             av_freep(&m->elems[m->count].value);
         }
         av_freep(&m->elems);
+        av_freep(&m->index);
     }
     av_freep(pm);
 }
@@ -25,9 +25,10 @@ AVDownmixInfo *av_downmix_info_update_side_data(AVFrame *frame)
 {
     AVFrameSideData *side_data;
 
-    side_data = av_frame_get_side_data(frame, AV_FRAME_DATA_DOWNMIX_INFO);
-
-    if (!side_data)
+    /* the side data may be shared with other frames */
+    if (av_frame_get_side_data(frame, AV_FRAME_DATA_DOWNMIX_INFO))
+        side_data = av_frame_get_side_data_writable(frame, AV_FRAME_DATA_DOWNMIX_INFO);
+    else
         side_data = av_frame_new_side_data(frame, AV_FRAME_DATA_DOWNMIX_INFO,
                                            sizeof(AVDownmixInfo));
 
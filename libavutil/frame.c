@@ -285,7 +285,7 @@ int av_frame_get_buffer(AVFrame *frame, int align)
     return AVERROR(EINVAL);
 }
 
-static int frame_copy_props(AVFrame *dst, const AVFrame *src, int force_copy)
+static int frame_copy_props(AVFrame *dst, const AVFrame *src)
 {
     int i;
 
@@ -335,27 +335,20 @@ FF_ENABLE_DEPRECATION_WARNINGS
         if (   sd_src->type == AV_FRAME_DATA_PANSCAN
             && (src->width != dst->width || src->height != dst->height))
             continue;
-        if (force_copy) {
-            sd_dst = av_frame_new_side_data(dst, sd_src->type,
-                                            sd_src->size);
-            if (!sd_dst) {
-                wipe_side_data(dst);
-                return AVERROR(ENOMEM);
-            }
-            memcpy(sd_dst->data, sd_src->data, sd_src->size);
-        } else {
-            sd_dst = av_frame_new_side_data(dst, sd_src->type, 0);
-            if (!sd_dst) {
-                wipe_side_data(dst);
-                return AVERROR(ENOMEM);
-            }
+        /* shared, see av_frame_get_side_data_writable() */
+        sd_dst = av_frame_new_side_data(dst, sd_src->type, 0);
+        if (!sd_dst) {
+            wipe_side_data(dst);
+            return AVERROR(ENOMEM);
+        }
+        if (sd_src->buf) {
             sd_dst->buf = av_buffer_ref(sd_src->buf);
             if (!sd_dst->buf) {
                 wipe_side_data(dst);
                 return AVERROR(ENOMEM);
             }
             sd_dst->data = sd_dst->buf->data;
-            sd_dst->size = sd_dst->buf->size;
+            sd_dst->size = sd_src->size;
         }
         av_dict_copy(&sd_dst->metadata, sd_src->metadata, 0);
     }
@@ -394,7 +387,7 @@ int av_frame_ref(AVFrame *dst, const AVFrame *src)
     dst->channel_layout = src->channel_layout;
     dst->nb_samples     = src->nb_samples;
 
-    ret = frame_copy_props(dst, src, 0);
+    ret = frame_copy_props(dst, src);
     if (ret < 0)
         return ret;
 
@@ -588,7 +581,7 @@ int av_frame_make_writable(AVFrame *frame)
 
 int av_frame_copy_props(AVFrame *dst, const AVFrame *src)
 {
-    return frame_copy_props(dst, src, 1);
+    return frame_copy_props(dst, src);
 }
 
 AVBufferRef *av_frame_get_plane_buffer(AVFrame *frame, int plane)
@@ -670,6 +663,19 @@ AVFrameSideData *av_frame_get_side_data(const AVFrame *frame,
     return NULL;
 }
 
+AVFrameSideData *av_frame_get_side_data_writable(AVFrame *frame,
+                                                 enum AVFrameSideDataType type)
+{
+    AVFrameSideData *sd = av_frame_get_side_data(frame, type);
+
+    if (!sd || av_buffer_is_writable(sd->buf))
+        return sd;
+    if (av_buffer_make_writable(&sd->buf) < 0)
+        return NULL;
+    sd->data = sd->buf->data;
+    return sd;
+}
+
 static int frame_copy_video(AVFrame *dst, const AVFrame *src)
 {
     const uint8_t *src_data[4];
@@ -703,7 +703,8 @@ int av_frame_copy(AVFrame *dst, const AVFrame *src);
  * Metadata for the purpose of this function are those fields that do not affect
  * the data layout in the buffers.  E.g. pts, sample rate (for audio) or sample
  * aspect ratio (for video), but not width/height or channel layout.
- * Side data is also copied.
+ * Side data is also copied, sharing the payloads with src as av_frame_ref()
+ * does; use av_frame_get_side_data_writable() to modify them.
  */
 int av_frame_copy_props(AVFrame *dst, const AVFrame *src);
 
@@ -737,6 +738,18 @@ AVFrameSideData *av_frame_new_side_data(AVFrame *frame,
 AVFrameSideData *av_frame_get_side_data(const AVFrame *frame,
                                         enum AVFrameSideDataType type);
 
+/**
+ * Same as av_frame_get_side_data(), but make sure the payload can be modified
+ * without affecting other frames. The payloads are shared between the frames
+ * copied by av_frame_ref() and av_frame_copy_props(); a shared payload is
+ * copied.
+ *
+ * @return the side data, or NULL if there is no side data with such type in
+ *         this frame or on allocation failure
+ */
+AVFrameSideData *av_frame_get_side_data_writable(AVFrame *frame,
+                                                 enum AVFrameSideDataType type);
+
 /**
  * If side data of the supplied type exists in the frame, free it and remove it
  * from the frame.
@@ -27,6 +27,7 @@
 
 #include "avutil.h"
 #include "avassert.h"
+#include "atomic.h"
 #include "avstring.h"
 #include "channel_layout.h"
 #include "common.h"
@@ -1569,11 +1570,131 @@ const AVOption *av_opt_find(void *obj, const char *name, const char *unit,
     return av_opt_find2(obj, name, unit, opt_flags, search_flags, NULL);
 }
 
+/* Number of options from which the options of a class are hashed. */
+#define OPT_INDEX_MIN 16
+/* Number of classes indexed at most, others are searched linearly. */
+#define OPT_INDEX_MAX 512
+
+/*
+ * The options of a class hashed by name, in an open addressing table. The
+ * indexes are built on first use and kept until av_opt_free_indexes(), in a
+ * hash table of classes which is only prepended to, without locking.
+ */
+typedef struct OptionIndex {
+    const AVClass  *class;
+    /* what the index was built for, so that another class allocated at the
+     * same address is not taken for it */
+    const AVOption *options;
+    const char     *class_name;
+    const char     *last_name;  ///< name of the last option
+    int nb_options;
+    const AVOption **table;     ///< NULL for classes with few options
+    unsigned mask;
+    struct OptionIndex *next;
+} OptionIndex;
+
+static OptionIndex *volatile option_indexes[64];
+static volatile int nb_option_indexes;
+
+static unsigned hash_name(const char *name)
+{
+    unsigned h = 2166136261U;
+
+    for (; *name; name++)
+        h = (h ^ (uint8_t)*name) * 16777619U;
+    return h;
+}
+
+static int option_index_matches(const OptionIndex *idx, const AVClass *c)
+{
+    return idx->class == c && idx->options == c->option &&
+           idx->class_name == c->class_name &&
+           (!idx->nb_options ||
+            (c->option[idx->nb_options - 1].name == idx->last_name &&
+             !c->option[idx->nb_options].name));
+}
+
+static const OptionIndex *get_option_index(const AVClass *c)
+{
+    OptionIndex *volatile *bucket = &option_indexes[((uintptr_t)c >> 4) % FF_ARRAY_ELEMS(option_indexes)];
+    OptionIndex *idx, *head;
+    const AVOption *o;
+    unsigned size = 2 * OPT_INDEX_MIN, h;
+
+    for (idx = *bucket; idx; idx = idx->next)
+        if (option_index_matches(idx, c))
+            return idx;
+
+    if (avpriv_atomic_int_add_and_fetch(&nb_option_indexes, 1) > OPT_INDEX_MAX)
+        goto fail;
+    if (!(idx = av_mallocz(sizeof(*idx))))
+        goto fail;
+    idx->class      = c;
+    idx->options    = c->option;
+    idx->class_name = c->class_name;
+
+    for (o = c->option; o && o->name; o++)
+        idx->nb_options++;
+    if (idx->nb_options)
+        idx->last_name = c->option[idx->nb_options - 1].name;
+    if (idx->nb_options >= OPT_INDEX_MIN) {
+        while (size < 2 * idx->nb_options)
+            size <<= 1;
+        if (!(idx->table = av_mallocz_array(size, sizeof(*idx->table)))) {
+            av_free(idx);
+            goto fail;
+        }
+        idx->mask = size - 1;
+        for (o = c->option; o->name; o++) {
+            for (h = hash_name(o->name) & idx->mask; idx->table[h]; h = (h + 1) & idx->mask)
+                ;
+            idx->table[h] = o;
+        }
+    }
+
+    do {
+        head = *bucket;
+        idx->next = head;
+    } while (avpriv_atomic_ptr_cas((void * volatile *)bucket, head, idx) != head);
+
+    return idx;
+
+fail:
+    avpriv_atomic_int_add_and_fetch(&nb_option_indexes, -1);
+    return NULL;
+}
+
+void av_opt_free_indexes(void)
+{
+    int i;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(option_indexes); i++) {
+        OptionIndex *idx = option_indexes[i], *next;
+
+        option_indexes[i] = NULL;
+        for (; idx; idx = next) {
+            next = idx->next;
+            av_free(idx->table);
+            av_free(idx);
+        }
+    }
+    nb_option_indexes = 0;
+}
+
+static int option_matches(const AVOption *o, const char *name, const char *unit,
+                          int opt_flags)
+{
+    return !strcmp(o->name, name) && (o->flags & opt_flags) == opt_flags &&
+           ((!unit && o->type != AV_OPT_TYPE_CONST) ||
+            (unit  && o->type == AV_OPT_TYPE_CONST && o->unit && !strcmp(o->unit, unit)));
+}
+
 const AVOption *av_opt_find2(void *obj, const char *name, const char *unit,
                              int opt_flags, int search_flags, void **target_obj)
 {
     const AVClass  *c;
     const AVOption *o = NULL;
+    const OptionIndex *idx;
 
     if(!obj)
         return NULL;
@@ -1597,20 +1718,28 @@ const AVOption *av_opt_find2(void *obj, const char *name, const char *unit,
         }
     }
 
-    while (o = av_opt_next(obj, o)) {
-        if (!strcmp(o->name, name) && (o->flags & opt_flags) == opt_flags &&
-            ((!unit && o->type != AV_OPT_TYPE_CONST) ||
-             (unit  && o->type == AV_OPT_TYPE_CONST && o->unit && !strcmp(o->unit, unit)))) {
-            if (target_obj) {
-                if (!(search_flags & AV_OPT_SEARCH_FAKE_OBJ))
-                    *target_obj = obj;
-                else
-                    *target_obj = NULL;
-            }
-            return o;
-        }
+    if ((idx = get_option_index(c)) && idx->table) {
+        /* the first match in the array, as the linear search finds it */
+        const AVOption *first = NULL;
+        unsigned h;
+
+        for (h = hash_name(name) & idx->mask; (o = idx->table[h]); h = (h + 1) & idx->mask)
+            if ((!first || o < first) && option_matches(o, name, unit, opt_flags))
+                first = o;
+        o = first;
+    } else {
+        while (o = av_opt_next(obj, o))
+            if (option_matches(o, name, unit, opt_flags))
+                break;
     }
-    return NULL;
+
+    if (o && target_obj) {
+        if (!(search_flags & AV_OPT_SEARCH_FAKE_OBJ))
+            *target_obj = obj;
+        else
+            *target_obj = NULL;
+    }
+    return o;
 }
 
 void *av_opt_child_next(void *obj, void *prev)
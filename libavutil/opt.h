@@ -625,6 +625,15 @@ const AVOption *av_opt_find(void *obj, const char *name, const char *unit,
 const AVOption *av_opt_find2(void *obj, const char *name, const char *unit,
                              int opt_flags, int search_flags, void **target_obj);
 
+/**
+ * Free the indexes av_opt_find2() builds to look up the options of a class by
+ * name. They are built again on the next lookup.
+ *
+ * No other thread may use the AVOption API while this is called. Call it
+ * e.g. before exiting, so that the indexes are not reported as leaked.
+ */
+void av_opt_free_indexes(void);
+
 /**
  * Iterate over all AVOptions belonging to obj.
  *
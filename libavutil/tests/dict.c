@@ -28,6 +28,21 @@ static void print_dict(const AVDictionary *m)
     printf("\n");
 }
 
+/* look up with the index, and check it finds what the linear search does */
+static AVDictionaryEntry *get_checked(AVDictionary *m, const char *key,
+                                      AVDictionaryEntry *prev, int flags)
+{
+    AVDictionaryEntry *e = av_dict_get(m, key, prev, flags);
+    unsigned *index = m->index;
+
+    m->index = NULL;
+    if (av_dict_get(m, key, prev, flags) != e)
+        printf("hashed lookup of %s differs from linear search\n", key);
+    m->index = index;
+
+    return e;
+}
+
 static void test_separators(const AVDictionary *m, const char pair, const char val)
 {
     AVDictionary *dict = NULL;
@@ -51,6 +66,8 @@ int main(void)
     AVDictionary *dict = NULL;
     AVDictionaryEntry *e;
     char *buffer = NULL;
+    static const char *const keys[] = { "key0", "KEY7", "key3", "key5", "key39", "key", "dup" };
+    int i;
 
     printf("Testing av_dict_get_string() and av_dict_parse_string()\n");
     av_dict_get_string(dict, &buffer, '=', ',');
@@ -129,5 +146,39 @@ int main(void)
     printf("%s\n", e->value);
     av_dict_free(&dict);
 
+    printf("\nTesting av_dict_get() on a hashed dictionary\n");
+    for (i = 0; i < 40; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", i);
+        av_dict_set_int(&dict, key, i, 0);
+    }
+    av_dict_set(&dict, "KEY7", "seven", 0);
+    av_dict_set(&dict, "key3", NULL, 0);
+    av_dict_set(&dict, "key5", "five", AV_DICT_APPEND);
+    av_dict_set(&dict, "dup", "1", AV_DICT_MULTIKEY);
+    av_dict_set(&dict, "dup", "2", AV_DICT_MULTIKEY);
+    printf("%d %s\n", av_dict_count(dict), dict->index ? "hashed" : "linear");
+    for (i = 0; i < FF_ARRAY_ELEMS(keys); i++) {
+        e = get_checked(dict, keys[i], NULL, 0);
+        printf("%s: %s\n", keys[i], e ? e->value : "(null)");
+    }
+    e = get_checked(dict, "Key7", NULL, AV_DICT_MATCH_CASE);
+    printf("Key7 matching case: %s\n", e ? e->value : "(null)");
+    e = NULL;
+    while ((e = get_checked(dict, "DUP", e, 0)))
+        printf("DUP: %s\n", e->value);
+    e = NULL;
+    while ((e = get_checked(dict, "key1", e, AV_DICT_IGNORE_SUFFIX)))
+        printf("key1*: %s %s\n", e->key, e->value);
+    for (i = 0; i < 30; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", i);
+        av_dict_set(&dict, key, NULL, 0);
+    }
+    printf("%d %s\n", av_dict_count(dict), dict->index ? "hashed" : "linear");
+    e = get_checked(dict, "key39", NULL, 0);
+    printf("key39: %s\n", e ? e->value : "(null)");
+    av_dict_free(&dict);
+
     return 0;
 }
@@ -0,0 +1,75 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avassert.h"
+#include "libavutil/downmix_info.h"
+#include "libavutil/frame.h"
+
+int main(void)
+{
+    AVFrame *a = av_frame_alloc(), *b = av_frame_alloc(), *c = av_frame_alloc();
+    AVFrameSideData *sd_a, *sd_b;
+    AVDownmixInfo *di;
+
+    av_assert0(a && b && c);
+
+    sd_a = av_frame_new_side_data(a, AV_FRAME_DATA_REPLAYGAIN, 16);
+    av_assert0(sd_a);
+    memset(sd_a->data, 1, sd_a->size);
+    av_assert0(av_frame_new_side_data(a, AV_FRAME_DATA_AFD, 0));
+    di = av_downmix_info_update_side_data(a);
+    av_assert0(di);
+    di->center_mix_level = 0.5;
+
+    /* copied properties share the side data payloads */
+    av_assert0(av_frame_copy_props(b, a) >= 0);
+    av_assert0(av_frame_copy_props(c, a) >= 0);
+    sd_b = av_frame_get_side_data(b, AV_FRAME_DATA_REPLAYGAIN);
+    av_assert0(sd_b && sd_b->data == sd_a->data && sd_b->size == 16);
+    sd_b = av_frame_get_side_data(b, AV_FRAME_DATA_AFD);
+    av_assert0(sd_b && !sd_b->buf && !sd_b->size);
+
+    /* a writer gets its own copy, the others keep the original */
+    sd_b = av_frame_get_side_data_writable(b, AV_FRAME_DATA_REPLAYGAIN);
+    av_assert0(sd_b && sd_b->data != sd_a->data && sd_b->size == 16);
+    sd_b->data[0] = 2;
+    av_assert0(sd_a->data[0] == 1);
+    av_assert0(av_frame_get_side_data(c, AV_FRAME_DATA_REPLAYGAIN)->data == sd_a->data);
+
+    di = av_downmix_info_update_side_data(b);
+    av_assert0(di);
+    di->center_mix_level = 0.25;
+    di = (AVDownmixInfo *)av_frame_get_side_data(a, AV_FRAME_DATA_DOWNMIX_INFO)->data;
+    av_assert0(di->center_mix_level == 0.5);
+    di = (AVDownmixInfo *)av_frame_get_side_data(c, AV_FRAME_DATA_DOWNMIX_INFO)->data;
+    av_assert0(di->center_mix_level == 0.5);
+    av_assert0(b->nb_side_data == a->nb_side_data);
+
+    /* the last reference is written in place */
+    av_frame_free(&c);
+    av_assert0(av_frame_get_side_data_writable(a, AV_FRAME_DATA_REPLAYGAIN) == sd_a);
+    av_assert0(sd_a->data[0] == 1);
+
+    av_frame_free(&a);
+    av_frame_free(&b);
+    printf("side data: ok\n");
+    return 0;
+}
@@ -308,5 +308,34 @@ int main(void)
         av_opt_free(&test_ctx);
     }
 
+    printf("\nTesting av_opt_find() in a class changed at the same address\n");
+    {
+        AVClass *class = av_memdup(&test_class, sizeof(test_class));
+        AVOption *options = av_memdup(test_options, sizeof(test_options));
+        const AVOption *o;
+
+        class->option = options;
+        o = av_opt_find(&class, "num", NULL, 0, AV_OPT_SEARCH_FAKE_OBJ);
+        printf("num: %s\n", o ? o->help : "not found");
+
+        /* as if freed and allocated again with other options */
+        options[0].name    = "renum";
+        options[0].help    = "set renum";
+        class->class_name  = "OtherContext";
+        o = av_opt_find(&class, "num", NULL, 0, AV_OPT_SEARCH_FAKE_OBJ);
+        printf("num: %s\n", o ? o->help : "not found");
+        o = av_opt_find(&class, "renum", NULL, 0, AV_OPT_SEARCH_FAKE_OBJ);
+        printf("renum: %s\n", o ? o->help : "not found");
+
+        av_opt_free_indexes();
+        o = av_opt_find(&class, "renum", NULL, 0, AV_OPT_SEARCH_FAKE_OBJ);
+        printf("renum after av_opt_free_indexes(): %s\n", o ? o->help : "not found");
+
+        av_free(options);
+        av_free(class);
+    }
+
+    av_opt_free_indexes();
+
     return 0;
 }
@@ -0,0 +1,235 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Message queue tests and throughput benchmark.
+ *
+ * Without arguments, the default, MPSC and SPSC queues are checked for
+ * message ordering, non-blocking operation, error codes and the free
+ * callback.
+ *
+ * usage: threadmessage [senders [messages [queue_size]]]
+ * Each sender sends messages packet sized messages to one receiver, through
+ * a default queue and through a ring buffer queue (SPSC with one sender,
+ * MPSC otherwise), and the messages received per second are printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/avassert.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
+#include "libavutil/time.h"
+
+typedef struct Message {
+    int64_t seq;
+    uint8_t payload[80];
+} Message;
+
+typedef struct Sender {
+    pthread_t thread;
+    AVThreadMessageQueue *queue;
+    int messages;
+    int id;
+} Sender;
+
+static int nb_freed;
+
+static void free_message(void *msg)
+{
+    nb_freed++;
+}
+
+static void *sender_thread(void *arg)
+{
+    Sender *s = arg;
+    Message msg = { 0 };
+    int i;
+
+    msg.payload[0] = s->id;
+    for (i = 0; i < s->messages; i++) {
+        msg.seq = i;
+        if (av_thread_message_queue_send(s->queue, &msg, 0) < 0)
+            break;
+    }
+    return NULL;
+}
+
+static int run(const char *name, unsigned flags, int nb_senders,
+               int messages, int queue_size)
+{
+    AVThreadMessageQueue *queue;
+    Sender *senders;
+    Message msg;
+    int64_t t0, t1, total = (int64_t)nb_senders * messages, i;
+    int ret;
+
+    if ((ret = av_thread_message_queue_alloc2(&queue, queue_size,
+                                              sizeof(Message), flags)) < 0)
+        return ret;
+    if (!(senders = av_mallocz_array(nb_senders, sizeof(*senders)))) {
+        av_thread_message_queue_free(&queue);
+        return AVERROR(ENOMEM);
+    }
+
+    t0 = av_gettime_relative();
+    for (i = 0; i < nb_senders; i++) {
+        senders[i].queue    = queue;
+        senders[i].messages = messages;
+        if ((ret = pthread_create(&senders[i].thread, NULL, sender_thread,
+                                  &senders[i]))) {
+            av_thread_message_queue_set_err_send(queue, AVERROR_EOF);
+            nb_senders = i;
+            total = 0;
+            ret = AVERROR(ret);
+            break;
+        }
+    }
+    for (i = 0; i < total; i++) {
+        ret = av_thread_message_queue_recv(queue, &msg, 0);
+        av_assert0(ret >= 0 && msg.seq < messages);
+    }
+    t1 = av_gettime_relative();
+    for (i = 0; i < nb_senders; i++)
+        pthread_join(senders[i].thread, NULL);
+
+    if (ret >= 0)
+        printf("%-8s %10.0f messages/s\n", name,
+               total * 1000000.0 / FFMAX(t1 - t0, 1));
+
+    av_free(senders);
+    av_thread_message_queue_free(&queue);
+    return ret;
+}
+
+static void test_queue(const char *name, unsigned flags)
+{
+    AVThreadMessageQueue *queue;
+    Sender senders[4] = { { 0 } };
+    Message msg = { 0 };
+    int64_t next[4] = { 0 };
+    int nb_senders = flags & AV_THREAD_MESSAGE_QUEUE_SPSC ? 1 : 4;
+    int i, j, ret;
+
+    ret = av_thread_message_queue_alloc2(&queue, 4, sizeof(Message), flags);
+    av_assert0(ret >= 0);
+    av_thread_message_queue_set_free_func(queue, free_message);
+
+    /* ordering across wrap-arounds, full and empty queues */
+    for (i = 0; i < 10; i++) {
+        for (j = 0; j < 3 + i % 2; j++) {
+            msg.seq = i * 4 + j;
+            av_assert0(av_thread_message_queue_send(queue, &msg, AV_THREAD_MESSAGE_NONBLOCK) >= 0);
+        }
+        if (j == 4) {
+            ret = av_thread_message_queue_send(queue, &msg, AV_THREAD_MESSAGE_NONBLOCK);
+            av_assert0(ret == AVERROR(EAGAIN));
+        }
+        for (j = 0; j < 3 + i % 2; j++) {
+            av_assert0(av_thread_message_queue_recv(queue, &msg, AV_THREAD_MESSAGE_NONBLOCK) >= 0);
+            av_assert0(msg.seq == i * 4 + j);
+        }
+        ret = av_thread_message_queue_recv(queue, &msg, AV_THREAD_MESSAGE_NONBLOCK);
+        av_assert0(ret == AVERROR(EAGAIN));
+    }
+
+    /* the free callback is called for the flushed messages only */
+    nb_freed = 0;
+    for (i = 0; i < 3; i++)
+        av_assert0(av_thread_message_queue_send(queue, &msg, 0) >= 0);
+    av_thread_message_flush(queue);
+    av_assert0(nb_freed == 3);
+    ret = av_thread_message_queue_recv(queue, &msg, AV_THREAD_MESSAGE_NONBLOCK);
+    av_assert0(ret == AVERROR(EAGAIN));
+
+    /* the receiving error is returned once the queue is empty */
+    msg.seq = 42;
+    av_assert0(av_thread_message_queue_send(queue, &msg, 0) >= 0);
+    av_thread_message_queue_set_err_recv(queue, AVERROR_EOF);
+    av_assert0(av_thread_message_queue_recv(queue, &msg, 0) >= 0 && msg.seq == 42);
+    av_assert0(av_thread_message_queue_recv(queue, &msg, 0) == AVERROR_EOF);
+    av_assert0(av_thread_message_queue_recv(queue, &msg, AV_THREAD_MESSAGE_NONBLOCK) == AVERROR_EOF);
+    av_thread_message_queue_set_err_recv(queue, 0);
+
+    /* the sending error is returned right away */
+    av_thread_message_queue_set_err_send(queue, AVERROR_EOF);
+    av_assert0(av_thread_message_queue_send(queue, &msg, 0) == AVERROR_EOF);
+    av_thread_message_queue_set_err_send(queue, 0);
+
+    /* concurrent senders, each sender's messages are received in order */
+    for (i = 0; i < nb_senders; i++) {
+        senders[i].queue    = queue;
+        senders[i].messages = 10000;
+        senders[i].id       = i;
+        av_assert0(!pthread_create(&senders[i].thread, NULL, sender_thread, &senders[i]));
+    }
+    for (i = 0; i < nb_senders * 10000; i++) {
+        av_assert0(av_thread_message_queue_recv(queue, &msg, 0) >= 0);
+        av_assert0(msg.payload[0] < nb_senders && msg.seq == next[msg.payload[0]]++);
+    }
+    for (i = 0; i < nb_senders; i++)
+        pthread_join(senders[i].thread, NULL);
+
+    /* a blocked sender is woken up by the sending error */
+    for (i = 0; i < 4; i++)
+        av_assert0(av_thread_message_queue_send(queue, &msg, 0) >= 0);
+    senders[0].messages = 1;
+    av_assert0(!pthread_create(&senders[0].thread, NULL, sender_thread, &senders[0]));
+    av_thread_message_queue_set_err_send(queue, AVERROR_EOF);
+    pthread_join(senders[0].thread, NULL);
+
+    /* the messages left are freed with the queue */
+    nb_freed = 0;
+    av_thread_message_queue_free(&queue);
+    av_assert0(nb_freed == 4);
+
+    printf("%s: ok\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    int nb_senders = argc > 1 ? atoi(argv[1]) : 1;
+    int messages   = argc > 2 ? atoi(argv[2]) : 1000000;
+    int queue_size = argc > 3 ? atoi(argv[3]) : 8;
+    int ret;
+
+    if (argc <= 1) {
+        test_queue("default", 0);
+        test_queue("mpsc", AV_THREAD_MESSAGE_QUEUE_MPSC);
+        test_queue("spsc", AV_THREAD_MESSAGE_QUEUE_SPSC);
+        return 0;
+    }
+
+    if (nb_senders <= 0 || messages <= 0 || queue_size <= 0) {
+        fprintf(stderr, "usage: %s [senders [messages [queue_size]]]\n", argv[0]);
+        return 1;
+    }
+
+    if ((ret = run("default", 0, nb_senders, messages, queue_size)) >= 0)
+        ret = nb_senders > 1 ?
+              run("mpsc", AV_THREAD_MESSAGE_QUEUE_MPSC, nb_senders, messages, queue_size) :
+              run("spsc", AV_THREAD_MESSAGE_QUEUE_SPSC, nb_senders, messages, queue_size);
+    if (ret < 0) {
+        fprintf(stderr, "%s\n", av_err2str(ret));
+        return 1;
+    }
+    return 0;
+}
@@ -18,20 +18,44 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <string.h>
+
+#include "atomic.h"
 #include "fifo.h"
 #include "threadmessage.h"
 #include "thread.h"
 
+#define AV_THREAD_MESSAGE_QUEUE_RING (AV_THREAD_MESSAGE_QUEUE_MPSC | \
+                                      AV_THREAD_MESSAGE_QUEUE_SPSC)
+
 struct AVThreadMessageQueue {
 #if HAVE_THREADS
     AVFifoBuffer *fifo;
     pthread_mutex_t lock;
     pthread_cond_t cond_recv;
     pthread_cond_t cond_send;
-    int err_send;
-    int err_recv;
+    volatile int err_send;
+    volatile int err_recv;
     unsigned elsize;
     void (*free_func)(void *msg);
+
+    /*
+     * Ring buffer used instead of the fifo by single receiver queues. The
+     * messages are written and read without locking; lock and the condition
+     * variables are only used to wait on a full or empty ring, and signaled
+     * only when the other side waits.
+     */
+    unsigned flags;
+    uint8_t *ring;
+    unsigned nelem;             ///< ring size, 0 if the fifo is used
+    pthread_mutex_t send_lock;  ///< serializes the senders of MPSC queues
+    /* message counters modulo 2 * nelem, each only advanced by one side */
+    volatile int sent;
+    uint8_t padding0[64];
+    volatile int received;
+    uint8_t padding1[64];
+    volatile int recv_waiting;
+    volatile int send_waiting;
 #else
     int dummy;
 #endif
@@ -40,6 +64,14 @@ struct AVThreadMessageQueue {
 int av_thread_message_queue_alloc(AVThreadMessageQueue **mq,
                                   unsigned nelem,
                                   unsigned elsize)
+{
+    return av_thread_message_queue_alloc2(mq, nelem, elsize, 0);
+}
+
+int av_thread_message_queue_alloc2(AVThreadMessageQueue **mq,
+                                   unsigned nelem,
+                                   unsigned elsize,
+                                   unsigned flags)
 {
 #if HAVE_THREADS
     AVThreadMessageQueue *rmq;
@@ -49,27 +81,49 @@ int av_thread_message_queue_alloc(AVThreadMessageQueue **mq,
         return AVERROR(EINVAL);
     if (!(rmq = av_mallocz(sizeof(*rmq))))
         return AVERROR(ENOMEM);
+    if (flags & AV_THREAD_MESSAGE_QUEUE_RING) {
+        /* the counters run up to twice the size to tell a full ring from an
+         * empty one */
+        if (!nelem || nelem > INT_MAX / 2) {
+            av_free(rmq);
+            return AVERROR(EINVAL);
+        }
+        rmq->flags = flags;
+        rmq->nelem = nelem;
+    }
     if ((ret = pthread_mutex_init(&rmq->lock, NULL))) {
         av_free(rmq);
         return AVERROR(ret);
     }
+    if ((ret = pthread_mutex_init(&rmq->send_lock, NULL))) {
+        pthread_mutex_destroy(&rmq->lock);
+        av_free(rmq);
+        return AVERROR(ret);
+    }
     if ((ret = pthread_cond_init(&rmq->cond_recv, NULL))) {
+        pthread_mutex_destroy(&rmq->send_lock);
         pthread_mutex_destroy(&rmq->lock);
         av_free(rmq);
         return AVERROR(ret);
     }
     if ((ret = pthread_cond_init(&rmq->cond_send, NULL))) {
         pthread_cond_destroy(&rmq->cond_recv);
+        pthread_mutex_destroy(&rmq->send_lock);
         pthread_mutex_destroy(&rmq->lock);
         av_free(rmq);
         return AVERROR(ret);
     }
-    if (!(rmq->fifo = av_fifo_alloc(elsize * nelem))) {
+    if (rmq->nelem)
+        rmq->ring = av_malloc_array(nelem, elsize);
+    else
+        rmq->fifo = av_fifo_alloc(elsize * nelem);
+    if (!rmq->ring && !rmq->fifo) {
         pthread_cond_destroy(&rmq->cond_send);
         pthread_cond_destroy(&rmq->cond_recv);
+        pthread_mutex_destroy(&rmq->send_lock);
         pthread_mutex_destroy(&rmq->lock);
         av_free(rmq);
-        return AVERROR(ret);
+        return AVERROR(ENOMEM);
     }
     rmq->elsize = elsize;
     *mq = rmq;
@@ -94,8 +148,10 @@ void av_thread_message_queue_free(AVThreadMessageQueue **mq)
     if (*mq) {
         av_thread_message_flush(*mq);
         av_fifo_freep(&(*mq)->fifo);
+        av_freep(&(*mq)->ring);
         pthread_cond_destroy(&(*mq)->cond_send);
         pthread_cond_destroy(&(*mq)->cond_recv);
+        pthread_mutex_destroy(&(*mq)->send_lock);
         pthread_mutex_destroy(&(*mq)->lock);
         av_freep(mq);
     }
@@ -104,6 +160,86 @@ void av_thread_message_queue_free(AVThreadMessageQueue **mq)
 
 #if HAVE_THREADS
 
+static unsigned ring_next(const AVThreadMessageQueue *mq, unsigned n)
+{
+    return n + 1 < 2 * mq->nelem ? n + 1 : 0;
+}
+
+static uint8_t *ring_slot(const AVThreadMessageQueue *mq, unsigned n)
+{
+    return mq->ring + (n < mq->nelem ? n : n - mq->nelem) * mq->elsize;
+}
+
+static int ring_full(AVThreadMessageQueue *mq, unsigned sent)
+{
+    unsigned received = avpriv_atomic_int_get(&mq->received);
+    return (sent >= received ? sent - received
+                             : sent + 2 * mq->nelem - received) >= mq->nelem;
+}
+
+/* Only one sender gets here at a time. */
+static int ring_send(AVThreadMessageQueue *mq, void *msg, unsigned flags)
+{
+    unsigned sent = mq->sent;
+    int ret;
+
+    while (ring_full(mq, sent)) {
+        if ((ret = mq->err_send))
+            return ret;
+        if ((flags & AV_THREAD_MESSAGE_NONBLOCK))
+            return AVERROR(EAGAIN);
+        /* The receiver reads send_waiting after advancing its counter, so
+         * either the ring is seen non-full below or the receiver signals. */
+        pthread_mutex_lock(&mq->lock);
+        avpriv_atomic_int_set(&mq->send_waiting, 1);
+        if (!mq->err_send && ring_full(mq, sent))
+            pthread_cond_wait(&mq->cond_send, &mq->lock);
+        mq->send_waiting = 0;
+        pthread_mutex_unlock(&mq->lock);
+    }
+    if ((ret = mq->err_send))
+        return ret;
+    memcpy(ring_slot(mq, sent), msg, mq->elsize);
+    avpriv_atomic_int_set(&mq->sent, ring_next(mq, sent));
+
+    if (avpriv_atomic_int_get(&mq->recv_waiting)) {
+        pthread_mutex_lock(&mq->lock);
+        mq->recv_waiting = 0;
+        pthread_cond_signal(&mq->cond_recv);
+        pthread_mutex_unlock(&mq->lock);
+    }
+    return 0;
+}
+
+static int ring_recv(AVThreadMessageQueue *mq, void *msg, unsigned flags)
+{
+    unsigned received = mq->received;
+    int ret;
+
+    while (avpriv_atomic_int_get(&mq->sent) == received) {
+        if ((ret = mq->err_recv))
+            return ret;
+        if ((flags & AV_THREAD_MESSAGE_NONBLOCK))
+            return AVERROR(EAGAIN);
+        pthread_mutex_lock(&mq->lock);
+        avpriv_atomic_int_set(&mq->recv_waiting, 1);
+        if (!mq->err_recv && avpriv_atomic_int_get(&mq->sent) == received)
+            pthread_cond_wait(&mq->cond_recv, &mq->lock);
+        mq->recv_waiting = 0;
+        pthread_mutex_unlock(&mq->lock);
+    }
+    memcpy(msg, ring_slot(mq, received), mq->elsize);
+    avpriv_atomic_int_set(&mq->received, ring_next(mq, received));
+
+    if (avpriv_atomic_int_get(&mq->send_waiting)) {
+        pthread_mutex_lock(&mq->lock);
+        mq->send_waiting = 0;
+        pthread_cond_signal(&mq->cond_send);
+        pthread_mutex_unlock(&mq->lock);
+    }
+    return 0;
+}
+
 static int av_thread_message_queue_send_locked(AVThreadMessageQueue *mq,
                                                void *msg,
                                                unsigned flags)
@@ -147,6 +283,20 @@ int av_thread_message_queue_send(AVThreadMessageQueue *mq,
 #if HAVE_THREADS
     int ret;
 
+    if (mq->flags & AV_THREAD_MESSAGE_QUEUE_MPSC) {
+        if (flags & AV_THREAD_MESSAGE_NONBLOCK) {
+            if (pthread_mutex_trylock(&mq->send_lock))
+                return AVERROR(EAGAIN);
+        } else {
+            pthread_mutex_lock(&mq->send_lock);
+        }
+        ret = ring_send(mq, msg, flags);
+        pthread_mutex_unlock(&mq->send_lock);
+        return ret;
+    }
+    if (mq->flags & AV_THREAD_MESSAGE_QUEUE_SPSC)
+        return ring_send(mq, msg, flags);
+
     pthread_mutex_lock(&mq->lock);
     ret = av_thread_message_queue_send_locked(mq, msg, flags);
     pthread_mutex_unlock(&mq->lock);
@@ -163,6 +313,9 @@ int av_thread_message_queue_recv(AVThreadMessageQueue *mq,
 #if HAVE_THREADS
     int ret;
 
+    if (mq->nelem)
+        return ring_recv(mq, msg, flags);
+
     pthread_mutex_lock(&mq->lock);
     ret = av_thread_message_queue_recv_locked(mq, msg, flags);
     pthread_mutex_unlock(&mq->lock);
@@ -208,6 +361,21 @@ void av_thread_message_flush(AVThreadMessageQueue *mq)
     int used, off;
     void *free_func = mq->free_func;
 
+    if (mq->nelem) {
+        unsigned sent = avpriv_atomic_int_get(&mq->sent);
+        unsigned received;
+
+        if (mq->free_func)
+            for (received = mq->received; received != sent;
+                 received = ring_next(mq, received))
+                mq->free_func(ring_slot(mq, received));
+        avpriv_atomic_int_set(&mq->received, sent);
+        pthread_mutex_lock(&mq->lock);
+        pthread_cond_broadcast(&mq->cond_send);
+        pthread_mutex_unlock(&mq->lock);
+        return;
+    }
+
     pthread_mutex_lock(&mq->lock);
     used = av_fifo_size(mq->fifo);
     if (free_func)
@@ -32,6 +32,30 @@ typedef enum AVThreadMessageFlags {
 
 } AVThreadMessageFlags;
 
+/**
+ * Queue flags for av_thread_message_queue_alloc2().
+ *
+ * Both select a ring buffer which the messages are copied in and out of
+ * without taking a lock, for queues with a single receiving thread. Threads
+ * only sleep on a full or empty queue, and are only woken up when the other
+ * side sees them waiting. av_thread_message_flush() may then only be called
+ * by the receiving thread, or when no thread uses the queue.
+ */
+enum AVThreadMessageQueueFlags {
+    /**
+     * One receiving thread, any number of sending threads. The senders are
+     * serialized by a lock only they use; a non-blocking send returns
+     * AVERROR(EAGAIN) if another sender holds it.
+     */
+    AV_THREAD_MESSAGE_QUEUE_MPSC = 1,
+
+    /**
+     * One receiving and one sending thread, neither taking any lock while the
+     * queue is neither full nor empty.
+     */
+    AV_THREAD_MESSAGE_QUEUE_SPSC = 2,
+};
+
 /**
  * Allocate a new message queue.
  *
@@ -45,6 +69,18 @@ int av_thread_message_queue_alloc(AVThreadMessageQueue **mq,
                                   unsigned nelem,
                                   unsigned elsize);
 
+/**
+ * Allocate a new message queue.
+ *
+ * Same as av_thread_message_queue_alloc(), with flags a combination of
+ * AVThreadMessageQueueFlags. With 0 the queue may be used by any number of
+ * sending and receiving threads.
+ */
+int av_thread_message_queue_alloc2(AVThreadMessageQueue **mq,
+                                   unsigned nelem,
+                                   unsigned elsize,
+                                   unsigned flags);
+
 /**
  * Free a message queue.
  *
@@ -0,0 +1,246 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "atomic.h"
+#include "avstring.h"
+#include "avutil.h"
+#include "error.h"
+#include "mem.h"
+#include "thread.h"
+#include "time.h"
+#include "trace.h"
+
+typedef struct TraceEvent {
+    int64_t ts;                 ///< nanoseconds since tracing was enabled
+    const char *name;
+    const char *cat;
+    int64_t arg;
+    int type;
+} TraceEvent;
+
+typedef struct TraceBuffer {
+    struct TraceBuffer *next;
+    int tid;
+    char name[32];
+    unsigned mask;
+    unsigned pos;               ///< number of events written, wrapping
+    TraceEvent events[1];
+} TraceBuffer;
+
+#define TRACE_SUPPORTED (HAVE_PTHREADS || !HAVE_THREADS)
+
+static volatile int trace_nb_events;    ///< ring size, 0 while disabled
+static int64_t trace_start;
+/* every buffer ever allocated, pushed lock-free and never removed */
+static TraceBuffer *volatile trace_buffers;
+static volatile int trace_nb_threads;
+
+#if HAVE_PTHREADS
+/* deleted by av_trace_free(), so that no thread keeps a freed buffer */
+static pthread_key_t trace_key;
+static int trace_key_valid;
+#elif !HAVE_THREADS
+static TraceBuffer *trace_local;
+#endif
+
+static int64_t trace_time(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return av_gettime_relative() * 1000;
+#endif
+}
+
+static TraceBuffer *get_buffer(void)
+{
+#if TRACE_SUPPORTED
+    TraceBuffer *buf;
+    int nb_events;
+
+#if HAVE_PTHREADS
+    if ((buf = pthread_getspecific(trace_key)))
+        return buf;
+#else
+    if ((buf = trace_local))
+        return buf;
+#endif
+
+    nb_events = avpriv_atomic_int_get(&trace_nb_events);
+    if (!nb_events)
+        return NULL;
+    buf = av_mallocz(sizeof(*buf) + (nb_events - 1) * sizeof(*buf->events));
+    if (!buf)
+        return NULL;
+    buf->mask = nb_events - 1;
+    buf->tid  = avpriv_atomic_int_add_and_fetch(&trace_nb_threads, 1);
+    do {
+        buf->next = trace_buffers;
+    } while (avpriv_atomic_ptr_cas((void * volatile *)&trace_buffers,
+                                   buf->next, buf) != buf->next);
+
+#if HAVE_PTHREADS
+    pthread_setspecific(trace_key, buf);
+#else
+    trace_local = buf;
+#endif
+    return buf;
+#else
+    return NULL;
+#endif /* TRACE_SUPPORTED */
+}
+
+int av_trace_enable(unsigned nb_events)
+{
+#if TRACE_SUPPORTED
+    if (nb_events > (INT_MAX - sizeof(TraceBuffer)) / sizeof(TraceEvent) / 2)
+        return AVERROR(EINVAL);
+    if (nb_events) {
+        /* round up to a power of two */
+        nb_events = 1U << av_log2(2 * nb_events - 1);
+#if HAVE_PTHREADS
+        if (!trace_key_valid) {
+            int ret = pthread_key_create(&trace_key, NULL);
+            if (ret)
+                return AVERROR(ret);
+            trace_key_valid = 1;
+        }
+#endif
+        if (!trace_start)
+            trace_start = trace_time();
+    }
+    avpriv_atomic_int_set(&trace_nb_events, nb_events);
+    return 0;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+void av_trace_event(enum AVTraceEventType type, const char *name,
+                    const char *cat, int64_t arg)
+{
+    TraceBuffer *buf;
+    TraceEvent *ev;
+
+    if (!trace_nb_events || !(buf = get_buffer()))
+        return;
+
+    ev = &buf->events[buf->pos++ & buf->mask];
+    ev->ts   = trace_time() - trace_start;
+    ev->name = name;
+    ev->cat  = cat;
+    ev->arg  = arg;
+    ev->type = type;
+}
+
+void av_trace_set_thread_name(const char *name)
+{
+    TraceBuffer *buf;
+
+    if (trace_nb_events && (buf = get_buffer()))
+        av_strlcpy(buf->name, name, sizeof(buf->name));
+}
+
+void av_trace_free(void)
+{
+    TraceBuffer *buf, *next;
+
+    avpriv_atomic_int_set(&trace_nb_events, 0);
+#if HAVE_PTHREADS
+    if (trace_key_valid) {
+        pthread_key_delete(trace_key);
+        trace_key_valid = 0;
+    }
+#elif !HAVE_THREADS
+    trace_local = NULL;
+#endif
+
+    for (buf = trace_buffers; buf; buf = next) {
+        next = buf->next;
+        av_free(buf);
+    }
+    trace_buffers    = NULL;
+    trace_nb_threads = 0;
+    trace_start      = 0;
+}
+
+static void write_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', f);
+        if ((unsigned char)*s >= ' ')
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+int av_trace_dump(const char *filename)
+{
+    static const char phases[] = { [AV_TRACE_BEGIN]   = 'B',
+                                   [AV_TRACE_END]     = 'E',
+                                   [AV_TRACE_INSTANT] = 'i' };
+    TraceBuffer *buf;
+    FILE *f;
+    int nb_written = 0, ret = 0;
+
+    if (!(f = av_fopen_utf8(filename, "w")))
+        return AVERROR(errno);
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (buf = trace_buffers; buf; buf = buf->next) {
+        unsigned i = buf->pos > buf->mask ? buf->pos - buf->mask - 1 : 0;
+
+        if (buf->name[0]) {
+            fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+                    "\"tid\":%d,\"args\":{\"name\":", nb_written++ ? ",\n" : "",
+                    buf->tid);
+            write_string(f, buf->name);
+            fprintf(f, "}}");
+        }
+        for (; i != buf->pos; i++) {
+            const TraceEvent *ev = &buf->events[i & buf->mask];
+
+            fprintf(f, "%s{\"ph\":\"%c\",\"name\":", nb_written++ ? ",\n" : "",
+                    phases[ev->type]);
+            write_string(f, ev->name);
+            fprintf(f, ",\"cat\":");
+            write_string(f, ev->cat);
+            fprintf(f, ",\"ts\":%"PRId64".%03d,\"pid\":1,\"tid\":%d,"
+                    "\"args\":{\"arg\":%"PRId64"}%s}",
+                    ev->ts / 1000, (int)(ev->ts % 1000), buf->tid, ev->arg,
+                    ev->type == AV_TRACE_INSTANT ? ",\"s\":\"t\"" : "");
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    if (ferror(f))
+        ret = AVERROR(EIO);
+    if (fclose(f) && !ret)
+        ret = AVERROR(errno);
+    return ret < 0 ? ret : nb_written;
+}
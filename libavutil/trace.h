@@ -0,0 +1,106 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_TRACE_H
+#define AVUTIL_TRACE_H
+
+/**
+ * @file
+ * @ingroup lavu_trace
+ * Event tracing.
+ */
+
+#include <stdint.h>
+
+/**
+ * @defgroup lavu_trace Event tracing
+ * @ingroup lavu_misc
+ *
+ * Record when the threads of the process enter and leave the instrumented
+ * parts of the libraries (decoding, frame threading handoffs, filtering,
+ * encoding, muxing), to see where a transcode stalls and how its threads
+ * interact.
+ *
+ * Each thread writes its events into its own ring buffer, without locking;
+ * once it is full the oldest events are overwritten. The events are written
+ * out in the Chrome trace event format, which chrome://tracing and Perfetto
+ * can display. While tracing is disabled, an event costs a function call and
+ * a test.
+ *
+ * @{
+ */
+
+enum AVTraceEventType {
+    AV_TRACE_BEGIN,     ///< start of a duration, nested on each thread
+    AV_TRACE_END,       ///< end of the last duration begun on the thread
+    AV_TRACE_INSTANT,
+};
+
+/**
+ * Start recording events, or stop if nb_events is 0.
+ *
+ * This should be called before the threads to trace start, and not while
+ * another thread records events.
+ *
+ * @param nb_events size of the per-thread ring buffers, in events, rounded up
+ *                  to a power of two; buffers already allocated keep their size
+ * @return 0 on success, AVERROR(ENOSYS) if tracing is not supported with the
+ *         threading implementation lavu was built with, or another negative
+ *         error code
+ */
+int av_trace_enable(unsigned nb_events);
+
+/**
+ * Record an event on the calling thread.
+ *
+ * @param name name of the event; the pointer is stored, so it must remain
+ *             valid until the trace is dumped
+ * @param cat  category of the event, with the same lifetime requirement
+ * @param arg  payload shown with the event
+ */
+void av_trace_event(enum AVTraceEventType type, const char *name,
+                    const char *cat, int64_t arg);
+
+/**
+ * Name the calling thread in the trace. The name is copied.
+ */
+void av_trace_set_thread_name(const char *name);
+
+/**
+ * Write the recorded events to a file in Chrome trace JSON format.
+ *
+ * No thread may record events while the trace is dumped.
+ *
+ * @return the number of events written, or a negative error code
+ */
+int av_trace_dump(const char *filename);
+
+/**
+ * Stop recording events and free those recorded so far, with the buffers of
+ * all threads, including those which have exited.
+ *
+ * No thread may record events while this is called. Tracing may be enabled
+ * again afterwards.
+ */
+void av_trace_free(void);
+
+/**
+ * @}
+ */
+
+#endif /* AVUTIL_TRACE_H */
@@ -27,8 +27,70 @@
  */
 
 #include "libavutil/avassert.h"
+#include "libavutil/thread.h"
 #include "resample.h"
 
+/**
+ * Number of filter banks shared through the process-wide cache.
+ * A bank is dropped from the cache when the last context using it lets go.
+ */
+#define FILTER_CACHE_SIZE 16
+
+typedef struct FilterBankCacheEntry {
+    AVBufferRef *bank;
+    int phase_count;
+    int filter_length;
+    int filter_alloc;
+    int filter_shift;
+    double factor;
+    double kaiser_beta;
+    enum SwrFilterType filter_type;
+    enum AVSampleFormat format;
+    unsigned last_use;
+} FilterBankCacheEntry;
+
+static FilterBankCacheEntry filter_cache[FILTER_CACHE_SIZE];
+static unsigned filter_cache_clock;
+static AVMutex filter_cache_mutex;
+static AVOnce filter_cache_once = AV_ONCE_INIT;
+
+#if HAVE_THREADS
+/**
+ * Below these, handing channels to worker threads costs more than it saves.
+ */
+#define THREAD_MIN_CHANNELS 4
+#define THREAD_MIN_SAMPLES  256
+
+typedef struct ResampleWorker {
+    struct ResampleThreads *pool;
+    pthread_t thread;
+    int index;                  ///< job number, the calling thread is job 0
+} ResampleWorker;
+
+typedef struct ResampleThreads {
+    ResampleContext *c;
+    ResampleWorker *workers;
+    int nb_workers;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t job_cond;
+    pthread_cond_t done_cond;
+    unsigned job_id;
+    int pending;
+    int exit;
+
+    /* current job, only written while no worker is running */
+    AudioData *dst;
+    AudioData *src;
+    int dst_size;
+    int src_size;
+    int need_emms;
+} ResampleThreads;
+
+static void threads_free(ResampleThreads **pp);
+static ResampleThreads *threads_alloc(ResampleContext *c, int nb_workers);
+#endif
+
 static inline double eval_poly(const double *coeff, int size, double x) {
     double sum = coeff[size-1];
     int i;
@@ -141,7 +203,7 @@ static double bessel(double x) {
  * @param kaiser_beta  kaiser window beta
  * @return 0 on success, negative on error
  */
-static int build_filter(ResampleContext *c, void *filter, double factor, int tap_count, int alloc, int phase_count, int scale,
+static int build_filter(const ResampleContext *c, void *filter, double factor, int tap_count, int alloc, int phase_count, int scale,
                         int filter_type, double kaiser_beta){
     int ph, i;
     int ph_nb = phase_count % 2 ? phase_count : phase_count / 2 + 1;
@@ -300,9 +362,150 @@ fail:
     return ret;
 }
 
+static void filter_cache_init(void)
+{
+    ff_mutex_init(&filter_cache_mutex, NULL);
+}
+
+static int filter_cache_match(const FilterBankCacheEntry *e, const ResampleContext *c, int phase_count)
+{
+    return e->bank &&
+           e->phase_count   == phase_count      &&
+           e->filter_length == c->filter_length &&
+           e->filter_alloc  == c->filter_alloc  &&
+           e->filter_shift  == c->filter_shift  &&
+           e->factor        == c->factor        &&
+           e->filter_type   == c->filter_type   &&
+           e->kaiser_beta   == c->kaiser_beta   &&
+           e->format        == c->format;
+}
+
+/* must be called with filter_cache_mutex held */
+static AVBufferRef *filter_cache_lookup(const ResampleContext *c, int phase_count)
+{
+    int i;
+
+    for (i = 0; i < FILTER_CACHE_SIZE; i++) {
+        FilterBankCacheEntry *e = &filter_cache[i];
+        if (filter_cache_match(e, c, phase_count)) {
+            e->last_use = ++filter_cache_clock;
+            return av_buffer_ref(e->bank);
+        }
+    }
+    return NULL;
+}
+
+/* must be called with filter_cache_mutex held */
+static void filter_cache_insert(const ResampleContext *c, int phase_count, AVBufferRef *bank)
+{
+    FilterBankCacheEntry *victim = NULL;
+    AVBufferRef *ref;
+    int i;
+
+    for (i = 0; i < FILTER_CACHE_SIZE; i++) {
+        FilterBankCacheEntry *e = &filter_cache[i];
+        if (!e->bank) {
+            victim = e;
+            break;
+        }
+        /* only the cache holds a reference, nobody can grab a new one without the lock */
+        if (av_buffer_get_ref_count(e->bank) == 1 &&
+            (!victim || e->last_use < victim->last_use))
+            victim = e;
+    }
+    if (!victim || !(ref = av_buffer_ref(bank)))
+        return;
+
+    av_buffer_unref(&victim->bank);
+    victim->bank          = ref;
+    victim->phase_count   = phase_count;
+    victim->filter_length = c->filter_length;
+    victim->filter_alloc  = c->filter_alloc;
+    victim->filter_shift  = c->filter_shift;
+    victim->factor        = c->factor;
+    victim->filter_type   = c->filter_type;
+    victim->kaiser_beta   = c->kaiser_beta;
+    victim->format        = c->format;
+    victim->last_use      = ++filter_cache_clock;
+}
+
+/**
+ * Get a reference to the polyphase filter bank described by the parameters
+ * of c, with phase_count phases. Banks are shared between all contexts of
+ * the process, building one only on a cache miss.
+ * The returned bank must be treated as read-only.
+ */
+static AVBufferRef *get_filter_bank(const ResampleContext *c, int phase_count)
+{
+    AVBufferRef *bank;
+    uint8_t *data;
+
+    ff_thread_once(&filter_cache_once, filter_cache_init);
+
+    ff_mutex_lock(&filter_cache_mutex);
+    bank = filter_cache_lookup(c, phase_count);
+    ff_mutex_unlock(&filter_cache_mutex);
+    if (bank)
+        return bank;
+
+    /* build outside of the lock, this is the expensive part */
+    if (c->filter_alloc * (int64_t)(phase_count + 1) * c->felem_size > INT_MAX)
+        return NULL;
+    bank = av_buffer_allocz(c->filter_alloc * (phase_count + 1) * c->felem_size);
+    if (!bank)
+        return NULL;
+    data = bank->data;
+    if (build_filter(c, data, c->factor, c->filter_length, c->filter_alloc,
+                     phase_count, 1 << c->filter_shift, c->filter_type, c->kaiser_beta)) {
+        av_buffer_unref(&bank);
+        return NULL;
+    }
+    memcpy(data + (c->filter_alloc*phase_count+1)*c->felem_size, data, (c->filter_alloc-1)*c->felem_size);
+    memcpy(data + (c->filter_alloc*phase_count  )*c->felem_size, data + (c->filter_alloc - 1)*c->felem_size, c->felem_size);
+
+    ff_mutex_lock(&filter_cache_mutex);
+    {
+        /* another thread may have built the same bank meanwhile */
+        AVBufferRef *cached = filter_cache_lookup(c, phase_count);
+        if (cached) {
+            av_buffer_unref(&bank);
+            bank = cached;
+        } else {
+            filter_cache_insert(c, phase_count, bank);
+        }
+    }
+    ff_mutex_unlock(&filter_cache_mutex);
+
+    return bank;
+}
+
+/**
+ * Drop a reference obtained from get_filter_bank(), and the cached one too
+ * if no other context uses the bank any longer.
+ */
+static void release_filter_bank(AVBufferRef **bank)
+{
+    int i;
+
+    if (!*bank)
+        return;
+
+    ff_mutex_lock(&filter_cache_mutex);
+    for (i = 0; i < FILTER_CACHE_SIZE; i++) {
+        FilterBankCacheEntry *e = &filter_cache[i];
+        if (e->bank && e->bank->buffer == (*bank)->buffer) {
+            if (av_buffer_get_ref_count(e->bank) == 2)
+                av_buffer_unref(&e->bank);
+            break;
+        }
+    }
+    av_buffer_unref(bank);
+    ff_mutex_unlock(&filter_cache_mutex);
+}
+
 static ResampleContext *resample_init(ResampleContext *c, int out_rate, int in_rate, int filter_size, int phase_shift, int linear,
                                     double cutoff0, enum AVSampleFormat format, enum SwrFilterType filter_type, double kaiser_beta,
-                                    double precision, int cheby, int exact_rational)
+                                    double precision, int cheby, int exact_rational, int nb_threads)
 {
     double cutoff = cutoff0? cutoff0 : 0.97;
     double factor= FFMIN(out_rate * cutoff / in_rate, 1.0);
@@ -356,16 +559,13 @@ static ResampleContext *resample_init(ResampleContext *c, int out_rate, int in_r
         c->factor        = factor;
         c->filter_length = FFMAX((int)ceil(filter_size/factor), 1);
         c->filter_alloc  = FFALIGN(c->filter_length, 8);
-        c->filter_bank   = av_calloc(c->filter_alloc, (phase_count+1)*c->felem_size);
         c->filter_type   = filter_type;
         c->kaiser_beta   = kaiser_beta;
         c->phase_count_compensation = phase_count_compensation;
-        if (!c->filter_bank)
+        c->filter_bank_buf = get_filter_bank(c, phase_count);
+        if (!c->filter_bank_buf)
             goto error;
-        if (build_filter(c, (void*)c->filter_bank, factor, c->filter_length, c->filter_alloc, phase_count, 1<<c->filter_shift, filter_type, kaiser_beta))
-            goto error;
-        memcpy(c->filter_bank + (c->filter_alloc*phase_count+1)*c->felem_size, c->filter_bank, (c->filter_alloc-1)*c->felem_size);
-        memcpy(c->filter_bank + (c->filter_alloc*phase_count  )*c->felem_size, c->filter_bank + (c->filter_alloc - 1)*c->felem_size, c->felem_size);
+        c->filter_bank   = c->filter_bank_buf->data;
     }
 
     c->compensation_distance= 0;
@@ -384,9 +584,19 @@ static ResampleContext *resample_init(ResampleContext *c, int out_rate, int in_r
 
     swri_resample_dsp_init(c);
 
+#if HAVE_THREADS
+    if (c->threads && c->threads->nb_workers != nb_threads - 1)
+        threads_free(&c->threads);
+    if (nb_threads > 1 && !c->threads) {
+        c->threads = threads_alloc(c, nb_threads - 1);
+        if (!c->threads)
+            av_log(NULL, AV_LOG_WARNING, "Failed to start resampling threads, resampling single threaded\n");
+    }
+#endif
+
     return c;
 error:
-    av_freep(&c->filter_bank);
+    release_filter_bank(&c->filter_bank_buf);
     av_free(c);
     return NULL;
 }
@@ -394,39 +604,32 @@ error:
 static void resample_free(ResampleContext **c){
     if(!*c)
         return;
-    av_freep(&(*c)->filter_bank);
+#if HAVE_THREADS
+    threads_free(&(*c)->threads);
+#endif
+    release_filter_bank(&(*c)->filter_bank_buf);
     av_freep(c);
 }
 
 static int rebuild_filter_bank_with_compensation(ResampleContext *c)
 {
-    uint8_t *new_filter_bank;
+    AVBufferRef *new_filter_bank;
     int new_src_incr, new_dst_incr;
     int phase_count = c->phase_count_compensation;
-    int ret;
 
     if (phase_count == c->phase_count)
         return 0;
 
     av_assert0(!c->frac && !c->dst_incr_mod && !c->compensation_distance);
 
-    new_filter_bank = av_calloc(c->filter_alloc, (phase_count + 1) * c->felem_size);
+    new_filter_bank = get_filter_bank(c, phase_count);
     if (!new_filter_bank)
         return AVERROR(ENOMEM);
 
-    ret = build_filter(c, new_filter_bank, c->factor, c->filter_length, c->filter_alloc,
-                       phase_count, 1 << c->filter_shift, c->filter_type, c->kaiser_beta);
-    if (ret < 0) {
-        av_freep(&new_filter_bank);
-        return ret;
-    }
-    memcpy(new_filter_bank + (c->filter_alloc*phase_count+1)*c->felem_size, new_filter_bank, (c->filter_alloc-1)*c->felem_size);
-    memcpy(new_filter_bank + (c->filter_alloc*phase_count  )*c->felem_size, new_filter_bank + (c->filter_alloc - 1)*c->felem_size, c->felem_size);
-
     if (!av_reduce(&new_src_incr, &new_dst_incr, c->src_incr,
                    c->dst_incr * (int64_t)(phase_count/c->phase_count), INT32_MAX/2))
     {
-        av_freep(&new_filter_bank);
+        release_filter_bank(&new_filter_bank);
         return AVERROR(EINVAL);
     }
 
@@ -441,8 +644,9 @@ static int rebuild_filter_bank_with_compensation(ResampleContext *c)
     c->dst_incr_mod   = c->dst_incr % c->src_incr;
     c->index         *= phase_count / c->phase_count;
     c->phase_count    = phase_count;
-    av_freep(&c->filter_bank);
-    c->filter_bank = new_filter_bank;
+    release_filter_bank(&c->filter_bank_buf);
+    c->filter_bank_buf = new_filter_bank;
+    c->filter_bank     = new_filter_bank->data;
     return 0;
 }
 
@@ -467,18 +671,35 @@ static int set_compensation(ResampleContext *c, int sample_delta, int compensati
     return 0;
 }
 
+/**
+ * @return the number of samples swri_resample() outputs from src_size input
+ *         samples, at most dst_size
+ */
+static int resample_output_size(const ResampleContext *c, int src_size, int dst_size)
+{
+    if (c->filter_length == 1 && c->phase_count == 1) {
+        int new_size = (src_size * (int64_t)c->src_incr - c->frac + c->dst_incr - 1) / c->dst_incr;
+        return FFMIN(dst_size, new_size);
+    } else {
+        int64_t end_index = (1LL + src_size - c->filter_length) * c->phase_count;
+        int64_t delta_frac = (end_index - c->index) * c->src_incr - c->frac;
+        int delta_n = (delta_frac + c->dst_incr - 1) / c->dst_incr;
+        return FFMIN(dst_size, delta_n);
+    }
+}
+
 static int swri_resample(ResampleContext *c,
                          uint8_t *dst, const uint8_t *src, int *consumed,
                          int src_size, int dst_size, int update_ctx)
 {
+    dst_size = resample_output_size(c, src_size, dst_size);
+
     if (c->filter_length == 1 && c->phase_count == 1) {
         int index= c->index;
         int frac= c->frac;
         int64_t index2= (1LL<<32)*c->frac/c->src_incr + (1LL<<32)*index;
         int64_t incr= (1LL<<32) * c->dst_incr / c->src_incr;
-        int new_size = (src_size * (int64_t)c->src_incr - frac + c->dst_incr - 1) / c->dst_incr;
 
-        dst_size= FFMIN(dst_size, new_size);
         c->dsp.resample_one(dst, src, dst_size, index2, incr);
 
         index += dst_size * c->dst_incr_div;
@@ -490,11 +711,6 @@ static int swri_resample(ResampleContext *c,
             c->index = 0;
         }
     } else {
-        int64_t end_index = (1LL + src_size - c->filter_length) * c->phase_count;
-        int64_t delta_frac = (end_index - c->index) * c->src_incr - c->frac;
-        int delta_n = (delta_frac + c->dst_incr - 1) / c->dst_incr;
-
-        dst_size = FFMIN(dst_size, delta_n);
         if (dst_size > 0) {
             *consumed = c->dsp.resample(c, dst, src, dst_size, update_ctx);
         } else {
@@ -505,6 +721,100 @@ static int swri_resample(ResampleContext *c,
     return dst_size;
 }
 
+#if HAVE_THREADS
+/* resample all channels but the last one assigned to thread jobnr, without updating the context */
+static void resample_channels(ResampleThreads *p, int jobnr)
+{
+    int i, consumed;
+
+    for (i = jobnr; i < p->dst->ch_count - 1; i += p->nb_workers + 1)
+        swri_resample(p->c, p->dst->ch[i], p->src->ch[i],
+                      &consumed, p->src_size, p->dst_size, 0);
+    if (p->need_emms)
+        emms_c();
+}
+
+static void *worker_thread(void *arg)
+{
+    ResampleWorker *w = arg;
+    ResampleThreads *p = w->pool;
+    unsigned job_id = 0;
+
+    pthread_mutex_lock(&p->mutex);
+    for (;;) {
+        while (!p->exit && p->job_id == job_id)
+            pthread_cond_wait(&p->job_cond, &p->mutex);
+        if (p->exit)
+            break;
+        job_id = p->job_id;
+        pthread_mutex_unlock(&p->mutex);
+
+        resample_channels(p, w->index);
+
+        pthread_mutex_lock(&p->mutex);
+        if (!--p->pending)
+            pthread_cond_signal(&p->done_cond);
+    }
+    pthread_mutex_unlock(&p->mutex);
+    return NULL;
+}
+
+static void threads_free(ResampleThreads **pp)
+{
+    ResampleThreads *p = *pp;
+    int i;
+
+    if (!p)
+        return;
+
+    pthread_mutex_lock(&p->mutex);
+    p->exit = 1;
+    pthread_cond_broadcast(&p->job_cond);
+    pthread_mutex_unlock(&p->mutex);
+
+    for (i = 0; i < p->nb_workers; i++)
+        pthread_join(p->workers[i].thread, NULL);
+
+    pthread_mutex_destroy(&p->mutex);
+    pthread_cond_destroy(&p->job_cond);
+    pthread_cond_destroy(&p->done_cond);
+    av_freep(&p->workers);
+    av_freep(pp);
+}
+
+static ResampleThreads *threads_alloc(ResampleContext *c, int nb_workers)
+{
+    ResampleThreads *p = av_mallocz(sizeof(*p));
+    int i;
+
+    if (!p)
+        return NULL;
+    p->workers = av_mallocz_array(nb_workers, sizeof(*p->workers));
+    if (!p->workers) {
+        av_free(p);
+        return NULL;
+    }
+    p->c = c;
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->job_cond, NULL);
+    pthread_cond_init(&p->done_cond, NULL);
+
+    for (i = 0; i < nb_workers; i++) {
+        ResampleWorker *w = &p->workers[i];
+        w->pool  = p;
+        w->index = i + 1;
+        if (pthread_create(&w->thread, NULL, worker_thread, w))
+            break;
+        p->nb_workers++;
+    }
+    if (p->nb_workers != nb_workers) {
+        threads_free(&p);
+        return NULL;
+    }
+    return p;
+}
+#endif
+
 static int multiple_resample(ResampleContext *c, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed){
     int i, ret= -1;
     int av_unused mm_flags = av_get_cpu_flags();
@@ -516,6 +826,35 @@ static int multiple_resample(ResampleContext *c, AudioData *dst, int dst_size, A
         dst_size = FFMIN(dst_size, c->compensation_distance);
     src_size = FFMIN(src_size, max_src_size);
 
+#if HAVE_THREADS
+    if (c->threads && dst->ch_count >= THREAD_MIN_CHANNELS &&
+        resample_output_size(c, src_size, dst_size) >= THREAD_MIN_SAMPLES) {
+        ResampleThreads *p = c->threads;
+
+        pthread_mutex_lock(&p->mutex);
+        p->dst       = dst;
+        p->src       = src;
+        p->dst_size  = dst_size;
+        p->src_size  = src_size;
+        p->need_emms = need_emms;
+        p->pending   = p->nb_workers;
+        p->job_id++;
+        pthread_cond_broadcast(&p->job_cond);
+        pthread_mutex_unlock(&p->mutex);
+
+        resample_channels(p, 0);
+
+        pthread_mutex_lock(&p->mutex);
+        while (p->pending)
+            pthread_cond_wait(&p->done_cond, &p->mutex);
+        pthread_mutex_unlock(&p->mutex);
+
+        /* the last channel updates the context once all others are done with it */
+        i = dst->ch_count - 1;
+        ret= swri_resample(c, dst->ch[i], src->ch[i],
+                           consumed, src_size, dst_size, 1);
+    } else
+#endif
     for(i=0; i<dst->ch_count; i++){
         ret= swri_resample(c, dst->ch[i], src->ch[i],
                            consumed, src_size, dst_size, i+1==dst->ch_count);
@@ -22,6 +22,7 @@
 #ifndef SWRESAMPLE_RESAMPLE_H
 #define SWRESAMPLE_RESAMPLE_H
 
+#include "libavutil/buffer.h"
 #include "libavutil/log.h"
 #include "libavutil/samplefmt.h"
 
@@ -49,6 +50,8 @@ typedef struct ResampleContext {
     int felem_size;
     int filter_shift;
     int phase_count_compensation;      /* desired phase_count when compensation is enabled */
+    AVBufferRef *filter_bank_buf;      /* shared, read-only backing of filter_bank */
+    struct ResampleThreads *threads;   /* workers resampling channels in parallel, NULL if single threaded */
 
     struct {
         void (*resample_one)(void *dst, const void *src,
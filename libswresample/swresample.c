@@ -265,7 +265,8 @@ av_cold int swr_init(struct SwrContext *s){
     }
 
     if (s->out_sample_rate!=s->in_sample_rate || (s->flags & SWR_FLAG_RESAMPLE)){
-        s->resample = s->resampler->init(s->resample, s->out_sample_rate, s->in_sample_rate, s->filter_size, s->phase_shift, s->linear_interp, s->cutoff, s->int_sample_fmt, s->filter_type, s->kaiser_beta, s->precision, s->cheby, s->exact_rational);
+        s->resample = s->resampler->init(s->resample, s->out_sample_rate, s->in_sample_rate, s->filter_size, s->phase_shift, s->linear_interp, s->cutoff, s->int_sample_fmt, s->filter_type, s->kaiser_beta, s->precision, s->cheby, s->exact_rational,
+                                         s->threads ? s->threads : FFMIN(av_cpu_count(), s->used_ch_count));
         if (!s->resample) {
             av_log(s, AV_LOG_ERROR, "Failed to initialize resampler\n");
             return AVERROR(ENOMEM);
@@ -572,11 +573,49 @@ static int resample(SwrContext *s, AudioData *out_param, int out_count,
     return ret_sum;
 }
 
+#define FUSED_BLOCK 2048
+
+/**
+ * Run rematrix and resample over blocks of FUSED_BLOCK input samples, so that
+ * the intermediate block is still in cache when the second stage reads it and
+ * midbuf only ever needs to hold one block.
+ */
+static int rematrix_resample(SwrContext *s, AudioData *out, int out_count,
+                             AudioData *mid, int mid_count, const AudioData *in, int in_count){
+    AudioData src = *in, dst = *out;
+    int ret_sum = 0;
+
+    while(in_count > 0){
+        int n = FFMIN(in_count, FUSED_BLOCK);
+        int ret;
+
+        if(s->resample_first){
+            ret = resample(s, mid, FFMIN(out_count, mid_count), &src, n);
+            if(ret < 0)
+                return ret;
+            swri_rematrix(s, &dst, mid, ret, 1);
+        }else{
+            swri_rematrix(s, mid, &src, n, 0);
+            ret = resample(s, &dst, out_count, mid, n);
+            if(ret < 0)
+                return ret;
+        }
+        out_count -= ret;
+        ret_sum   += ret;
+        buf_set(&dst, &dst, ret);
+        buf_set(&src, &src, n);
+        in_count -= n;
+    }
+    return ret_sum;
+}
+
 static int swr_convert_internal(struct SwrContext *s, AudioData *out, int out_count,
                                                       AudioData *in , int  in_count){
     AudioData *postin, *midbuf, *preout;
     int ret/*, in_max*/;
     AudioData preout_tmp, midbuf_tmp;
+    int fused = s->rematrix && s->resample && in_count > FUSED_BLOCK;
+    int mid_count = s->resample_first ? out_count : in_count;
 
     if(s->full_convert){
         av_assert0(!s->resample);
@@ -589,15 +628,17 @@ static int swr_convert_internal(struct SwrContext *s, AudioData *out, int out_co
 
     if((ret=swri_realloc_audio(&s->postin, in_count))<0)
         return ret;
-    if(s->resample_first){
-        av_assert0(s->midbuf.ch_count == s->used_ch_count);
-        if((ret=swri_realloc_audio(&s->midbuf, out_count))<0)
-            return ret;
-    }else{
-        av_assert0(s->midbuf.ch_count ==  s->out.ch_count);
-        if((ret=swri_realloc_audio(&s->midbuf,  in_count))<0)
-            return ret;
-    }
+    if(fused){
+        /* room for one input block's worth of output plus the resampler's
+         * buffered history; any excess simply stays in the resampler */
+        mid_count = s->resample_first ? av_rescale_rnd(2 * FUSED_BLOCK, s->out_sample_rate,
+                                                       s->in_sample_rate, AV_ROUND_UP) + 16
+                                      : FUSED_BLOCK;
+        mid_count = FFMIN(mid_count, s->resample_first ? out_count : in_count);
+    }
+    av_assert0(s->midbuf.ch_count == (s->resample_first ? s->used_ch_count : s->out.ch_count));
+    if((ret=swri_realloc_audio(&s->midbuf, mid_count))<0)
+        return ret;
     if((ret=swri_realloc_audio(&s->preout, out_count))<0)
         return ret;
 
@@ -634,7 +675,10 @@ static int swr_convert_internal(struct SwrContext *s, AudioData *out, int out_co
         swri_audio_convert(s->in_convert, postin, in, in_count);
     }
 
-    if(s->resample_first){
+    if(fused){
+        av_assert1(postin != midbuf && midbuf != preout);
+        out_count= rematrix_resample(s, preout, out_count, midbuf, mid_count, postin, in_count);
+    }else if(s->resample_first){
         if(postin != midbuf)
             out_count= resample(s, midbuf, out_count, postin, in_count);
         if(midbuf != preout)
@@ -0,0 +1,88 @@
+/*
+ * This file is part of libswresample
+ *
+ * libswresample is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libswresample is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libswresample; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Check that identical resamplers share one polyphase filter bank, that a
+ * resampler with another cutoff gets its own, and that a bank built again
+ * after all its users are gone has the same contents.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avassert.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/mem.h"
+
+#include "libswresample/swresample.h"
+#include "libswresample/resample.h"
+#include "libswresample/swresample_internal.h"
+
+static struct SwrContext *alloc_swr(int in_rate, int out_rate)
+{
+    struct SwrContext *s = swr_alloc_set_opts(NULL,
+                                              AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, out_rate,
+                                              AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, in_rate,
+                                              0, NULL);
+    av_assert0(s);
+    av_assert0(swr_init(s) >= 0);
+    av_assert0(s->resample && s->resample->filter_bank_buf);
+    return s;
+}
+
+static int bank_size(struct SwrContext *s)
+{
+    return s->resample->filter_bank_buf->size;
+}
+
+int main(void)
+{
+    struct SwrContext *a, *b, *c;
+    uint8_t *copy;
+    int size;
+
+    a = alloc_swr(44100, 48000);
+    b = alloc_swr(44100, 48000);
+    c = alloc_swr(48000, 22050);
+
+    printf("identical contexts share the bank: %s\n",
+           a->resample->filter_bank == b->resample->filter_bank ? "yes" : "no");
+    /* the cache, a and b */
+    printf("references to the shared bank: %d\n",
+           av_buffer_get_ref_count(a->resample->filter_bank_buf));
+    printf("downsampling shares the bank: %s\n",
+           a->resample->filter_bank == c->resample->filter_bank ? "yes" : "no");
+
+    size = bank_size(a);
+    copy = av_memdup(a->resample->filter_bank, size);
+    av_assert0(copy);
+
+    swr_free(&a);
+    printf("references after freeing one context: %d\n",
+           av_buffer_get_ref_count(b->resample->filter_bank_buf));
+    swr_free(&b);
+
+    b = alloc_swr(44100, 48000);
+    printf("rebuilt bank matches: %s\n",
+           bank_size(b) == size && !memcmp(b->resample->filter_bank, copy, size) ? "yes" : "no");
+
+    av_free(copy);
+    swr_free(&b);
+    swr_free(&c);
+    return 0;
+}
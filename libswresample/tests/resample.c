@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2016 Plex, Inc.
+ *
+ * This file is part of libswresample
+ *
+ * libswresample is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libswresample is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libswresample; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Resampling throughput benchmark.
+ *
+ * usage: resample [in_rate [out_rate [channels [internal_sample_fmt [threads [seconds]]]]]]
+ * Defaults to resampling 8 channels of 96 kHz s16 to 48 kHz, the shape of a
+ * 7.1 lossless soundtrack being transcoded, for 60 seconds of audio.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/channel_layout.h"
+#include "libavutil/common.h"
+#include "libavutil/lfg.h"
+#include "libavutil/opt.h"
+#include "libavutil/samplefmt.h"
+#include "libavutil/time.h"
+
+#include "libswresample/swresample.h"
+
+#define CHUNK 4096
+
+int main(int argc, char **argv)
+{
+    int in_rate  = argc > 1 ? atoi(argv[1]) : 96000;
+    int out_rate = argc > 2 ? atoi(argv[2]) : 48000;
+    int channels = argc > 3 ? atoi(argv[3]) : 8;
+    enum AVSampleFormat int_fmt = argc > 4 ? av_get_sample_fmt(argv[4]) : AV_SAMPLE_FMT_S16P;
+    int threads  = argc > 5 ? atoi(argv[5]) : 1;
+    int seconds  = argc > 6 ? atoi(argv[6]) : 60;
+    int64_t layout = av_get_default_channel_layout(channels);
+    uint8_t **in = NULL, **out = NULL;
+    int out_max, i, j, ret = 1;
+    int64_t in_total = 0, out_total = 0, t0, t1;
+    struct SwrContext *swr;
+    AVLFG lfg;
+
+    if (in_rate <= 0 || out_rate <= 0 || channels <= 0 || !layout || int_fmt == AV_SAMPLE_FMT_NONE) {
+        fprintf(stderr, "usage: %s [in_rate [out_rate [channels [internal_sample_fmt [threads [seconds]]]]]]\n", argv[0]);
+        return 1;
+    }
+
+    swr = swr_alloc_set_opts(NULL, layout, AV_SAMPLE_FMT_S16P, out_rate,
+                                   layout, AV_SAMPLE_FMT_S16P, in_rate, 0, NULL);
+    if (!swr)
+        return 1;
+    av_opt_set_sample_fmt(swr, "internal_sample_fmt", int_fmt, 0);
+    av_opt_set_int(swr, "threads", threads, 0);
+
+    t0 = av_gettime_relative();
+    if (swr_init(swr) < 0) {
+        fprintf(stderr, "swr_init failed\n");
+        goto end;
+    }
+    t1 = av_gettime_relative();
+    printf("init: %"PRId64" us\n", t1 - t0);
+
+    out_max = av_rescale_rnd(CHUNK, out_rate, in_rate, AV_ROUND_UP) + 64;
+    if (av_samples_alloc_array_and_samples(&in,  NULL, channels, CHUNK,   AV_SAMPLE_FMT_S16P, 0) < 0 ||
+        av_samples_alloc_array_and_samples(&out, NULL, channels, out_max, AV_SAMPLE_FMT_S16P, 0) < 0)
+        goto end;
+
+    av_lfg_init(&lfg, 0xC0FFEE);
+    for (i = 0; i < channels; i++)
+        for (j = 0; j < CHUNK; j++)
+            ((int16_t *)in[i])[j] = av_lfg_get(&lfg) >> 17;
+
+    t0 = av_gettime_relative();
+    while (in_total < (int64_t)seconds * in_rate) {
+        int n = swr_convert(swr, out, out_max, (const uint8_t **)in, CHUNK);
+        if (n < 0) {
+            fprintf(stderr, "swr_convert failed\n");
+            goto end;
+        }
+        in_total  += CHUNK;
+        out_total += n;
+    }
+    t1 = av_gettime_relative();
+
+    printf("%d ch %s %d -> %d Hz, %d thread(s): %"PRId64" -> %"PRId64" samples in %"PRId64" us, %.1fx realtime\n",
+           channels, av_get_sample_fmt_name(int_fmt), in_rate, out_rate, threads,
+           in_total, out_total, t1 - t0,
+           in_total / (double)in_rate * 1000000.0 / FFMAX(t1 - t0, 1));
+    ret = 0;
+
+end:
+    if (in)
+        av_freep(&in[0]);
+    av_freep(&in);
+    if (out)
+        av_freep(&out[0]);
+    av_freep(&out);
+    swr_free(&swr);
+    return ret;
+}
@@ -33,6 +33,7 @@ struct sender_data {
     pthread_t tid;
     int workload;
     AVThreadMessageQueue *queue;
+    int can_flush;
 };
 
 /* same as sender_data but shuffled for testing purpose */
@@ -66,7 +67,7 @@ static void *sender_thread(void *arg)
 
     av_log(NULL, AV_LOG_INFO, "sender #%d: workload=%d\n", wd->id, wd->workload);
     for (i = 0; i < wd->workload; i++) {
-        if (rand() % wd->workload < wd->workload / 10) {
+        if (wd->can_flush && rand() % wd->workload < wd->workload / 10) {
             av_log(NULL, AV_LOG_INFO, "sender #%d: flushing the queue\n", wd->id);
             av_thread_message_flush(wd->queue);
         } else {
@@ -165,14 +166,16 @@ int main(int ac, char **av)
     int max_queue_size;
     int nb_senders, sender_min_load, sender_max_load;
     int nb_receivers, receiver_min_load, receiver_max_load;
+    unsigned flags = 0;
     struct sender_data *senders;
     struct receiver_data *receivers;
     AVThreadMessageQueue *queue = NULL;
 
-    if (ac != 8) {
+    if (ac != 8 && ac != 9) {
         av_log(NULL, AV_LOG_ERROR, "%s <max_queue_size> "
                "<nb_senders> <sender_min_send> <sender_max_send> "
-               "<nb_receivers> <receiver_min_recv> <receiver_max_recv>\n", av[0]);
+               "<nb_receivers> <receiver_min_recv> <receiver_max_recv> "
+               "[mpsc|spsc]\n", av[0]);
         return 1;
     }
 
@@ -183,6 +186,9 @@ int main(int ac, char **av)
     nb_receivers      = atoi(av[5]);
     receiver_min_load = atoi(av[6]);
     receiver_max_load = atoi(av[7]);
+    if (ac > 8)
+        flags = !strcmp(av[8], "spsc") ? AV_THREAD_MESSAGE_QUEUE_SPSC :
+                                         AV_THREAD_MESSAGE_QUEUE_MPSC;
 
     if (max_queue_size <= 0 ||
         nb_senders <= 0 || sender_min_load <= 0 || sender_max_load <= 0 ||
@@ -190,6 +196,11 @@ int main(int ac, char **av)
         av_log(NULL, AV_LOG_ERROR, "negative values not allowed\n");
         return 1;
     }
+    if ((flags && nb_receivers > 1) ||
+        ((flags & AV_THREAD_MESSAGE_QUEUE_SPSC) && nb_senders > 1)) {
+        av_log(NULL, AV_LOG_ERROR, "too many threads for %s\n", av[8]);
+        return 1;
+    }
 
     av_log(NULL, AV_LOG_INFO, "qsize:%d / %d senders sending [%d-%d] / "
            "%d receivers receiving [%d-%d]\n", max_queue_size,
@@ -203,7 +214,8 @@ int main(int ac, char **av)
         goto end;
     }
 
-    ret = av_thread_message_queue_alloc(&queue, max_queue_size, sizeof(struct message));
+    ret = av_thread_message_queue_alloc2(&queue, max_queue_size,
+                                         sizeof(struct message), flags);
     if (ret < 0)
         goto end;
 
@@ -241,6 +253,10 @@ int main(int ac, char **av)
     }                                                                           \
 } while (0)
 
+    /* a ring buffer queue may only be flushed by its receiver */
+    for (i = 0; i < nb_senders; i++)
+        senders[i].can_flush = !flags;
+
     SPAWN_THREADS(receiver);
     SPAWN_THREADS(sender);
 
@@ -210,6 +210,66 @@ transcode(){
         -f framecrc - || return
 }
 
+faststart(){
+    durations="0 $1 $2"
+    shift 2
+    encfile="${outdir}/${test}.mp4"
+    crcfile="${outdir}/${test}.crc"
+    cleanfiles="$cleanfiles $encfile $crcfile"
+    tencfile=$(target_path $encfile)
+    tcrcfile=$(target_path $crcfile)
+    # 0 is plain +faststart, the others reserve room for the moov up front,
+    # which must not change the packets
+    for duration in $durations; do
+        echo "faststart_duration $duration"
+        ffmpeg "$@" -flags +bitexact -fflags +bitexact -movflags +faststart \
+            -faststart_duration $duration -f mp4 -y $tencfile || return
+        run ffprobe${PROGSUF} -v trace $tencfile 2>&1 | grep "parent:'root'" | sed "s/.*type:/type:/"
+        ffmpeg -i $tencfile -c copy -flags +bitexact -fflags +bitexact -f framecrc -y $tcrcfile || return
+        do_md5sum $crcfile
+    done
+}
+
+reserved_index(){
+    enc_fmt=$1
+    seek_duration=$2
+    shift 2
+    encfile="${outdir}/${test}.${enc_fmt}"
+    partfile="${outdir}/${test}-part.${enc_fmt}"
+    cleanfiles="$cleanfiles $encfile $partfile"
+    ffmpeg "$@" -flags +bitexact -fflags +bitexact -f $enc_fmt -y $(target_path $encfile) || return
+    do_md5sum $encfile
+    echo $(wc -c $encfile)
+    # the index in front of the media data must keep a truncated file seekable
+    head -c $(($(wc -c < $encfile) / 2)) $encfile > $partfile
+    run libavformat/tests/seek${EXECSUF} $(target_path $partfile) -duration $seek_duration
+}
+
+mpegts_index(){
+    srcfile=$1
+    encfile="${outdir}/${test}.ts"
+    idxfile="${outdir}/${test}.idx"
+    crcfile="${outdir}/${test}.crc"
+    cleanfiles="$cleanfiles $encfile $idxfile $crcfile"
+    tencfile=$(target_path $encfile)
+    tidxfile=$(target_path $idxfile)
+    ffmpeg -i $(target_path $srcfile) -map 0 -c copy -flags +bitexact -fflags +bitexact \
+        -f mpegts -index_file $tidxfile -y $tencfile || return
+    do_md5sum $idxfile
+    for index in none index_file seek_index; do
+        case $index in
+            none)       opts= ;;
+            index_file) opts="-index_file $tidxfile" ;;
+            seek_index) opts="-seek_index 1" ;;
+        esac
+        echo "index: $index"
+        ffmpeg $opts -i $tencfile -map 0 -c copy -flags +bitexact -fflags +bitexact \
+            -f framecrc -y $(target_path $crcfile) || return
+        do_md5sum $crcfile
+        run libavformat/tests/seek${EXECSUF} $tencfile $opts
+    done
+}
+
 lavffatetest(){
     t="${test#lavf-fate-}"
     ref=${base}/ref/lavf-fate/$t
@@ -34,6 +34,18 @@ fate-api-threadmessage: CMD = run $(APITESTSDIR)/api-threadmessage-test 3 10 30
 fate-api-threadmessage: CMP = null
 fate-api-threadmessage: REF = /dev/null
 
+FATE_API-$(HAVE_THREADS) += fate-api-threadmessage-mpsc
+fate-api-threadmessage-mpsc: $(APITESTSDIR)/api-threadmessage-test$(EXESUF)
+fate-api-threadmessage-mpsc: CMD = run $(APITESTSDIR)/api-threadmessage-test 3 10 30 50 1 20 40 mpsc
+fate-api-threadmessage-mpsc: CMP = null
+fate-api-threadmessage-mpsc: REF = /dev/null
+
+FATE_API-$(HAVE_THREADS) += fate-api-threadmessage-spsc
+fate-api-threadmessage-spsc: $(APITESTSDIR)/api-threadmessage-test$(EXESUF)
+fate-api-threadmessage-spsc: CMD = run $(APITESTSDIR)/api-threadmessage-test 3 1 30 50 1 20 40 spsc
+fate-api-threadmessage-spsc: CMP = null
+fate-api-threadmessage-spsc: REF = /dev/null
+
 FATE_API_SAMPLES-$(CONFIG_AVFORMAT) += $(FATE_API_SAMPLES_LIBAVFORMAT-yes)
 
 ifdef SAMPLES
@@ -104,6 +104,18 @@ fate-filter-dcshift: tests/data/asynth-44100-2.wav
 fate-filter-dcshift: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
 fate-filter-dcshift: CMD = framecrc -i $(SRC) -aframes 20 -af dcshift=shift=0.25:limitergain=0.05
 
+FATE_FILTER_DYNAUDNORM += fate-filter-dynaudnorm-altboundary
+fate-filter-dynaudnorm-altboundary: tests/data/asynth-44100-2.wav
+fate-filter-dynaudnorm-altboundary: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-dynaudnorm-altboundary: CMD = framecrc -i $(SRC) -af afade=t=in:d=4,dynaudnorm=f=100:b=1
+
+FATE_FILTER_DYNAUDNORM += fate-filter-dynaudnorm-lookahead
+fate-filter-dynaudnorm-lookahead: tests/data/asynth-44100-2.wav
+fate-filter-dynaudnorm-lookahead: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-dynaudnorm-lookahead: CMD = framecrc -i $(SRC) -af afade=t=in:d=4,dynaudnorm=f=100:b=1:l=3
+
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, AFADE DYNAUDNORM, WAV, PCM_S16LE, PCM_S16LE, WAV) += $(FATE_FILTER_DYNAUDNORM)
+
 FATE_AFILTER-$(call FILTERDEMDECENCMUX, EARWAX, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-earwax
 fate-filter-earwax: tests/data/asynth-44100-2.wav
 fate-filter-earwax: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
@@ -279,6 +291,10 @@ fate-filter-hdcd-detect-errors: CMD = md5 -i $(SRC) -af hdcd -f s24le
 fate-filter-hdcd-detect-errors: CMP = grep
 fate-filter-hdcd-detect-errors: REF = detectable errors: [1-9]
 
+FATE_AFILTER-$(CONFIG_LOUDNORM_FILTER) += fate-filter-ebur128
+fate-filter-ebur128: libavfilter/tests/ebur128$(EXESUF)
+fate-filter-ebur128: CMD = run libavfilter/tests/ebur128
+
 FATE_AFILTER-yes += fate-filter-formats
 fate-filter-formats: libavfilter/tests/formats$(EXESUF)
 fate-filter-formats: CMD = run libavfilter/tests/formats
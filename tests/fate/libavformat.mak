@@ -18,6 +18,10 @@ FATE_LIBAVFORMAT-yes += fate-url
 fate-url: libavformat/tests/url$(EXESUF)
 fate-url: CMD = run libavformat/tests/url
 
+FATE_LIBAVFORMAT-$(CONFIG_FRAMECRC_MUXER) += fate-interleave
+fate-interleave: libavformat/tests/interleave$(EXESUF)
+fate-interleave: CMD = run libavformat/tests/interleave
+
 FATE_LIBAVFORMAT-$(CONFIG_MOV_MUXER) += fate-movenc
 fate-movenc: libavformat/tests/movenc$(EXESUF)
 fate-movenc: CMD = run libavformat/tests/movenc
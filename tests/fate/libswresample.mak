@@ -749,5 +749,10 @@ fate-swr-audioconvert: CMP = stddev
 fate-swr-audioconvert: FUZZ = 0
 
 FATE_SWR += $(FATE_SWR_AUDIOCONVERT-yes)
+FATE_SWR_LIB-$(CONFIG_SWRESAMPLE) += fate-swr-filter-cache
+fate-swr-filter-cache: libswresample/tests/filter_cache$(EXESUF)
+fate-swr-filter-cache: CMD = run libswresample/tests/filter_cache
+
+FATE-yes += $(FATE_SWR_LIB-yes)
 FATE_FFMPEG += $(FATE_SWR)
-fate-swr: $(FATE_SWR)
+fate-swr: $(FATE_SWR) $(FATE_SWR_LIB-yes)
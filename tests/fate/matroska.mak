@@ -7,3 +7,10 @@ fate-matroska-remux: CMP = oneline
 fate-matroska-remux: REF = 9b8398b42804ba12c39d2f47299a0996
 
 FATE_SAMPLES_AVCONV += $(FATE_MATROSKA-yes)
+
+# Index rewritten in reserved space every 5 seconds, thinned out to fit.
+FATE_MATROSKA_FFMPEG-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER MPEG4_ENCODER MATROSKA_MUXER MATROSKA_DEMUXER MPEG4_DECODER) += fate-matroska-reserved-cues
+fate-matroska-reserved-cues: libavformat/tests/seek$(EXESUF)
+fate-matroska-reserved-cues: CMD = reserved_index matroska 60 -f lavfi -i testsrc=r=25:d=120:s=64x48 -c:v mpeg4 -g 25 -cluster_time_limit 500 -cues_interval 5000 -reserve_index_space 300
+
+FATE_FFMPEG += $(FATE_MATROSKA_FFMPEG-yes)
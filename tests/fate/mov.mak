@@ -30,3 +30,13 @@ fate-mov-2elist-elist1-ends-bframe: CMD = framemd5 -i $(TARGET_SAMPLES)/mov/mov-
 
 fate-mov-aac-2048-priming: ffprobe$(PROGSSUF)$(EXESUF)
 fate-mov-aac-2048-priming: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_packets -print_format compact $(TARGET_SAMPLES)/mov/aac-2048-priming.mov
+
+# The moov must end up in front of the same packets whether its room was
+# reserved from faststart_duration, the reservation was too small and the
+# media data had to be moved, or plain +faststart moved everything.
+FATE_MOV_FFMPEG-$(call ALLYES, FFPROBE LAVFI_INDEV TESTSRC_FILTER SINE_FILTER MPEG4_ENCODER MP2FIXED_ENCODER MP4_MUXER MOV_DEMUXER FRAMECRC_MUXER) += fate-mov-faststart-duration
+fate-mov-faststart-duration: ffprobe$(PROGSSUF)$(EXESUF)
+fate-mov-faststart-duration: CMD = faststart 30 1 -f lavfi -i testsrc=r=25:d=30:s=64x48 -f lavfi -i sine=d=30 -c:v mpeg4 -c:a mp2fixed -shortest
+
+FATE_FFMPEG += $(FATE_MOV_FFMPEG-yes)
+fate-mov: $(FATE_MOV_FFMPEG-yes)